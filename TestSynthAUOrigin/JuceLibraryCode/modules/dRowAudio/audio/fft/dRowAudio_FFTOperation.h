@@ -111,6 +111,13 @@ public:
 	
 	void performFFT (float* samples);
 	
+	/** Transforms the contents of the FFT buffer (as left by performFFT(), and
+		possibly modified in place since) back into fftSize time-domain samples.
+		The result is unnormalised, and its scale differs between platforms, so
+		callers should measure the round-trip gain rather than assume it.
+	 */
+	void performIFFT (float* samples);
+	
 private:
     //==============================================================================
 	FFTProperties fftProperties;
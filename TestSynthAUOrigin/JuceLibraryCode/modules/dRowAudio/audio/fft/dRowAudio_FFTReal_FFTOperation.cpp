@@ -67,6 +67,11 @@ void FFTOperation::performFFT (float* samples)
     fftConfig->do_fft (fftBuffer.getData(), samples);
 }
 
+void FFTOperation::performIFFT (float* samples)
+{
+    fftConfig->do_ifft (fftBuffer.getData(), samples);
+}
+
 
 
 #endif //DROWAUDIO_USE_FFTREAL
\ No newline at end of file
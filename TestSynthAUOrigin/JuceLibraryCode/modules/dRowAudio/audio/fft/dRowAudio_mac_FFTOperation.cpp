@@ -69,6 +69,12 @@ void FFTOperation::performFFT (float* samples)
 	vDSP_fft_zrip (fftConfig, &fftBufferSplit, 1, fftProperties.fftSizeLog2, FFT_FORWARD);
 }
 
+void FFTOperation::performIFFT (float* samples)
+{
+	vDSP_fft_zrip (fftConfig, &fftBufferSplit, 1, fftProperties.fftSizeLog2, FFT_INVERSE);
+	vDSP_ztoc (&fftBufferSplit, 1, (COMPLEX *) samples, 2, fftProperties.fftSizeHalved);
+}
+
 //============================================================================
 
 
@@ -26,7 +26,7 @@
 #define JUCE_AUDIO_BASICS_H_INCLUDED
 
 #include "../juce_core/juce_core.h"
-#include "modules/stk_module/stk/stk.h"
+#include "modules/stk_module/stk/Stk.h"
 
 //=============================================================================
 namespace juce
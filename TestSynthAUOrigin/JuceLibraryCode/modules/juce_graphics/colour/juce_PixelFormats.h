@@ -87,11 +87,12 @@ public:
     forcedinline uint8 getBlue() const noexcept     { return components.b; }
 
    #if JUCE_GCC && ! JUCE_CLANG
-    // NB these are here as a workaround because GCC refuses to bind to packed values.
-    forcedinline uint8& getAlpha() noexcept         { return comps [indexA]; }
-    forcedinline uint8& getRed() noexcept           { return comps [indexR]; }
-    forcedinline uint8& getGreen() noexcept         { return comps [indexG]; }
-    forcedinline uint8& getBlue() noexcept          { return comps [indexB]; }
+    // NB these are here as a workaround because GCC refuses to bind to packed values
+    // (and GCC 9 on won't bind to the packed array either, so it's reached by pointer).
+    forcedinline uint8& getAlpha() noexcept         { return reinterpret_cast<uint8*> (this) [indexA]; }
+    forcedinline uint8& getRed() noexcept           { return reinterpret_cast<uint8*> (this) [indexR]; }
+    forcedinline uint8& getGreen() noexcept         { return reinterpret_cast<uint8*> (this) [indexG]; }
+    forcedinline uint8& getBlue() noexcept          { return reinterpret_cast<uint8*> (this) [indexB]; }
    #else
     forcedinline uint8& getAlpha() noexcept         { return components.a; }
     forcedinline uint8& getRed() noexcept           { return components.r; }
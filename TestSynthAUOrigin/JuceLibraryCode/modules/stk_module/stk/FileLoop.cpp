@@ -98,7 +98,7 @@ void FileLoop :: addTime( StkFloat time )
   // Add an absolute time in samples.
   time_ += time;
 
-  StkFloat fileSize = file_.fileSize();
+  StkFloat fileSize = loopSize();
   while ( time_ < 0.0 )
     time_ += fileSize;
   while ( time_ >= fileSize )
@@ -108,7 +108,7 @@ void FileLoop :: addTime( StkFloat time )
 void FileLoop :: addPhase( StkFloat angle )
 {
   // Add a time in cycles (one cycle = fileSize).
-  StkFloat fileSize = file_.fileSize();
+  StkFloat fileSize = loopSize();
   time_ += fileSize * angle;
 
   while ( time_ < 0.0 )
@@ -120,7 +120,7 @@ void FileLoop :: addPhase( StkFloat angle )
 void FileLoop :: addPhaseOffset( StkFloat angle )
 {
   // Add a phase offset in cycles, where 1.0 = fileSize.
-  phaseOffset_ = file_.fileSize() * angle;
+  phaseOffset_ = loopSize() * angle;
 }
 
 StkFloat FileLoop :: tick( unsigned int channel )
@@ -134,7 +134,7 @@ StkFloat FileLoop :: tick( unsigned int channel )
 
   // Check limits of time address ... if necessary, recalculate modulo
   // fileSize.
-  StkFloat fileSize = file_.fileSize();
+  StkFloat fileSize = loopSize();
 
   while ( time_ < 0.0 )
     time_ += fileSize;
@@ -197,7 +197,7 @@ StkFloat FileLoop :: tick( unsigned int channel )
 
 StkFrames& FileLoop :: tick( StkFrames& frames )
 {
-  if ( !file_.isOpen() ) {
+  if ( lastFrame_.size() == 0 ) { // neither a file nor frames are open
 #if defined(_STK_DEBUG_)
     oStream_ << "FileLoop::tick(): no file data is loaded!";
     handleError( StkError::WARNING );
@@ -48,6 +48,17 @@ class FileLoop : protected FileWvIn
   */
   void openFile( std::string fileName, bool raw = false, bool doNormalize = true );
 
+  //! Loop sample data from memory rather than a file, sharing it rather than copying it.
+  /*!
+    The frames must end with a copy of their first frame, as the
+    data of a FileLoop does (so another FileLoop's getFrames() can be
+    shared), and must outlive this object.
+  */
+  void openFrames( const StkFrames& frames ) { FileWvIn::openFrames( frames ); };
+
+  //! Return the sample data, including the repeated first frame at its end.
+  const StkFrames& getFrames( void ) const { return data_; };
+
   //! Close a file if one is open.
   void closeFile( void ) { FileWvIn::closeFile(); };
 
@@ -95,7 +106,7 @@ class FileLoop : protected FileWvIn
     corresponds to file cycles per second.  The frequency can be
     negative, in which case the loop is read in reverse order.
   */
-  void setFrequency( StkFloat frequency ) { this->setRate( file_.fileSize() * frequency / Stk::sampleRate() ); };
+  void setFrequency( StkFloat frequency ) { this->setRate( loopSize() * frequency / Stk::sampleRate() ); };
 
   //! Increment the read pointer by \e time samples, modulo file size.
   void addTime( StkFloat time );
@@ -154,6 +165,10 @@ class FileLoop : protected FileWvIn
 
  protected:
 
+  // The length of the loop in frames (the data in memory carries one more,
+  // a copy of the first).
+  unsigned long loopSize( void ) const { return chunking_ ? file_.fileSize() : ( data_.frames() > 0 ? data_.frames() - 1 : 0 ); };
+
   StkFrames firstFrame_;
   StkFloat phaseOffset_;
 
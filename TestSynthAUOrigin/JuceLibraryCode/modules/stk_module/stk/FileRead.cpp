@@ -38,8 +38,125 @@
 #include <cmath>
 #include <cstdio>
 
+// read() decodes with SSE2 or NEON where the target has it.
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+  #include <emmintrin.h>
+  #define STK_FILEREAD_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+  #include <arm_neon.h>
+  #define STK_FILEREAD_NEON
+#endif
+
 namespace stk {
 
+// The decoders used by read().  The file data is read straight into the
+// front of the StkFloat buffer it's decoded into, so each works backwards
+// from the end of the data: nothing is written over samples that are
+// still to be read.
+#if defined(STK_FILEREAD_SSE2)
+static inline __m128i swapBytes16( __m128i x )
+{
+  return _mm_or_si128( _mm_slli_epi16( x, 8 ), _mm_srli_epi16( x, 8 ) );
+}
+
+static inline __m128i swapBytes32( __m128i x )
+{
+  x = swapBytes16( x );
+  return _mm_shufflehi_epi16( _mm_shufflelo_epi16( x, _MM_SHUFFLE( 2, 3, 0, 1 ) ), _MM_SHUFFLE( 2, 3, 0, 1 ) );
+}
+#endif
+
+static void decodeInt16( StkFloat *out, SINT16 *in, long nSamples, bool byteswap, StkFloat gain )
+{
+  long i = nSamples;
+#if defined(STK_FILEREAD_SSE2)
+  const __m128 vgain = _mm_set1_ps( gain );
+  while ( i >= 8 ) {
+    i -= 8;
+    __m128i x = _mm_loadu_si128( (const __m128i *) ( in + i ) );
+    if ( byteswap ) x = swapBytes16( x );
+    const __m128i lo = _mm_srai_epi32( _mm_unpacklo_epi16( x, x ), 16 );
+    const __m128i hi = _mm_srai_epi32( _mm_unpackhi_epi16( x, x ), 16 );
+    _mm_storeu_ps( out + i + 4, _mm_mul_ps( _mm_cvtepi32_ps( hi ), vgain ) );
+    _mm_storeu_ps( out + i, _mm_mul_ps( _mm_cvtepi32_ps( lo ), vgain ) );
+  }
+#elif defined(STK_FILEREAD_NEON)
+  const float32x4_t vgain = vdupq_n_f32( gain );
+  while ( i >= 8 ) {
+    i -= 8;
+    int16x8_t x = vld1q_s16( in + i );
+    if ( byteswap ) x = vreinterpretq_s16_u8( vrev16q_u8( vreinterpretq_u8_s16( x ) ) );
+    vst1q_f32( out + i + 4, vmulq_f32( vcvtq_f32_s32( vmovl_s16( vget_high_s16( x ) ) ), vgain ) );
+    vst1q_f32( out + i, vmulq_f32( vcvtq_f32_s32( vmovl_s16( vget_low_s16( x ) ) ), vgain ) );
+  }
+#endif
+  while ( i-- > 0 ) {
+    SINT16 x = in[i];
+    if ( byteswap ) Stk::swap16( (unsigned char *) &x );
+    out[i] = x * gain;
+  }
+}
+
+static void decodeInt32( StkFloat *out, SINT32 *in, long nSamples, bool byteswap, StkFloat gain )
+{
+  long i = nSamples;
+#if defined(STK_FILEREAD_SSE2)
+  const __m128 vgain = _mm_set1_ps( gain );
+  while ( i >= 4 ) {
+    i -= 4;
+    __m128i x = _mm_loadu_si128( (const __m128i *) ( in + i ) );
+    if ( byteswap ) x = swapBytes32( x );
+    _mm_storeu_ps( out + i, _mm_mul_ps( _mm_cvtepi32_ps( x ), vgain ) );
+  }
+#elif defined(STK_FILEREAD_NEON)
+  const float32x4_t vgain = vdupq_n_f32( gain );
+  while ( i >= 4 ) {
+    i -= 4;
+    int32x4_t x = vld1q_s32( in + i );
+    if ( byteswap ) x = vreinterpretq_s32_u8( vrev32q_u8( vreinterpretq_u8_s32( x ) ) );
+    vst1q_f32( out + i, vmulq_f32( vcvtq_f32_s32( x ), vgain ) );
+  }
+#endif
+  while ( i-- > 0 ) {
+    SINT32 x = in[i];
+    if ( byteswap ) Stk::swap32( (unsigned char *) &x );
+    out[i] = x * gain;
+  }
+}
+
+// (in place, as StkFloat is also 32-bit float)
+static void swapFloat32( FLOAT32 *data, long nSamples )
+{
+  long i = nSamples;
+#if defined(STK_FILEREAD_SSE2)
+  while ( i >= 4 ) {
+    i -= 4;
+    __m128i *ptr = (__m128i *) ( data + i );
+    _mm_storeu_si128( ptr, swapBytes32( _mm_loadu_si128( ptr ) ) );
+  }
+#elif defined(STK_FILEREAD_NEON)
+  while ( i >= 4 ) {
+    i -= 4;
+    vst1q_f32( data + i, vreinterpretq_f32_u8( vrev32q_u8( vreinterpretq_u8_f32( vld1q_f32( data + i ) ) ) ) );
+  }
+#endif
+  while ( i-- > 0 )
+    Stk::swap32( (unsigned char *) ( data + i ) );
+}
+
+// 24-bit samples are placed in the top of a 32-bit integer (as the gain
+// expects), from big- or little-endian byte order.
+static void decodeInt24( StkFloat *out, const unsigned char *in, long nSamples, bool bigEndian, StkFloat gain )
+{
+  for ( long i=nSamples-1; i>=0; i-- ) {
+    const unsigned char *ptr = in + 3 * i;
+    const UINT32 value = bigEndian
+      ? ( (UINT32) ptr[0] << 24 ) | ( (UINT32) ptr[1] << 16 ) | ( (UINT32) ptr[2] << 8 )
+      : ( (UINT32) ptr[2] << 24 ) | ( (UINT32) ptr[1] << 16 ) | ( (UINT32) ptr[0] << 8 );
+    out[i] = (StkFloat) (SINT32) value * gain;
+  }
+}
+
 FileRead :: FileRead()
   : fd_(0), fileSize_(0), channels_(0), dataType_(0), fileRate_(0.0)
 {
@@ -744,68 +861,39 @@ void FileRead :: read( StkFrames& buffer, unsigned long startFrame, bool doNorma
   long i, nSamples = (long) ( nFrames * channels_ );
   unsigned long offset = startFrame * channels_;
 
-  // Read samples into StkFrames data buffer.
+  // Read samples into StkFrames data buffer, each format with a single
+  // read, then decode them in place.
   if ( dataType_ == STK_SINT16 ) {
     SINT16 *buf = (SINT16 *) &buffer[0];
     if ( fseek( fd_, dataOffset_+(offset*2), SEEK_SET ) == -1 ) goto error;
     if ( fread( buf, nSamples * 2, 1, fd_ ) != 1 ) goto error;
-    if ( byteswap_ ) {
-      SINT16 *ptr = buf;
-      for ( i=nSamples-1; i>=0; i-- )
-        swap16( (unsigned char *) ptr++ );
-    }
-    if ( doNormalize ) {
-      StkFloat gain = 1.0 / 32768.0;
-      for ( i=nSamples-1; i>=0; i-- )
-        buffer[i] = buf[i] * gain;
-    }
-    else {
-      for ( i=nSamples-1; i>=0; i-- )
-        buffer[i] = buf[i];
-    }
+    decodeInt16( &buffer[0], buf, nSamples, byteswap_, doNormalize ? 1.0 / 32768.0 : 1.0 );
   }
   else if ( dataType_ == STK_SINT32 ) {
     SINT32 *buf = (SINT32 *) &buffer[0];
     if ( fseek( fd_, dataOffset_+(offset*4 ), SEEK_SET ) == -1 ) goto error;
     if ( fread( buf, nSamples * 4, 1, fd_ ) != 1 ) goto error;
-    if ( byteswap_ ) {
-      SINT32 *ptr = buf;
-      for ( i=nSamples-1; i>=0; i-- )
-        swap32( (unsigned char *) ptr++ );
-    }
-    if ( doNormalize ) {
-      StkFloat gain = 1.0 / 2147483648.0;
-      for ( i=nSamples-1; i>=0; i-- )
-        buffer[i] = buf[i] * gain;
-    }
-    else {
-      for ( i=nSamples-1; i>=0; i-- )
-        buffer[i] = buf[i];
-    }
+    decodeInt32( &buffer[0], buf, nSamples, byteswap_, doNormalize ? 1.0 / 2147483648.0 : 1.0 );
   }
   else if ( dataType_ == STK_FLOAT32 ) {
     FLOAT32 *buf = (FLOAT32 *) &buffer[0];
     if ( fseek( fd_, dataOffset_+(offset*4), SEEK_SET ) == -1 ) goto error;
     if ( fread( buf, nSamples * 4, 1, fd_ ) != 1 ) goto error;
-    if ( byteswap_ ) {
-      FLOAT32 *ptr = buf;
-      for ( i=nSamples-1; i>=0; i-- )
-        swap32( (unsigned char *) ptr++ );
-    }
-    for ( i=nSamples-1; i>=0; i-- )
-      buffer[i] = buf[i];
+    if ( byteswap_ ) swapFloat32( buf, nSamples );
   }
   else if ( dataType_ == STK_FLOAT64 ) {
-    FLOAT64 *buf = (FLOAT64 *) &buffer[0];
+    // (a frame of doubles is bigger than the StkFloat frame it's read into,
+    // so these are read in blocks)
+    FLOAT64 block[1024];
     if ( fseek( fd_, dataOffset_+(offset*8), SEEK_SET ) == -1 ) goto error;
-    if ( fread( buf, nSamples * 8, 1, fd_ ) != 1 ) goto error;
-    if ( byteswap_ ) {
-      FLOAT64 *ptr = buf;
-      for ( i=nSamples-1; i>=0; i-- )
-        swap64( (unsigned char *) ptr++ );
+    for ( i=0; i<nSamples; i+=1024 ) {
+      long n = nSamples - i < 1024 ? nSamples - i : 1024;
+      if ( fread( block, n * 8, 1, fd_ ) != 1 ) goto error;
+      for ( long j=0; j<n; j++ ) {
+        if ( byteswap_ ) swap64( (unsigned char *) &block[j] );
+        buffer[i+j] = (StkFloat) block[j];
+      }
     }
-    for ( i=nSamples-1; i>=0; i-- )
-      buffer[i] = buf[i];
   }
   else if ( dataType_ == STK_SINT8 && wavFile_ ) { // 8-bit WAV data is unsigned!
     unsigned char *buf = (unsigned char *) &buffer[0];
@@ -836,42 +924,18 @@ void FileRead :: read( StkFrames& buffer, unsigned long startFrame, bool doNorma
     }
   }
   else if ( dataType_ == STK_SINT24 ) {
-    // 24-bit values are harder to import efficiently since there is
-    // no native 24-bit type.  The following routine works but is much
-    // less efficient than that used for the other data types.
-    SINT32 temp;
-    unsigned char *ptr = (unsigned char *) &temp;
-    StkFloat gain = 1.0 / 2147483648.0;
-    if ( fseek(fd_, dataOffset_+(offset*3), SEEK_SET ) == -1 ) goto error;
-    for ( i=0; i<nSamples; i++ ) {
+    // There's no native 24-bit type, so the bytes are assembled by hand
+    // (but read in one go, rather than three at a time).
+    unsigned char *buf = (unsigned char *) &buffer[0];
+    if ( fseek( fd_, dataOffset_+(offset*3), SEEK_SET ) == -1 ) goto error;
+    if ( fread( buf, nSamples * 3, 1, fd_ ) != 1 ) goto error;
 #ifdef __LITTLE_ENDIAN__
-      if ( byteswap_ ) {
-        if ( fread( ptr, 3, 1, fd_ ) != 1 ) goto error;
-        temp &= 0x00ffffff;
-        swap32( (unsigned char *) ptr );
-      }
-      else {
-        if ( fread( ptr+1, 3, 1, fd_ ) != 1 ) goto error;
-        temp &= 0xffffff00;
-      }
+    bool bigEndian = byteswap_;
 #else
-      if ( byteswap_ ) {
-        if ( fread( ptr+1, 3, 1, fd_ ) != 1 ) goto error;
-        temp &= 0xffffff00;
-        swap32( (unsigned char *) ptr );
-      }
-      else {
-        if ( fread( ptr, 3, 1, fd_ ) != 1 ) goto error;
-        temp &= 0x00ffffff;
-      }
+    bool bigEndian = !byteswap_;
 #endif
-
-      if ( doNormalize ) {
-        buffer[i] = (StkFloat) temp * gain; // "gain" also  includes 1 / 256 factor.
-      }
-      else
-        buffer[i] = (StkFloat) temp / 256;  // right shift without affecting the sign bit
-    }
+    // "gain" also includes the 1 / 256 for the sample's place in 32 bits
+    decodeInt24( &buffer[0], buf, nSamples, bigEndian, doNormalize ? 1.0 / 2147483648.0 : 1.0 / 256.0 );
   }
 
   buffer.setDataRate( fileRate_ );
@@ -67,6 +67,8 @@ void FileWvIn :: sampleRateChanged( StkFloat newRate, StkFloat oldRate )
 void FileWvIn :: closeFile( void )
 {
   if ( file_.isOpen() ) file_.close();
+  // Let go of any shared frames, so that the next file isn't read into them.
+  if ( data_.isView() ) data_ = StkFrames();
   finished_ = true;
   lastFrame_.resize( 0, 0 );
 }
@@ -106,6 +108,18 @@ void FileWvIn :: openFile( std::string fileName, bool raw, bool doNormalize )
   this->reset();
 }
 
+void FileWvIn :: openFrames( const StkFrames& frames )
+{
+  this->closeFile();
+  chunking_ = false;
+
+  data_.setView( frames );
+  lastFrame_.resize( 1, data_.channels() );
+
+  this->setRate( data_.dataRate() / Stk::sampleRate() );
+  this->reset();
+}
+
 void FileWvIn :: reset(void)
 {
   time_ = (StkFloat) 0.0;
@@ -124,19 +138,22 @@ void FileWvIn :: normalize( StkFloat peak )
   // When chunking, the "normalization" scaling is performed by FileRead.
   if ( chunking_ ) return;
 
-  size_t i;
+  size_t i, n = data_.size();
   StkFloat max = 0.0;
+  if ( n == 0 ) return;
 
-  for ( i=0; i<data_.size(); i++ ) {
-    if ( fabs( data_[i] ) > max )
-      max = (StkFloat) fabs((double) data_[i]);
+  // (kept in StkFloat, and free of branches, so that both passes vectorise)
+  StkFloat *data = &data_[0];
+  for ( i=0; i<n; i++ ) {
+    StkFloat magnitude = data[i] < 0.0f ? -data[i] : data[i];
+    max = magnitude > max ? magnitude : max;
   }
 
   if ( max > 0.0 ) {
     max = 1.0 / max;
     max *= peak;
-    for ( i=0; i<data_.size(); i++ )
-      data_[i] *= max;
+    for ( i=0; i<n; i++ )
+      data[i] *= max;
   }
 }
 
@@ -146,7 +163,7 @@ void FileWvIn :: setRate( StkFloat rate )
 
   // If negative rate and at beginning of sound, move pointer to end
   // of sound.
-  if ( (rate_ < 0) && (time_ == 0.0) ) time_ = file_.fileSize() - 1.0;
+  if ( (rate_ < 0) && (time_ == 0.0) ) time_ = dataSize() - 1.0;
 
   if ( fmod( rate_, 1.0 ) != 0.0 ) interpolate_ = true;
   else interpolate_ = false;
@@ -158,8 +175,8 @@ void FileWvIn :: addTime( StkFloat time )
   time_ += time;
 
   if ( time_ < 0.0 ) time_ = 0.0;
-  if ( time_ > file_.fileSize() - 1.0 ) {
-    time_ = file_.fileSize() - 1.0;
+  if ( time_ > dataSize() - 1.0 ) {
+    time_ = dataSize() - 1.0;
     for ( unsigned int i=0; i<lastFrame_.size(); i++ ) lastFrame_[i] = 0.0;
     finished_ = true;
   }
@@ -177,7 +194,7 @@ StkFloat FileWvIn :: tick( unsigned int channel )
   if ( finished_ ) return 0.0;
 
 //    printf("%f / %f\n", time_, (StkFloat) ( file_.fileSize() - 1.0 ));
-  if ( time_ < 0.0 || time_ > (StkFloat) ( file_.fileSize() - 1.0 ) ) {
+  if ( time_ < 0.0 || time_ > (StkFloat) ( dataSize() - 1.0 ) ) {
     for ( unsigned int i=0; i<lastFrame_.size(); i++ ) lastFrame_[i] = 0.0;
 //      printf("Finished\n"); // CN
     finished_ = true;
@@ -226,7 +243,7 @@ StkFloat FileWvIn :: tick( unsigned int channel )
 
 StkFrames& FileWvIn :: tick( StkFrames& frames )
 {
-  if ( !file_.isOpen() ) {
+  if ( lastFrame_.size() == 0 ) { // neither a file nor frames are open
 #if defined(_STK_DEBUG_)
     oStream_ << "FileWvIn::tick(): no file data is loaded!";
     handleError( StkError::DEBUG_PRINT );
@@ -68,6 +68,17 @@ public:
   */
   virtual void openFile( std::string fileName, bool raw = false, bool doNormalize = true );
 
+  //! Play sample data from memory rather than a file, sharing it rather than copying it.
+  /*!
+    Any open file is closed, and the rate is set from the frames'
+    data rate.  The frames must outlive this object (and any other
+    sharing them through getFrames()).
+  */
+  virtual void openFrames( const StkFrames& frames );
+
+  //! Return the sample data (or, when reading incrementally from disk, the current chunk of it).
+  const StkFrames& getFrames( void ) const { return data_; };
+
   //! Close a file if one is open.
   virtual void closeFile( void );
 
@@ -89,7 +100,7 @@ public:
   virtual void normalize( StkFloat peak );
 
   //! Return the file size in sample frames.
-  virtual unsigned long getSize( void ) const { return file_.fileSize(); };
+  virtual unsigned long getSize( void ) const { return dataSize(); };
 
   //! Return the input file sample rate in Hz (not the data read rate).
   /*!
@@ -165,6 +176,10 @@ protected:
 
   void sampleRateChanged( StkFloat newRate, StkFloat oldRate );
 
+  // The length of the sound in frames: the file's when it's read from disk
+  // in chunks, otherwise that of the data in memory.
+  unsigned long dataSize( void ) const { return chunking_ ? file_.fileSize() : data_.frames(); };
+
   FileRead file_;
   bool finished_;
   bool interpolate_;
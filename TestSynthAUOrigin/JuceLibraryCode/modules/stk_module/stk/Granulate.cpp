@@ -85,8 +85,10 @@ void Granulate :: setRandomFactor( StkFloat randomness )
 
 void Granulate :: openFile( std::string fileName, bool typeRaw )
 {
-  // Attempt to load the soundfile data.
+  // Attempt to load the soundfile data (into data of our own, if we were
+  // sharing some).
   FileRead file( fileName, typeRaw );
+  if ( data_.isView() ) data_ = StkFrames();
   data_.resize( file.fileSize(), file.channels() );
   file.read( data_ );
   lastFrame_.resize( 1, file.channels(), 0.0 );
@@ -101,6 +103,14 @@ void Granulate :: openFile( std::string fileName, bool typeRaw )
 
 }
 
+void Granulate :: openFrames( const StkFrames& frames )
+{
+  data_.setView( frames );
+  lastFrame_.resize( 1, data_.channels(), 0.0 );
+
+  this->reset();
+}
+
 void Granulate :: reset( void )
 {
   gPointer_ = 0;
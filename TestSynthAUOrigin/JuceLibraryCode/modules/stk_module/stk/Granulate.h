@@ -44,6 +44,12 @@ class Granulate: public Generator
   */
   void openFile( std::string fileName, bool typeRaw = false );
 
+  //! Granulate monophonic sample data from memory, sharing it rather than copying it.
+  /*!
+    The frames must outlive this object.
+  */
+  void openFrames( const StkFrames& frames );
+
   //! Reset the file pointer and all existing grains to the file start.
   /*!
     Multiple grains are offset from one another in time by grain
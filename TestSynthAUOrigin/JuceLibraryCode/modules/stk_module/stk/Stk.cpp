@@ -52,6 +52,7 @@
 
 #include "Stk.h"
 #include <stdlib.h>
+#include <string.h>
 
 namespace stk {
 
@@ -228,38 +229,59 @@ void Stk :: handleError( std::string message, StkError::Type type )
 // StkFrames definitions
 //
 
+StkFloat *StkFrames :: allocate( size_t size )
+{
+  void *ptr = 0;
+#if defined(_MSC_VER)
+  ptr = _aligned_malloc( size * sizeof( StkFloat ), STK_FRAMES_ALIGNMENT );
+#else
+  if ( posix_memalign( &ptr, STK_FRAMES_ALIGNMENT, size * sizeof( StkFloat ) ) != 0 ) ptr = 0;
+#endif
+
+#if defined(_STK_DEBUG_)
+  if ( ptr == NULL ) {
+    std::string error = "StkFrames: memory allocation error!";
+    Stk::handleError( error, StkError::MEMORY_ALLOCATION );
+  }
+#endif
+  return (StkFloat *) ptr;
+}
+
+void StkFrames :: release( void )
+{
+  if ( data_ && owner_ ) {
+#if defined(_MSC_VER)
+    _aligned_free( data_ );
+#else
+    free( data_ );
+#endif
+  }
+  data_ = 0;
+  bufferSize_ = 0;
+  owner_ = true;
+}
+
 StkFrames :: StkFrames( unsigned int nFrames, unsigned int nChannels )
-  : data_( 0 ), nFrames_( nFrames ), nChannels_( nChannels )
+  : data_( 0 ), nFrames_( nFrames ), nChannels_( nChannels ), owner_( true )
 {
   size_ = nFrames_ * nChannels_;
   bufferSize_ = size_;
 
   if ( size_ > 0 ) {
-    data_ = (StkFloat *) calloc( size_, sizeof( StkFloat ) );
-#if defined(_STK_DEBUG_)
-    if ( data_ == NULL ) {
-      std::string error = "StkFrames: memory allocation error in constructor!";
-      Stk::handleError( error, StkError::MEMORY_ALLOCATION );
-    }
-#endif
+    data_ = allocate( size_ );
+    if ( data_ ) memset( data_, 0, size_ * sizeof( StkFloat ) );
   }
 
   dataRate_ = Stk::sampleRate();
 }
 
 StkFrames :: StkFrames( const StkFloat& value, unsigned int nFrames, unsigned int nChannels )
-  : data_( 0 ), nFrames_( nFrames ), nChannels_( nChannels )
+  : data_( 0 ), nFrames_( nFrames ), nChannels_( nChannels ), owner_( true )
 {
   size_ = nFrames_ * nChannels_;
   bufferSize_ = size_;
   if ( size_ > 0 ) {
-    data_ = (StkFloat *) malloc( size_ * sizeof( StkFloat ) );
-#if defined(_STK_DEBUG_)
-    if ( data_ == NULL ) {
-      std::string error = "StkFrames: memory allocation error in constructor!";
-      Stk::handleError( error, StkError::MEMORY_ALLOCATION );
-    }
-#endif
+    data_ = allocate( size_ );
     for ( long i=0; i<(long)size_; i++ ) data_[i] = value;
   }
 
@@ -268,27 +290,82 @@ StkFrames :: StkFrames( const StkFloat& value, unsigned int nFrames, unsigned in
 
 StkFrames :: ~StkFrames()
 {
-  if ( data_ ) free( data_ );
+  release();
 }
 
 StkFrames :: StkFrames( const StkFrames& f )
-  : data_(0), size_(0), bufferSize_(0)
+  : data_( 0 ), nFrames_( 0 ), nChannels_( 0 ), size_( 0 ), bufferSize_( 0 ), owner_( true )
 {
   resize( f.frames(), f.channels() );
-  dataRate_ = Stk::sampleRate();
-  for ( unsigned int i=0; i<size_; i++ ) data_[i] = f[i];
+  dataRate_ = f.dataRate();
+  if ( size_ > 0 ) memcpy( data_, f.data_, size_ * sizeof( StkFloat ) );
 }
 
 StkFrames& StkFrames :: operator= ( const StkFrames& f )
 {
-  data_ = 0;
-  size_ = 0;
-  bufferSize_ = 0;
+  if ( &f == this ) return *this;
+
+  // Reuse our own storage if it's big enough (a view of other data
+  // gets storage of its own).
+  if ( !owner_ ) release();
   resize( f.frames(), f.channels() );
-  dataRate_ = Stk::sampleRate();
-  for ( unsigned int i=0; i<size_; i++ ) data_[i] = f[i];
+  dataRate_ = f.dataRate();
+  if ( size_ > 0 ) memcpy( data_, f.data_, size_ * sizeof( StkFloat ) );
+  return *this;
+}
+
+#if defined(__STK_MOVE_SEMANTICS__)
+StkFrames :: StkFrames( StkFrames&& f )
+  : data_( f.data_ ), dataRate_( f.dataRate_ ), nFrames_( f.nFrames_ ), nChannels_( f.nChannels_ ),
+    size_( f.size_ ), bufferSize_( f.bufferSize_ ), owner_( f.owner_ )
+{
+  f.data_ = 0;
+  f.nFrames_ = 0;
+  f.size_ = 0;
+  f.bufferSize_ = 0;
+  f.owner_ = true;
+}
+
+StkFrames& StkFrames :: operator= ( StkFrames&& f )
+{
+  if ( &f == this ) return *this;
+
+  release();
+  data_ = f.data_;
+  dataRate_ = f.dataRate_;
+  nFrames_ = f.nFrames_;
+  nChannels_ = f.nChannels_;
+  size_ = f.size_;
+  bufferSize_ = f.bufferSize_;
+  owner_ = f.owner_;
+
+  f.data_ = 0;
+  f.nFrames_ = 0;
+  f.size_ = 0;
+  f.bufferSize_ = 0;
+  f.owner_ = true;
   return *this;
 }
+#endif
+
+void StkFrames :: setView( StkFloat *data, size_t nFrames, unsigned int nChannels )
+{
+  release();
+  owner_ = false;
+  data_ = data;
+  nFrames_ = nFrames;
+  nChannels_ = nChannels;
+  size_ = nFrames_ * nChannels_;
+  bufferSize_ = size_;
+}
+
+void StkFrames :: setView( const StkFrames& f )
+{
+  if ( &f == this ) return;
+
+  setView( f.data_, f.frames(), f.channels() );
+  dataRate_ = f.dataRate();
+}
 
 void StkFrames :: resize( size_t nFrames, unsigned int nChannels )
 {
@@ -297,14 +374,8 @@ void StkFrames :: resize( size_t nFrames, unsigned int nChannels )
 
   size_ = nFrames_ * nChannels_;
   if ( size_ > bufferSize_ ) {
-    if ( data_ ) free( data_ );
-    data_ = (StkFloat *) malloc( size_ * sizeof( StkFloat ) );
-#if defined(_STK_DEBUG_)
-    if ( data_ == NULL ) {
-      std::string error = "StkFrames::resize: memory allocation error!";
-      Stk::handleError( error, StkError::MEMORY_ALLOCATION );
-    }
-#endif
+    release();
+    data_ = allocate( size_ );
     bufferSize_ = size_;
   }
 }
@@ -344,9 +415,6 @@ StkFrames& StkFrames :: makeStereo(const StkFrames& left, const StkFrames& right
         Stk::handleError( error.str(), StkError::MEMORY_ACCESS );
     }
     
-    data_ = 0;
-    size_ = 0;
-    bufferSize_ = 0;
     resize( left.frames(), 2 );
     dataRate_ = Stk::sampleRate();
     
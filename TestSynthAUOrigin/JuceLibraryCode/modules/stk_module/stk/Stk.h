@@ -7,6 +7,12 @@
 #include <vector>
 //#include <cstdlib>
 
+// Compilers that support rvalue references get move construction and
+// assignment for StkFrames.
+#if __cplusplus >= 201103L || ( defined(_MSC_VER) && _MSC_VER >= 1600 )
+  #define __STK_MOVE_SEMANTICS__
+#endif
+
 /*! \namespace stk
     \brief The STK namespace.
 
@@ -240,6 +246,10 @@ protected:
 };
 
 
+// The alignment of StkFrames storage, in bytes (a cache line, which also
+// suits 32-byte AVX loads).
+const size_t STK_FRAMES_ALIGNMENT = 64;
+
 /***************************************************/
 /*! \class StkFrames
     \brief An STK class to handle vectorized audio data.
@@ -261,6 +271,11 @@ protected:
     Note that this class can also be used as a table with interpolating
     lookup.
 
+    Storage is aligned to STK_FRAMES_ALIGNMENT bytes, for SIMD loads.
+    An StkFrames can also be a non-owning view of sample data held
+    elsewhere (see setView()), so that several objects can share one
+    copy of a sound.  Copying a view makes an owning copy of its data.
+
     Possible future improvements in this class could include functions
     to convert to and return other data types.
 
@@ -287,6 +302,28 @@ public:
   // Assignment operator that returns a reference to self.
   StkFrames& operator= ( const StkFrames& f );
 
+#if defined(__STK_MOVE_SEMANTICS__)
+  //! Move constructor, which takes over the argument's data (or view).
+  StkFrames( StkFrames&& f );
+
+  //! Move assignment operator, which takes over the argument's data (or view).
+  StkFrames& operator= ( StkFrames&& f );
+#endif
+
+  //! Make self a non-owning view of \c nFrames frames of \c nChannels interleaved channels at \c data.
+  /*!
+    Any data self owned is freed.  The data must outlive self (and
+    anything sharing it), and is not copied until self is resized
+    beyond it.
+  */
+  void setView( StkFloat *data, size_t nFrames, unsigned int nChannels = 1 );
+
+  //! Make self a non-owning view of another StkFrames' data (see setView()), taking its data rate.
+  void setView( const StkFrames& f );
+
+  //! Returns \e true if self is a view of data it doesn't own.
+  bool isView( void ) const { return !owner_; };
+
   //! Subscript operator that returns a reference to element \c n of self.
   /*!
     The result can be used as an lvalue. This reference is valid
@@ -358,7 +395,8 @@ public:
     channels.  No element assignment is performed.  No memory
     deallocation occurs if the new size is smaller than the previous
     size.  Further, no new memory is allocated when the new size is
-    smaller or equal to a previously allocated size.
+    smaller or equal to a previously allocated size (or, for a view,
+    the size of the data viewed).
   */
   void resize( size_t nFrames, unsigned int nChannels = 1 );
 
@@ -398,12 +436,17 @@ public:
   StkFrames& toRight(const StkFrames& right);
 private:
 
+  // aligned allocation, and release of any data owned
+  static StkFloat *allocate( size_t size );
+  void release( void );
+
   StkFloat *data_;
   StkFloat dataRate_;
   size_t nFrames_;
   unsigned int nChannels_;
   size_t size_;
   size_t bufferSize_;
+  bool owner_;
 
 };
 
@@ -0,0 +1,144 @@
+//
+//  AnalysisTap.h
+//  TestSynthAU
+//
+//  Feeds the editor's scopes without them being touched by the audio thread. The
+//  audio thread copies the master output and one selected bus into lock-free FIFOs
+//  (AnalysisTap, owned by the synth so it outlives any editor); a TimeSliceClient
+//  on the editor's scope thread (AnalysisFeed) drains them into the scopes, whose
+//  FFTs then run on that same thread.
+//
+
+#ifndef __AnalysisTap_h__
+#define __AnalysisTap_h__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+/** The audio thread's end of the analysis pipeline. Nothing is written unless an
+    editor has enabled the tap, so with no scopes showing it costs nothing.     */
+class AnalysisTap
+{
+public:
+    enum Source { kMaster, kBus, kNumSources };
+    enum { kFifoSize = 32768, kMaxBlockSize = 16384 };
+
+    AnalysisTap()
+    :   master(kFifoSize), bus(kFifoSize), mixdown(kMaxBlockSize)
+    {
+        iBus = 0;
+    }
+
+    //==============================================================================
+    // UI thread: starts or stops the audio thread's writes
+    void setEnabled(bool bShouldBeEnabled) { bEnabled = bShouldBeEnabled ? 1 : 0; }
+
+    // UI thread: chooses the bus that's tapped, alongside the master
+    void setBus(int busIndex) { iBus = busIndex; }
+    int getBus() const { return iBus.get(); }
+
+    //==============================================================================
+    // audio thread: the master output (mixed to mono if there are two channels)
+    void pushMaster(float** channels, int numChannels, int numSamples)
+    {
+        if(!bEnabled.get() || numChannels < 1)
+            return;
+
+        numSamples = jmin(numSamples, (int)kMaxBlockSize);
+        if(numChannels == 1){
+            write(master, channels[0], numSamples);
+        }else{
+            FloatVectorOperations::copyWithMultiply(mixdown, channels[0], 0.5f, numSamples);
+            FloatVectorOperations::addWithMultiply(mixdown, channels[1], 0.5f, numSamples);
+            write(master, mixdown, numSamples);
+        }
+    }
+
+    // audio thread: the selected one of a set of buses
+    void pushBus(float** buses, int numBuses, int numSamples)
+    {
+        const int index = iBus.get();
+        if(!bEnabled.get() || index < 0 || index >= numBuses)
+            return;
+
+        write(bus, buses[index], jmin(numSamples, (int)kMaxBlockSize));
+    }
+
+    //==============================================================================
+    // reading thread: takes up to maxSamples from a source, returning how many
+    int read(int source, float* samples, int maxSamples)
+    {
+        Fifo& fifo = source == kMaster ? master : bus;
+        const int numSamples = jmin(maxSamples, fifo.getNumAvailable());
+        if(numSamples > 0)
+            fifo.readSamples(samples, numSamples);
+        return numSamples;
+    }
+
+private:
+    typedef drow::FifoBuffer<float> Fifo;
+
+    // a block that doesn't fit (the reader has fallen behind) is dropped whole,
+    // rather than leaving a partial one to join up with the next
+    static void write(Fifo& fifo, const float* samples, int numSamples)
+    {
+        if(fifo.getNumFree() >= numSamples)
+            fifo.writeSamples(samples, numSamples);
+    }
+
+    Fifo master, bus;
+    HeapBlock<float> mixdown;
+    Atomic<int> bEnabled, iBus;
+
+    JUCE_DECLARE_NON_COPYABLE (AnalysisTap)
+};
+
+//==============================================================================
+/** The scope thread's end: drains an AnalysisTap into an oscilloscope and a
+    spectrum display (the master) and a second display (the selected bus). Any of
+    them may be NULL. Register it with the same TimeSliceThread as the displays. */
+class AnalysisFeed : public TimeSliceClient
+{
+public:
+    AnalysisFeed(AnalysisTap& analysisTap, drow::AudioOscilloscope* scope,
+                 drow::GraphicalComponent* masterDisplay, drow::GraphicalComponent* busDisplay)
+    :   tap(analysisTap), pScope(scope), pMasterDisplay(masterDisplay), pBusDisplay(busDisplay)
+    {
+    }
+
+    int useTimeSlice()
+    {
+        bool bAny = false;
+        int numSamples;
+
+        while((numSamples = tap.read(AnalysisTap::kMaster, block, kBlockSize)) > 0){
+            if(pScope)
+                pScope->processBlock(block, numSamples);
+            if(pMasterDisplay)
+                pMasterDisplay->copySamples(block, numSamples);
+            bAny = true;
+        }
+
+        while((numSamples = tap.read(AnalysisTap::kBus, block, kBlockSize)) > 0){
+            if(pBusDisplay)
+                pBusDisplay->copySamples(block, numSamples);
+            bAny = true;
+        }
+
+        // poll faster while audio is arriving
+        return bAny ? 5 : 20;
+    }
+
+private:
+    enum { kBlockSize = 1024 };
+
+    AnalysisTap& tap;
+    drow::AudioOscilloscope* pScope;
+    drow::GraphicalComponent* pMasterDisplay;
+    drow::GraphicalComponent* pBusDisplay;
+    float block[kBlockSize];
+
+    JUCE_DECLARE_NON_COPYABLE (AnalysisFeed)
+};
+
+#endif
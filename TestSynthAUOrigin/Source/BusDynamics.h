@@ -0,0 +1,483 @@
+//
+//  BusDynamics.h
+//  TestSynthAU
+//
+//  A compressor and an attack/sustain transient shaper for each of a set of mix
+//  buses. As in BusEQ, buses are processed four at a time in SSE lanes. Detection
+//  and gain computation run in the log domain (using fast log2/exp2
+//  approximations), a chunk at a time ahead of applying the gains, with optional
+//  lookahead and with each bus able to key from any other bus.
+//
+
+#ifndef __BusDynamics_h__
+#define __BusDynamics_h__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#if JUCE_INTEL
+ #include <emmintrin.h>
+ #define BUSDYNAMICS_SSE 1
+#endif
+
+class BusDynamics
+{
+public:
+    enum { kMaxBuses = 20, kLanes = 4, kMaxLookahead = 256 };
+
+    BusDynamics(int numBuses)
+    :   numBuses(jlimit(0, (int)kMaxBuses, numBuses)), fSampleRate(44100.0), fLookaheadMs(0.0f), lastVersion(-1),
+        bAnyActive(false), iLookahead(0), iDelayPos(0)
+    {
+        zerostruct(groups);
+        zerostruct(delay);
+        for(int b=0; b<kMaxBuses; b++)
+            settings[b] = Settings();
+    }
+
+    //==============================================================================
+    // Compressor for a bus (a ratio of 1 switches it off). Settings may be changed
+    // from any thread, taking effect from the next block.
+    void setCompressor(int bus, float thresholdDecibels, float ratio, float attackMs = 5.0f, float releaseMs = 100.0f, float makeupDecibels = 0.0f)
+    {
+        if(bus < 0 || bus >= numBuses)
+            return;
+
+        settings[bus].fThreshold = thresholdDecibels;
+        settings[bus].fRatio = jmax(1.0f, ratio);
+        settings[bus].fAttack = jmax(0.01f, attackMs);
+        settings[bus].fRelease = jmax(1.0f, releaseMs);
+        settings[bus].fMakeup = makeupDecibels;
+        ++version;
+    }
+
+    // Transient shaper for a bus: attack and sustain from -1 to 1 cut or boost the
+    // onsets and the decays (0 and 0 switches it off)
+    void setTransientShaper(int bus, float attack, float sustain)
+    {
+        if(bus < 0 || bus >= numBuses)
+            return;
+
+        settings[bus].fTransientAttack = jlimit(-1.0f, 1.0f, attack);
+        settings[bus].fTransientSustain = jlimit(-1.0f, 1.0f, sustain);
+        ++version;
+    }
+
+    // keys a bus's compressor and shaper from another bus (-1 for its own signal)
+    void setSidechain(int bus, int sourceBus)
+    {
+        if(bus < 0 || bus >= numBuses)
+            return;
+
+        settings[bus].iSidechain = sourceBus >= 0 && sourceBus < numBuses ? sourceBus : -1;
+        ++version;
+    }
+
+    // Delays every bus (whether or not its dynamics are on, so the mics stay in
+    // phase) behind the detectors, up to kMaxLookahead samples.
+    void setLookahead(float milliseconds)
+    {
+        fLookaheadMs = jmax(0.0f, milliseconds);
+        ++version;
+    }
+
+    void setSampleRate(double sampleRate)
+    {
+        if(sampleRate > 0.0 && sampleRate != fSampleRate){
+            fSampleRate = sampleRate;
+            ++version;
+        }
+    }
+
+    float getThreshold(int bus) const { return getSettings(bus).fThreshold; }
+    float getRatio(int bus) const { return getSettings(bus).fRatio; }
+    float getAttack(int bus) const { return getSettings(bus).fAttack; }
+    float getRelease(int bus) const { return getSettings(bus).fRelease; }
+    float getMakeup(int bus) const { return getSettings(bus).fMakeup; }
+    float getTransientAttack(int bus) const { return getSettings(bus).fTransientAttack; }
+    float getTransientSustain(int bus) const { return getSettings(bus).fTransientSustain; }
+    int getSidechain(int bus) const { return getSettings(bus).iSidechain; }
+    float getLookahead() const { return fLookaheadMs; }
+
+    // Saves the lookahead, and the settings of every bus that isn't left as it was,
+    // as <BUS> children of xml.
+    void saveSettings(XmlElement& xml) const
+    {
+        xml.setAttribute("lookahead", fLookaheadMs);
+
+        for(int b=0; b<numBuses; b++){
+            const Settings& s = settings[b];
+            if(s.fRatio == 1.0f && s.fTransientAttack == 0.0f && s.fTransientSustain == 0.0f && s.iSidechain < 0)
+                continue;
+            XmlElement* pBus = xml.createNewChildElement("BUS");
+            pBus->setAttribute("index", b);
+            pBus->setAttribute("threshold", s.fThreshold);
+            pBus->setAttribute("ratio", s.fRatio);
+            pBus->setAttribute("attack", s.fAttack);
+            pBus->setAttribute("release", s.fRelease);
+            pBus->setAttribute("makeup", s.fMakeup);
+            pBus->setAttribute("transientAttack", s.fTransientAttack);
+            pBus->setAttribute("transientSustain", s.fTransientSustain);
+            pBus->setAttribute("sidechain", s.iSidechain);
+        }
+    }
+
+    // Replaces every setting with those saved by saveSettings() (buses it doesn't
+    // mention are switched off).
+    void loadSettings(const XmlElement& xml)
+    {
+        for(int b=0; b<kMaxBuses; b++)
+            settings[b] = Settings();
+        setLookahead((float) xml.getDoubleAttribute("lookahead"));
+
+        const Settings defaults;
+        forEachXmlChildElementWithTagName(xml, pBus, "BUS"){
+            const int bus = pBus->getIntAttribute("index", -1);
+            setCompressor(bus, (float) pBus->getDoubleAttribute("threshold", defaults.fThreshold),
+                          (float) pBus->getDoubleAttribute("ratio", defaults.fRatio),
+                          (float) pBus->getDoubleAttribute("attack", defaults.fAttack),
+                          (float) pBus->getDoubleAttribute("release", defaults.fRelease),
+                          (float) pBus->getDoubleAttribute("makeup", defaults.fMakeup));
+            setTransientShaper(bus, (float) pBus->getDoubleAttribute("transientAttack"), (float) pBus->getDoubleAttribute("transientSustain"));
+            setSidechain(bus, pBus->getIntAttribute("sidechain", -1));
+        }
+        ++version;
+    }
+
+    // The lookahead the settings give, in samples: the delay on every bus from the
+    // next block on (so it's what the host should compensate for).
+    int getLatency() const { return getLookaheadSamples(); }
+
+    //==============================================================================
+    // Processes numSamples of each bus in place, from startSample.
+    void process(float** buses, int startSample, int numSamples)
+    {
+        if(version.get() != lastVersion)
+            updateSettings();
+
+        if(!bAnyActive && iLookahead == 0)
+            return;
+
+       #if BUSDYNAMICS_SSE
+        const unsigned int csr = _mm_getcsr();
+        _mm_setcsr(csr | 0x8040);
+       #endif
+
+        for(int done=0; done<numSamples; done+=kChunk){
+            const int n = jmin((int)kChunk, numSamples - done);
+
+            // take every detector input before any bus is changed, as a bus may key
+            // another bus's dynamics
+            for(int g=0; g<getNumGroups(); g++){
+                if(!groups[g].bActive)
+                    continue;
+                for(int l=0; l<kLanes; l++){
+                    const int bus = g * kLanes + l;
+                    const int key = bus < numBuses ? (settings[bus].iSidechain >= 0 ? settings[bus].iSidechain : bus) : -1;
+                    float* dst = detector[g] + l;
+                    if(key < 0){
+                        for(int s=0; s<n; s++)
+                            dst[s * kLanes] = 0.0f;
+                    }else{
+                        const float* src = buses[key] + startSample + done;
+                        for(int s=0; s<n; s++)
+                            dst[s * kLanes] = src[s];
+                    }
+                }
+            }
+
+            for(int g=0; g<getNumGroups(); g++){
+                if(!groups[g].bActive && iLookahead == 0)
+                    continue;
+
+                const int first = g * kLanes;
+                const int lanes = jmin((int)kLanes, numBuses - first);
+
+                // interleave the group's audio, through the lookahead delay
+                for(int l=0; l<kLanes; l++){
+                    const float* src = l < lanes ? buses[first + l] + startSample + done : nullptr;
+                    float* line = delay[g] + l;
+                    for(int s=0; s<n; s++){
+                        const int w = (iDelayPos + s) & kDelayMask;
+                        line[w * kLanes] = src != nullptr ? src[s] : 0.0f;
+                        audio[s * kLanes + l] = line[((w - iLookahead) & kDelayMask) * kLanes];
+                    }
+                }
+
+                if(groups[g].bActive){
+                    computeGains(groups[g], detector[g], gains, n);
+                    for(int s=0; s<n * kLanes; s++)
+                        audio[s] *= gains[s];
+                }
+
+                for(int l=0; l<lanes; l++){
+                    float* dst = buses[first + l] + startSample + done;
+                    for(int s=0; s<n; s++)
+                        dst[s] = audio[s * kLanes + l];
+                }
+            }
+
+            iDelayPos = (iDelayPos + n) & kDelayMask;
+        }
+
+       #if BUSDYNAMICS_SSE
+        _mm_setcsr(csr);
+       #endif
+    }
+
+private:
+    enum { kChunk = 256, kDelaySize = 512, kDelayMask = kDelaySize - 1 };
+
+    struct Settings
+    {
+        Settings() : fThreshold(0.0f), fRatio(1.0f), fAttack(5.0f), fRelease(100.0f), fMakeup(0.0f),
+                     fTransientAttack(0.0f), fTransientSustain(0.0f), iSidechain(-1) {}
+
+        float fThreshold, fRatio, fAttack, fRelease, fMakeup;
+        float fTransientAttack, fTransientSustain;
+        int iSidechain;
+    };
+
+    //==============================================================================
+    // four lanes of floats, in an SSE register where available
+   #if BUSDYNAMICS_SSE
+    struct Vec
+    {
+        __m128 v;
+
+        Vec() {}
+        Vec(__m128 x) : v(x) {}
+        Vec(float x) : v(_mm_set1_ps(x)) {}
+        static Vec load(const float* p) { return _mm_loadu_ps(p); }
+        void store(float* p) const { _mm_storeu_ps(p, v); }
+
+        Vec operator+ (const Vec& o) const { return _mm_add_ps(v, o.v); }
+        Vec operator- (const Vec& o) const { return _mm_sub_ps(v, o.v); }
+        Vec operator* (const Vec& o) const { return _mm_mul_ps(v, o.v); }
+        static Vec max(const Vec& a, const Vec& b) { return _mm_max_ps(a.v, b.v); }
+        static Vec min(const Vec& a, const Vec& b) { return _mm_min_ps(a.v, b.v); }
+        static Vec abs(const Vec& a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+        // a > b ? x : y
+        static Vec selectGreater(const Vec& a, const Vec& b, const Vec& x, const Vec& y)
+        {
+            const __m128 mask = _mm_cmpgt_ps(a.v, b.v);
+            return _mm_or_ps(_mm_and_ps(mask, x.v), _mm_andnot_ps(mask, y.v));
+        }
+
+        // log2 for positive normal x (about 1e-4 error)
+        static Vec log2(const Vec& x)
+        {
+            const __m128i bits = _mm_castps_si128(x.v);
+            const __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+            const Vec m = _mm_or_ps(_mm_castsi128_ps(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF))), _mm_set1_ps(1.0f));
+            return Vec(e) + log2Mantissa(m);
+        }
+
+        // 2^x for x within +-126 (about 1e-4 relative error)
+        static Vec exp2(const Vec& x)
+        {
+            const Vec clamped = min(max(x, Vec(-126.0f)), Vec(126.0f));
+            // floor (truncation, less one where that rounded up)
+            __m128 whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(clamped.v));
+            whole = _mm_sub_ps(whole, _mm_and_ps(_mm_cmpgt_ps(whole, clamped.v), _mm_set1_ps(1.0f)));
+            const Vec f = clamped - Vec(whole);
+            const __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(whole), _mm_set1_epi32(127)), 23));
+            return Vec(scale) * exp2Fraction(f);
+        }
+    };
+   #else
+    struct Vec
+    {
+        float v[kLanes];
+
+        Vec() {}
+        Vec(float x) { for(int l=0; l<kLanes; l++) v[l] = x; }
+        static Vec load(const float* p) { Vec r; for(int l=0; l<kLanes; l++) r.v[l] = p[l]; return r; }
+        void store(float* p) const { for(int l=0; l<kLanes; l++) p[l] = v[l]; }
+
+        Vec operator+ (const Vec& o) const { Vec r; for(int l=0; l<kLanes; l++) r.v[l] = v[l] + o.v[l]; return r; }
+        Vec operator- (const Vec& o) const { Vec r; for(int l=0; l<kLanes; l++) r.v[l] = v[l] - o.v[l]; return r; }
+        Vec operator* (const Vec& o) const { Vec r; for(int l=0; l<kLanes; l++) r.v[l] = v[l] * o.v[l]; return r; }
+        static Vec max(const Vec& a, const Vec& b) { Vec r; for(int l=0; l<kLanes; l++) r.v[l] = jmax(a.v[l], b.v[l]); return r; }
+        static Vec min(const Vec& a, const Vec& b) { Vec r; for(int l=0; l<kLanes; l++) r.v[l] = jmin(a.v[l], b.v[l]); return r; }
+        static Vec abs(const Vec& a) { Vec r; for(int l=0; l<kLanes; l++) r.v[l] = fabsf(a.v[l]); return r; }
+        static Vec selectGreater(const Vec& a, const Vec& b, const Vec& x, const Vec& y)
+        {
+            Vec r; for(int l=0; l<kLanes; l++) r.v[l] = a.v[l] > b.v[l] ? x.v[l] : y.v[l]; return r;
+        }
+
+        static Vec log2(const Vec& x)
+        {
+            Vec e, m;
+            for(int l=0; l<kLanes; l++){
+                int exponent;
+                m.v[l] = 2.0f * frexpf(x.v[l], &exponent);
+                e.v[l] = (float)(exponent - 1);
+            }
+            return e + log2Mantissa(m);
+        }
+
+        static Vec exp2(const Vec& x)
+        {
+            Vec scale, f;
+            for(int l=0; l<kLanes; l++){
+                const float clamped = jlimit(-126.0f, 126.0f, x.v[l]);
+                const float i = floorf(clamped);
+                scale.v[l] = ldexpf(1.0f, (int)i);
+                f.v[l] = clamped - i;
+            }
+            return scale * exp2Fraction(f);
+        }
+    };
+   #endif
+
+    // log2(m) for m in [1, 2), and 2^f for f in [0, 1)
+    static Vec log2Mantissa(const Vec& m)
+    {
+        // (a polynomial fit of ln(m), scaled to log2)
+        const Vec ln = Vec(-1.7417939f) + m * (Vec(2.8212026f) + m * (Vec(-1.4699568f) + m * (Vec(0.44717955f) - m * Vec(0.056570851f))));
+        return ln * Vec(1.4426950f);
+    }
+    static Vec exp2Fraction(const Vec& f)
+    {
+        return Vec(0.99992522f) + f * (Vec(0.69583354f) + f * (Vec(0.22606716f) + f * Vec(0.078024523f)));
+    }
+
+    //==============================================================================
+    // per group settings (as vectors of kLanes, one lane per bus) and state
+    struct Group
+    {
+        float threshold[kLanes], slope[kLanes], makeup[kLanes];
+        float attack[kLanes], release[kLanes];
+        float transientAttack[kLanes], transientSustain[kLanes];
+
+        // state: smoothed gain reduction and the shaper's three level followers (dB)
+        float reduction[kLanes], fast[kLanes], slow[kLanes], hold[kLanes];
+        bool bActive;
+    };
+
+    int getNumGroups() const { return (numBuses + kLanes - 1) / kLanes; }
+
+    Settings getSettings(int bus) const { return bus >= 0 && bus < numBuses ? settings[bus] : Settings(); }
+
+    // Works out a chunk of gains for a group from its (interleaved) detector input.
+    // The compressor smooths its gain reduction with the attack/release times; the
+    // shaper compares fast and slow attack followers for the onsets, and a long
+    // release follower against the fast one for the decays.
+    void computeGains(Group& group, const float* input, float* gainsOut, int numSamples) const
+    {
+        const Vec dBPerOctave(6.0206f), octavesPerdB(1.0f / 6.0206f);
+        const Vec floor(-120.0f), zero(0.0f), minLevel(1.0e-6f);
+        const Vec threshold = Vec::load(group.threshold), slope = Vec::load(group.slope), makeup = Vec::load(group.makeup);
+        const Vec attack = Vec::load(group.attack), release = Vec::load(group.release);
+        const Vec transientAttack = Vec::load(group.transientAttack), transientSustain = Vec::load(group.transientSustain);
+        const Vec fastAttack(fFastAttack), slowAttack(fSlowAttack), shortRelease(fShortRelease), longRelease(fLongRelease);
+        const Vec minGain(-48.0f), maxGain(24.0f);
+
+        Vec reduction = Vec::load(group.reduction);
+        Vec fast = Vec::load(group.fast), slow = Vec::load(group.slow), hold = Vec::load(group.hold);
+
+        for(int s=0; s<numSamples; s++){
+            const Vec level = Vec::max(Vec::log2(Vec::max(Vec::abs(Vec::load(input + s * kLanes)), minLevel)) * dBPerOctave, floor);
+
+            const Vec target = Vec::max(level - threshold, zero) * slope;
+            reduction = reduction + Vec::selectGreater(target, reduction, attack, release) * (target - reduction);
+
+            fast = fast + Vec::selectGreater(level, fast, fastAttack, shortRelease) * (level - fast);
+            slow = slow + Vec::selectGreater(level, slow, slowAttack, shortRelease) * (level - slow);
+            hold = hold + Vec::selectGreater(level, hold, fastAttack, longRelease) * (level - hold);
+
+            const Vec shape = transientAttack * (fast - slow) + transientSustain * (hold - fast);
+            const Vec gain = Vec::min(Vec::max(makeup - reduction + shape, minGain), maxGain);
+
+            Vec::exp2(gain * octavesPerdB).store(gainsOut + s * kLanes);
+        }
+
+        reduction.store(group.reduction);
+        fast.store(group.fast);
+        slow.store(group.slow);
+        hold.store(group.hold);
+    }
+
+    int getLookaheadSamples() const
+    {
+        return jlimit(0, (int)kMaxLookahead, roundToInt(fLookaheadMs * 0.001 * fSampleRate));
+    }
+
+    // one-pole smoothing coefficient for a time constant
+    float coefficient(float milliseconds) const
+    {
+        return 1.0f - expf(-1.0f / (jmax(0.001f, milliseconds) * 0.001f * (float)fSampleRate));
+    }
+
+    // audio thread: rebuilds the groups' settings after a change
+    void updateSettings()
+    {
+        lastVersion = version.get();
+
+        fFastAttack = coefficient(1.0f);
+        fSlowAttack = coefficient(25.0f);
+        fShortRelease = coefficient(80.0f);
+        fLongRelease = coefficient(400.0f);
+
+        const int lookahead = getLookaheadSamples();
+        if(lookahead != iLookahead){
+            iLookahead = lookahead;
+            zerostruct(delay);
+        }
+
+        bAnyActive = false;
+        for(int g=0; g<getNumGroups(); g++){
+            Group& group = groups[g];
+            const bool bWasActive = group.bActive;
+            group.bActive = false;
+
+            for(int l=0; l<kLanes; l++){
+                const int bus = g * kLanes + l;
+                const Settings s = bus < numBuses ? settings[bus] : Settings();
+                const bool bOn = s.fRatio > 1.0f || s.fTransientAttack != 0.0f || s.fTransientSustain != 0.0f;
+
+                group.threshold[l] = s.fThreshold;
+                group.slope[l] = 1.0f - 1.0f / s.fRatio;
+                group.makeup[l] = bOn ? s.fMakeup : 0.0f;
+                group.attack[l] = coefficient(s.fAttack);
+                group.release[l] = coefficient(s.fRelease);
+                group.transientAttack[l] = s.fTransientAttack;
+                group.transientSustain[l] = s.fTransientSustain;
+                group.bActive |= bOn;
+            }
+
+            // a group coming out of bypass starts from silence
+            if(group.bActive && !bWasActive){
+                for(int l=0; l<kLanes; l++){
+                    group.reduction[l] = 0.0f;
+                    group.fast[l] = group.slow[l] = group.hold[l] = -120.0f;
+                }
+            }
+            bAnyActive |= group.bActive;
+        }
+    }
+
+    const int numBuses;
+    double fSampleRate;
+
+    Settings settings[kMaxBuses];
+    float fLookaheadMs;
+    Atomic<int> version;
+    int lastVersion;
+
+    Group groups[kMaxBuses / kLanes];
+    bool bAnyActive;
+    int iLookahead;
+    float fFastAttack, fSlowAttack, fShortRelease, fLongRelease;
+
+    // working buffers (interleaved, one lane per bus)
+    float detector[kMaxBuses / kLanes][kChunk * kLanes];
+    float audio[kChunk * kLanes];
+    float gains[kChunk * kLanes];
+    float delay[kMaxBuses / kLanes][kDelaySize * kLanes];
+    int iDelayPos;
+
+    JUCE_DECLARE_NON_COPYABLE (BusDynamics)
+};
+
+#endif
@@ -0,0 +1,321 @@
+//
+//  BusEQ.h
+//  TestSynthAU
+//
+//  A five band EQ strip (high-pass, low shelf, two bells, high shelf) for each of
+//  a set of mix buses. Buses are processed four at a time, one per SSE lane, by a
+//  transposed-direct-form-II biquad kernel, so EQing the whole kit costs about the
+//  same as two channels of a scalar filter.
+//
+
+#ifndef __BusEQ_h__
+#define __BusEQ_h__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#if JUCE_INTEL
+ #include <xmmintrin.h>
+ #define BUSEQ_SSE 1
+#endif
+
+class BusEQ
+{
+public:
+    enum Band { kHighPass, kLowShelf, kBell1, kBell2, kHighShelf, kNumBands };
+    enum { kMaxBuses = 20, kLanes = 4 };
+
+    BusEQ(int numBuses)
+    :   numBuses(jlimit(0, (int)kMaxBuses, numBuses)), fSampleRate(44100.0), lastVersion(-1)
+    {
+        zerostruct(groups);
+        for(int b=0; b<kMaxBuses; b++){
+            for(int k=0; k<kNumBands; k++)
+                settings[b][k] = Settings();
+        }
+    }
+
+    //==============================================================================
+    // Sets one band of a bus (from any thread - it takes effect from the next block).
+    // A frequency of 0 (or a gain of 0dB, for the shelves and bells) bypasses the band.
+    void setBand(int bus, int band, float frequency, float gainDecibels = 0.0f, float q = 0.7071f)
+    {
+        if(!isBand(bus, band))
+            return;
+
+        settings[bus][band].fFrequency = frequency;
+        settings[bus][band].fGain = gainDecibels;
+        settings[bus][band].fQ = jmax(0.05f, q);
+        ++version;
+    }
+
+    float getFrequency(int bus, int band) const { return isBand(bus, band) ? settings[bus][band].fFrequency : 0.0f; }
+    float getGain(int bus, int band) const { return isBand(bus, band) ? settings[bus][band].fGain : 0.0f; }
+    float getQ(int bus, int band) const { return isBand(bus, band) ? settings[bus][band].fQ : 0.7071f; }
+
+    // Saves the bands that are in use, as <BAND> children of xml.
+    void saveSettings(XmlElement& xml) const
+    {
+        for(int b=0; b<numBuses; b++){
+            for(int k=0; k<kNumBands; k++){
+                if(settings[b][k].fFrequency <= 0.0f)
+                    continue;
+                XmlElement* pBand = xml.createNewChildElement("BAND");
+                pBand->setAttribute("bus", b);
+                pBand->setAttribute("band", k);
+                pBand->setAttribute("frequency", settings[b][k].fFrequency);
+                pBand->setAttribute("gain", settings[b][k].fGain);
+                pBand->setAttribute("q", settings[b][k].fQ);
+            }
+        }
+    }
+
+    // Replaces every band with those saved by saveSettings() (the rest are bypassed).
+    void loadSettings(const XmlElement& xml)
+    {
+        for(int b=0; b<kMaxBuses; b++){
+            for(int k=0; k<kNumBands; k++)
+                settings[b][k] = Settings();
+        }
+        forEachXmlChildElementWithTagName(xml, pBand, "BAND"){
+            setBand(pBand->getIntAttribute("bus", -1), pBand->getIntAttribute("band", -1),
+                    (float) pBand->getDoubleAttribute("frequency"), (float) pBand->getDoubleAttribute("gain"),
+                    (float) pBand->getDoubleAttribute("q", 0.7071));
+        }
+        ++version;
+    }
+
+    void setSampleRate(double sampleRate)
+    {
+        if(sampleRate > 0.0 && sampleRate != fSampleRate){
+            fSampleRate = sampleRate;
+            ++version;
+        }
+    }
+
+    //==============================================================================
+    // Filters numSamples of each bus in place, from startSample. Groups of buses whose
+    // bands are all bypassed are skipped.
+    void process(float** buses, int startSample, int numSamples)
+    {
+        if(version.get() != lastVersion)
+            updateCoefficients();
+
+       #if BUSEQ_SSE
+        // flush denormals (the filter state decays into them after each hit)
+        const unsigned int csr = _mm_getcsr();
+        _mm_setcsr(csr | 0x8040);
+       #endif
+
+        for(int g=0; g<getNumGroups(); g++){
+            if(!groups[g].bActive)
+                continue;
+
+            const int first = g * kLanes;
+            const int lanes = jmin((int)kLanes, numBuses - first);
+
+            for(int done=0; done<numSamples; done+=kChunk){
+                const int n = jmin((int)kChunk, numSamples - done);
+
+                // interleave the group's buses, one per lane
+                for(int l=0; l<kLanes; l++){
+                    if(l < lanes){
+                        const float* src = buses[first + l] + startSample + done;
+                        for(int s=0; s<n; s++)
+                            chunk.f[s * kLanes + l] = src[s];
+                    }else{
+                        for(int s=0; s<n; s++)
+                            chunk.f[s * kLanes + l] = 0.0f;
+                    }
+                }
+
+                for(int k=0; k<kNumBands; k++){
+                    if(groups[g].bBandActive[k])
+                        processStage(groups[g].stages[k], chunk.f, n);
+                }
+
+                for(int l=0; l<lanes; l++){
+                    float* dst = buses[first + l] + startSample + done;
+                    for(int s=0; s<n; s++)
+                        dst[s] = chunk.f[s * kLanes + l];
+                }
+            }
+        }
+
+       #if BUSEQ_SSE
+        _mm_setcsr(csr);
+       #endif
+    }
+
+    // clears the filters' state (e.g. when playback restarts)
+    void reset()
+    {
+        for(int g=0; g<kMaxBuses / kLanes; g++){
+            for(int k=0; k<kNumBands; k++)
+                zerostruct(groups[g].stages[k].z);
+        }
+    }
+
+private:
+    enum { kChunk = 256 };
+
+    struct Settings
+    {
+        Settings() : fFrequency(0.0f), fGain(0.0f), fQ(0.7071f) {}
+        float fFrequency, fGain, fQ;
+    };
+
+    // one biquad for each lane of a group: coefficients b0, b1, b2, a1, a2 and the
+    // two state variables, each as a vector of kLanes
+    struct Stage
+    {
+        float c[5][kLanes];
+        float z[2][kLanes];
+    };
+
+    struct Group
+    {
+        Stage stages[kNumBands];
+        bool bBandActive[kNumBands];
+        bool bActive;
+    };
+
+    int getNumGroups() const { return (numBuses + kLanes - 1) / kLanes; }
+    bool isBand(int bus, int band) const { return bus >= 0 && bus < numBuses && band >= 0 && band < kNumBands; }
+
+    // y = b0.x + z1;  z1 = b1.x - a1.y + z2;  z2 = b2.x - a2.y  (in every lane)
+    static void processStage(Stage& stage, float* data, int numSamples)
+    {
+       #if BUSEQ_SSE
+        const __m128 b0 = _mm_loadu_ps(stage.c[0]), b1 = _mm_loadu_ps(stage.c[1]), b2 = _mm_loadu_ps(stage.c[2]);
+        const __m128 a1 = _mm_loadu_ps(stage.c[3]), a2 = _mm_loadu_ps(stage.c[4]);
+        __m128 z1 = _mm_loadu_ps(stage.z[0]), z2 = _mm_loadu_ps(stage.z[1]);
+
+        for(int s=0; s<numSamples; s++){
+            const __m128 x = _mm_load_ps(data + s * kLanes);
+            const __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), z1);
+            z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), z2);
+            z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+            _mm_store_ps(data + s * kLanes, y);
+        }
+
+        _mm_storeu_ps(stage.z[0], z1);
+        _mm_storeu_ps(stage.z[1], z2);
+       #else
+        for(int s=0; s<numSamples; s++){
+            float* v = data + s * kLanes;
+            for(int l=0; l<kLanes; l++){
+                const float x = v[l];
+                const float y = stage.c[0][l] * x + stage.z[0][l];
+                stage.z[0][l] = stage.c[1][l] * x - stage.c[3][l] * y + stage.z[1][l];
+                stage.z[1][l] = stage.c[2][l] * x - stage.c[4][l] * y;
+                v[l] = y;
+            }
+        }
+       #endif
+    }
+
+    // RBJ cookbook coefficients for one band; returns false (leaving coeffs) if the
+    // band is bypassed
+    bool designBand(int band, const Settings& settings, float* coeffs) const
+    {
+        const double nyquist = fSampleRate * 0.5;
+        if(settings.fFrequency <= 0.0f || settings.fFrequency >= nyquist
+           || (band != kHighPass && settings.fGain == 0.0f))
+            return false;
+
+        const double w0 = 2.0 * double_Pi * settings.fFrequency / fSampleRate;
+        const double cosw = cos(w0);
+        const double alpha = sin(w0) / (2.0 * settings.fQ);
+        const double A = pow(10.0, settings.fGain / 40.0);
+        const double sq = 2.0 * sqrt(A) * alpha;
+        double b0, b1, b2, a0, a1, a2;
+
+        switch(band){
+            case kHighPass:
+                b0 = (1.0 + cosw) / 2.0;    b1 = -(1.0 + cosw);     b2 = b0;
+                a0 = 1.0 + alpha;           a1 = -2.0 * cosw;       a2 = 1.0 - alpha;
+                break;
+            case kLowShelf:
+                b0 = A * ((A + 1.0) - (A - 1.0) * cosw + sq);
+                b1 = 2.0 * A * ((A - 1.0) - (A + 1.0) * cosw);
+                b2 = A * ((A + 1.0) - (A - 1.0) * cosw - sq);
+                a0 = (A + 1.0) + (A - 1.0) * cosw + sq;
+                a1 = -2.0 * ((A - 1.0) + (A + 1.0) * cosw);
+                a2 = (A + 1.0) + (A - 1.0) * cosw - sq;
+                break;
+            case kHighShelf:
+                b0 = A * ((A + 1.0) + (A - 1.0) * cosw + sq);
+                b1 = -2.0 * A * ((A - 1.0) + (A + 1.0) * cosw);
+                b2 = A * ((A + 1.0) + (A - 1.0) * cosw - sq);
+                a0 = (A + 1.0) - (A - 1.0) * cosw + sq;
+                a1 = 2.0 * ((A - 1.0) - (A + 1.0) * cosw);
+                a2 = (A + 1.0) - (A - 1.0) * cosw - sq;
+                break;
+            default: // bells
+                b0 = 1.0 + alpha * A;       b1 = -2.0 * cosw;       b2 = 1.0 - alpha * A;
+                a0 = 1.0 + alpha / A;       a1 = -2.0 * cosw;       a2 = 1.0 - alpha / A;
+                break;
+        }
+
+        coeffs[0] = (float)(b0 / a0);
+        coeffs[1] = (float)(b1 / a0);
+        coeffs[2] = (float)(b2 / a0);
+        coeffs[3] = (float)(a1 / a0);
+        coeffs[4] = (float)(a2 / a0);
+        return true;
+    }
+
+    // audio thread: rebuilds every group's coefficients after a change
+    void updateCoefficients()
+    {
+        lastVersion = version.get();
+
+        for(int g=0; g<getNumGroups(); g++){
+            Group& group = groups[g];
+            group.bActive = false;
+
+            for(int k=0; k<kNumBands; k++){
+                const bool bWasActive = group.bBandActive[k];
+                group.bBandActive[k] = false;
+
+                for(int l=0; l<kLanes; l++){
+                    const int bus = g * kLanes + l;
+                    float coeffs[5];
+                    const bool bOn = bus < numBuses && designBand(k, settings[bus][k], coeffs);
+                    if(!bOn){
+                        coeffs[0] = 1.0f;
+                        coeffs[1] = coeffs[2] = coeffs[3] = coeffs[4] = 0.0f;
+                    }
+                    for(int i=0; i<5; i++)
+                        group.stages[k].c[i][l] = coeffs[i];
+                    group.bBandActive[k] |= bOn;
+                }
+                group.bActive |= group.bBandActive[k];
+
+                // a band coming out of bypass starts from silence
+                if(group.bBandActive[k] && !bWasActive)
+                    zerostruct(group.stages[k].z);
+            }
+        }
+    }
+
+    const int numBuses;
+    double fSampleRate;
+
+    Settings settings[kMaxBuses][kNumBands];
+    Atomic<int> version;
+    int lastVersion;
+
+    Group groups[kMaxBuses / kLanes];
+
+    // the chunk being filtered, interleaved (aligned for the SSE loads)
+    union { float f[kChunk * kLanes];
+           #if BUSEQ_SSE
+            __m128 v[kChunk];
+           #endif
+          } chunk;
+
+    JUCE_DECLARE_NON_COPYABLE (BusEQ)
+};
+
+#endif
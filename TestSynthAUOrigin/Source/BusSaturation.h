@@ -0,0 +1,538 @@
+//
+//  BusSaturation.h
+//  TestSynthAU
+//
+//  A drive stage for each of a set of mix buses: gain into a waveshaping curve (a
+//  TableWaveshaper for each of the curves, built up front), run at 2x or 4x
+//  the sample rate so the harmonics it adds don't fold back down as aliasing. The
+//  oversampling is a cascade of polyphase half-band FIR stages - only the half of
+//  each filter's taps that aren't zero are ever computed, four outputs at a time.
+//
+//  The filters are linear phase, so while any bus is driven every bus is delayed by
+//  getLatency() samples (the undriven ones just through a delay line), keeping the
+//  kit's mics lined up with each other.
+//
+
+#ifndef __BusSaturation_h__
+#define __BusSaturation_h__
+
+#include "PluginWrapper.h"
+
+#if JUCE_INTEL
+ #include <xmmintrin.h>
+ #define BUSSATURATION_SSE 1
+#endif
+
+class BusSaturation
+{
+public:
+    enum { kMaxBuses = 20 };
+
+    enum Curve { kSoftClip, kHardClip, kCubicClip, kTube, kNumCurves };
+
+    BusSaturation(int numBuses, Curve curve = kSoftClip)
+    :   numBuses(jlimit(0, (int)kMaxBuses, numBuses)), fSampleRate(44100.0), iRequestedFactor(2), iFactor(2),
+        requestedCurve(curve), lastVersion(-1), bAnyActive(false), bDCBlock(false), fDCCoeff(0.0f)
+    {
+        designHalfband(stage1, 31, 7.0);
+        designHalfband(stage2, 10, 7.0);     // (even, for a whole number of samples' latency)
+        zerostruct(state);
+
+        for(int c=0; c<kNumCurves; c++){
+            shapers[c].setFunction(getFunction((Curve)c));
+            bSymmetric[c] = shapers[c].isSymmetric();
+        }
+        pShaper = &shapers[curve];
+        bDCBlock = !bSymmetric[curve];
+    }
+
+    //==============================================================================
+    // The curves the shaper can use
+
+    // smooth, symmetric soft clipping
+    static float softClip(float x) { return tanhf(x); }
+    // clips flat at +/-1
+    static float hardClip(float x) { return jlimit(-1.0f, 1.0f, x); }
+    // a cubic knee that flattens out at +/-1 (for inputs of +/-1.5)
+    static float cubicClip(float x) { x = jlimit(-1.5f, 1.5f, x); return x - (4.0f / 27.0f) * x * x * x; }
+    // asymmetric, like a single-ended tube stage: the negative half clips later
+    static float tube(float x) { return x >= 0.0f ? tanhf(x) : tanhf(0.6f * x) / 0.6f; }
+
+    static Function getFunction(Curve curve)
+    {
+        const Function functions[kNumCurves] = { softClip, hardClip, cubicClip, tube };
+        return functions[jlimit(0, (int)kNumCurves - 1, (int)curve)];
+    }
+
+    static String getCurveName(Curve curve)
+    {
+        const char* const names[kNumCurves] = { "Soft", "Hard", "Cubic", "Tube" };
+        return names[jlimit(0, (int)kNumCurves - 1, (int)curve)];
+    }
+
+    //==============================================================================
+    // Sets the shaping curve for every bus (from any thread - the tables are all
+    // built already, and the switch is made at the start of the next block).
+    void setCurve(Curve curve)
+    {
+        requestedCurve = (Curve)jlimit(0, (int)kNumCurves - 1, (int)curve);
+        ++version;
+    }
+
+    // Sets the drive into the curve, the level after it and the wet/dry mix of a bus
+    // (from any thread - changes are ramped in over the next block). A mix of 0
+    // bypasses the bus.
+    void setBus(int bus, float driveDecibels, float outputDecibels = 0.0f, float mix = 1.0f)
+    {
+        if(bus < 0 || bus >= numBuses)
+            return;
+
+        settings[bus].fDrive = driveDecibels;
+        settings[bus].fOutput = outputDecibels;
+        settings[bus].fMix = jlimit(0.0f, 1.0f, mix);
+        ++version;
+    }
+
+    // 1 (no oversampling - cheapest, but aliases), 2 or 4
+    void setOversampling(int factor)
+    {
+        iRequestedFactor = factor >= 4 ? 4 : factor >= 2 ? 2 : 1;
+        ++version;
+    }
+
+    void setSampleRate(double sampleRate)
+    {
+        if(sampleRate > 0.0 && sampleRate != fSampleRate){
+            fSampleRate = sampleRate;
+            ++version;
+        }
+    }
+
+    Curve getCurve() const { return requestedCurve; }
+    int getOversampling() const { return iRequestedFactor; }
+    float getDrive(int bus) const { return getSettings(bus).fDrive; }
+    float getOutput(int bus) const { return getSettings(bus).fOutput; }
+    float getMix(int bus) const { return getSettings(bus).fMix; }
+
+    //==============================================================================
+    // Writes the settings into xml, as attributes and a child element for each bus
+    // that's driven.
+    void saveSettings(XmlElement& xml) const
+    {
+        xml.setAttribute("curve", getCurveName(requestedCurve));
+        xml.setAttribute("oversampling", iRequestedFactor);
+
+        for(int b=0; b<numBuses; b++){
+            const Settings& s = settings[b];
+            if(s.fMix <= 0.0f)
+                continue;
+            XmlElement* pBus = xml.createNewChildElement("BUS");
+            pBus->setAttribute("index", b);
+            pBus->setAttribute("drive", s.fDrive);
+            pBus->setAttribute("output", s.fOutput);
+            pBus->setAttribute("mix", s.fMix);
+        }
+    }
+
+    // Replaces every setting with those saved by saveSettings() (buses it doesn't
+    // mention are bypassed). Without a saved curve, the current one is kept.
+    void loadSettings(const XmlElement& xml)
+    {
+        for(int b=0; b<kMaxBuses; b++)
+            settings[b] = Settings();
+
+        const String curve = xml.getStringAttribute("curve");
+        for(int c=0; c<kNumCurves; c++){
+            if(curve == getCurveName((Curve)c))
+                requestedCurve = (Curve)c;
+        }
+        setOversampling(xml.getIntAttribute("oversampling", 2));
+
+        forEachXmlChildElementWithTagName(xml, pBus, "BUS"){
+            setBus(pBus->getIntAttribute("index", -1), (float) pBus->getDoubleAttribute("drive"),
+                   (float) pBus->getDoubleAttribute("output"), (float) pBus->getDoubleAttribute("mix", 1.0));
+        }
+        ++version;
+    }
+
+    // The delay the settings give the buses, in samples (0 while none are driven),
+    // from the next block on - so it's what the host should compensate for.
+    int getLatency() const
+    {
+        for(int b=0; b<numBuses; b++){
+            if(settings[b].fMix > 0.0f)
+                return getLatency(iRequestedFactor);
+        }
+        return 0;
+    }
+
+    //==============================================================================
+    // Drives numSamples of each bus in place, from startSample.
+    void process(float** buses, int startSample, int numSamples)
+    {
+        if(version.get() != lastVersion)
+            updateSettings();
+
+        if(!bAnyActive)
+            return;
+
+       #if BUSSATURATION_SSE
+        const unsigned int csr = _mm_getcsr();
+        _mm_setcsr(csr | 0x8040);
+       #endif
+
+        const int latency = getLatency(iFactor);
+
+        for(int b=0; b<numBuses; b++){
+            BusState& bus = state[b];
+            const bool bShaping = bus.bActive || bus.fWet != 0.0f || bus.fDry != 1.0f;
+
+            for(int done=0; done<numSamples; done+=kChunk){
+                const int n = jmin((int)kChunk, numSamples - done);
+                float* data = buses[b] + startSample + done;
+
+                // the undriven signal, with enough history to delay it by the latency
+                float* dry = loadHistory(dryBuffer, bus.hDry);
+                memcpy(dry, data, sizeof(float) * n);
+                saveHistory(bus.hDry, dry, n);
+
+                if(bShaping)
+                    shape(bus, dry, data, n, latency);
+                else
+                    memcpy(data, dry - latency, sizeof(float) * n);
+            }
+        }
+
+       #if BUSSATURATION_SSE
+        _mm_setcsr(csr);
+       #endif
+    }
+
+    // clears the filters and delays (e.g. when playback restarts)
+    void reset()
+    {
+        for(int b=0; b<kMaxBuses; b++){
+            clearFilters(state[b]);
+            zerostruct(state[b].hDry);
+        }
+    }
+
+private:
+    enum { kChunk = 256, kHistory = 40, kMaxTaps = 32 };
+
+    struct Settings
+    {
+        Settings() : fDrive(0.0f), fOutput(0.0f), fMix(0.0f) {}
+        float fDrive, fOutput, fMix;
+    };
+
+    // A half-band lowpass (cutoff at a quarter of the higher rate) of length 2M+1. All
+    // but its centre tap (0.5) are zero in one of its two phases, so the other phase
+    // is the only one that needs filtering: taps[] are its non-zero coefficients
+    // (doubled, for the upsampler's gain) and the centre tap becomes a plain delay.
+    struct Halfband
+    {
+        float up[kMaxTaps], down[kMaxTaps];
+        int numTaps;
+        int length;     // M (the filter delays by M samples at the higher rate)
+        int phase;      // which output phase is filtered (the other is delayed)
+        int delay;      // the delay of the other phase, at the lower rate
+    };
+
+    struct BusState
+    {
+        // recent samples of each stream the filters read, carried between chunks
+        float hIn[kHistory], hUp[kHistory], hEven2[kHistory], hOdd2[kHistory],
+              hEven1[kHistory], hOdd1[kHistory], hDry[kHistory];
+        // current (ramped) gains
+        float fDrive, fWet, fDry;
+        float fDCIn, fDCOut;
+        // targets, from the settings
+        float fTargetDrive, fTargetWet, fTargetDry;
+        bool bActive;
+    };
+
+    Settings getSettings(int bus) const { return bus >= 0 && bus < numBuses ? settings[bus] : Settings(); }
+
+    // each stage delays by its length at its higher rate, once up and once down
+    int getLatency(int factor) const
+    {
+        return (factor >= 2 ? stage1.length : 0) + (factor == 4 ? stage2.length / 2 : 0);
+    }
+
+    // copies a stream's history to the front of a work buffer, returning where the
+    // new samples go; saveHistory() keeps the last of them for the next chunk
+    static float* loadHistory(float* buffer, const float* history)
+    {
+        memcpy(buffer, history, sizeof(float) * kHistory);
+        return buffer + kHistory;
+    }
+
+    static void saveHistory(float* history, const float* samples, int numSamples)
+    {
+        memcpy(history, samples + numSamples - kHistory, sizeof(float) * kHistory);
+    }
+
+    static void clearFilters(BusState& bus)
+    {
+        zerostruct(bus.hIn);   zerostruct(bus.hUp);
+        zerostruct(bus.hEven2); zerostruct(bus.hOdd2);
+        zerostruct(bus.hEven1); zerostruct(bus.hOdd1);
+        bus.fDCIn = bus.fDCOut = 0.0f;
+    }
+
+    //==============================================================================
+    // Kaiser windowed-sinc design of a half-band filter of length 2M+1
+    static void designHalfband(Halfband& filter, int M, double beta)
+    {
+        jassert(M + 1 <= kMaxTaps && M + 2 <= kHistory);
+
+        filter.length = M;
+        filter.phase = 1 - (M & 1);
+        filter.delay = M / 2;
+        filter.numTaps = 0;
+
+        double taps[kMaxTaps], sum = 0.0;
+        for(int k = filter.phase; k <= 2 * M; k += 2){
+            const double t = (k - M) * 0.5;
+            const double r = (k - M) / (double)M;
+            const double window = besselI0(beta * sqrt(jmax(0.0, 1.0 - r * r))) / besselI0(beta);
+            taps[filter.numTaps] = 0.5 * sin(double_Pi * t) / (double_Pi * t) * window;
+            sum += taps[filter.numTaps++];
+        }
+
+        // normalise so the filtered phase passes DC at exactly the centre tap's 0.5
+        for(int j=0; j<filter.numTaps; j++){
+            filter.down[j] = (float)(taps[j] * 0.5 / sum);
+            filter.up[j] = 2.0f * filter.down[j];
+        }
+    }
+
+    static double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for(int k=1; k<32; k++){
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // y[i] = sum of c[j].x[i-j] for i = 0 to numSamples-1 (x has history before it)
+    static void convolve(const float* c, int numTaps, const float* x, float* y, int numSamples)
+    {
+        int i = 0;
+       #if BUSSATURATION_SSE
+        for(; i + 8 <= numSamples; i += 8){
+            __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+            for(int j=0; j<numTaps; j++){
+                const __m128 cj = _mm_set1_ps(c[j]);
+                a0 = _mm_add_ps(a0, _mm_mul_ps(cj, _mm_loadu_ps(x + i - j)));
+                a1 = _mm_add_ps(a1, _mm_mul_ps(cj, _mm_loadu_ps(x + i + 4 - j)));
+            }
+            _mm_storeu_ps(y + i, a0);
+            _mm_storeu_ps(y + i + 4, a1);
+        }
+       #endif
+        for(; i<numSamples; i++){
+            float fSum = 0.0f;
+            for(int j=0; j<numTaps; j++)
+                fSum += c[j] * x[i - j];
+            y[i] = fSum;
+        }
+    }
+
+    // numSamples of x (with history) to 2 * numSamples of y
+    void upsample(const Halfband& filter, const float* x, float* y, int numSamples)
+    {
+        convolve(filter.up, filter.numTaps, x, scratch, numSamples);
+
+        const float* delayed = x - filter.delay;
+        float* filtered = y + filter.phase;
+        float* other = y + 1 - filter.phase;
+        for(int i=0; i<numSamples; i++){
+            filtered[2 * i] = scratch[i];
+            other[2 * i] = delayed[i];
+        }
+    }
+
+    // 2 * numSamples of x to numSamples of y
+    void downsample(const Halfband& filter, const float* x, float* y, int numSamples, float* hEven, float* hOdd)
+    {
+        float* even = loadHistory(evenBuffer, hEven);
+        float* odd = loadHistory(oddBuffer, hOdd);
+        for(int i=0; i<numSamples; i++){
+            even[i] = x[2 * i];
+            odd[i] = x[2 * i + 1];
+        }
+        saveHistory(hEven, even, numSamples);
+        saveHistory(hOdd, odd, numSamples);
+
+        // y[n] = sum of h[k].x[2n-k]: the filtered phase lines up with the even samples
+        // when it's phase 0, or the previous odd ones when it's phase 1
+        const float* filtered = filter.phase == 0 ? even : odd - 1;
+        const float* centre = filter.phase == 0 ? odd - filter.delay - 1 : even - filter.delay;
+
+        convolve(filter.down, filter.numTaps, filtered, y, numSamples);
+        for(int i=0; i<numSamples; i++)
+            y[i] += 0.5f * centre[i];
+    }
+
+    // scales from by a gain ramping from current to target
+    static void ramp(const float* src, float* dst, int numSamples, float& current, float target)
+    {
+        if(current == target){
+            FloatVectorOperations::copyWithMultiply(dst, src, target, numSamples);
+            return;
+        }
+
+        const float fStep = (target - current) / numSamples;
+        float fGain = current;
+        for(int s=0; s<numSamples; s++){
+            fGain += fStep;
+            dst[s] = src[s] * fGain;
+        }
+        current = target;
+    }
+
+    // drives one chunk of a bus into data (dry is the chunk undelayed, with history)
+    void shape(BusState& bus, const float* dry, float* data, int numSamples, int latency)
+    {
+        float* x = loadHistory(inBuffer, bus.hIn);
+        ramp(dry, x, numSamples, bus.fDrive, bus.fTargetDrive);
+        saveHistory(bus.hIn, x, numSamples);
+
+        if(iFactor == 1){
+            pShaper->process(x, numSamples);
+            memcpy(wetBuffer, x, sizeof(float) * numSamples);
+        }else{
+            float* up = loadHistory(upBuffer, bus.hUp);
+            upsample(stage1, x, up, numSamples);
+            saveHistory(bus.hUp, up, 2 * numSamples);
+
+            if(iFactor == 4){
+                upsample(stage2, up, highBuffer, 2 * numSamples);
+                pShaper->process(highBuffer, 4 * numSamples);
+                downsample(stage2, highBuffer, up, 2 * numSamples, bus.hEven2, bus.hOdd2);
+            }else{
+                pShaper->process(up, 2 * numSamples);
+            }
+
+            downsample(stage1, up, wetBuffer, numSamples, bus.hEven1, bus.hOdd1);
+        }
+
+        // a lopsided curve leaves an offset, which a 10Hz highpass takes back out
+        if(bDCBlock){
+            float fIn = bus.fDCIn, fOut = bus.fDCOut;
+            for(int s=0; s<numSamples; s++){
+                const float fX = wetBuffer[s];
+                fOut = fX - fIn + fDCCoeff * fOut;
+                fIn = fX;
+                wetBuffer[s] = fOut;
+            }
+            bus.fDCIn = fIn;
+            bus.fDCOut = fOut;
+        }
+
+        // mix with the dry signal, delayed to match
+        const float* delayed = dry - latency;
+        if(bus.fWet == bus.fTargetWet && bus.fDry == bus.fTargetDry){
+            FloatVectorOperations::copyWithMultiply(data, wetBuffer, bus.fWet, numSamples);
+            if(bus.fDry != 0.0f)
+                FloatVectorOperations::addWithMultiply(data, delayed, bus.fDry, numSamples);
+        }else{
+            const float fWetStep = (bus.fTargetWet - bus.fWet) / numSamples;
+            const float fDryStep = (bus.fTargetDry - bus.fDry) / numSamples;
+            float fWet = bus.fWet, fDry = bus.fDry;
+            for(int s=0; s<numSamples; s++){
+                fWet += fWetStep;
+                fDry += fDryStep;
+                data[s] = wetBuffer[s] * fWet + delayed[s] * fDry;
+            }
+            bus.fWet = bus.fTargetWet;
+            bus.fDry = bus.fTargetDry;
+        }
+    }
+
+    // audio thread: picks up changed settings
+    void updateSettings()
+    {
+        lastVersion = version.get();
+
+        const bool bWasActive = bAnyActive;
+        bAnyActive = false;
+        for(int b=0; b<numBuses; b++)
+            bAnyActive |= settings[b].fMix > 0.0f;
+
+        // a change of latency starts every bus afresh
+        const bool bRestart = iFactor != iRequestedFactor || (bAnyActive && !bWasActive);
+        iFactor = iRequestedFactor;
+        if(bRestart)
+            reset();
+
+        // the DC blocker starts afresh if the new curve needs it
+        const Curve curve = requestedCurve;
+        if(pShaper != &shapers[curve]){
+            pShaper = &shapers[curve];
+            bDCBlock = !bSymmetric[curve];
+            for(int b=0; b<kMaxBuses; b++)
+                state[b].fDCIn = state[b].fDCOut = 0.0f;
+        }
+
+        fDCCoeff = (float)(1.0 - 2.0 * double_Pi * 10.0 / fSampleRate);
+
+        for(int b=0; b<numBuses; b++){
+            BusState& bus = state[b];
+            const Settings& s = settings[b];
+            const bool bOn = s.fMix > 0.0f;
+
+            bus.fTargetDrive = Decibels::decibelsToGain(s.fDrive);
+            bus.fTargetWet = bOn ? Decibels::decibelsToGain(s.fOutput) * s.fMix : 0.0f;
+            bus.fTargetDry = 1.0f - s.fMix;
+
+            // a bus coming out of bypass fades in, from clear filters
+            if(bOn && !bus.bActive){
+                if(!bRestart)
+                    clearFilters(bus);
+                bus.fDrive = bus.fTargetDrive;
+                bus.fWet = 0.0f;
+                bus.fDry = 1.0f;
+            }
+            bus.bActive = bOn;
+
+            if(bRestart){
+                bus.fDrive = bus.fTargetDrive;
+                bus.fWet = bus.fTargetWet;
+                bus.fDry = bus.fTargetDry;
+            }
+        }
+    }
+
+    const int numBuses;
+    double fSampleRate;
+    int iRequestedFactor, iFactor;
+    volatile Curve requestedCurve;
+
+    Settings settings[kMaxBuses];
+    Atomic<int> version;
+    int lastVersion;
+
+    bool bAnyActive, bDCBlock;
+    float fDCCoeff;
+
+    TableWaveshaper shapers[kNumCurves];
+    bool bSymmetric[kNumCurves];
+    TableWaveshaper* pShaper;
+    Halfband stage1, stage2;    // 1x <-> 2x, 2x <-> 4x
+    BusState state[kMaxBuses];
+
+    // work buffers for the chunk being driven (at each rate, with history in front)
+    float dryBuffer[kHistory + kChunk], inBuffer[kHistory + kChunk], wetBuffer[kChunk];
+    float upBuffer[kHistory + 2 * kChunk], highBuffer[4 * kChunk];
+    float evenBuffer[kHistory + 2 * kChunk], oddBuffer[kHistory + 2 * kChunk];
+    float scratch[2 * kChunk];
+
+    JUCE_DECLARE_NON_COPYABLE (BusSaturation)
+};
+
+#endif
@@ -0,0 +1,319 @@
+//
+//  ChannelStrip.h
+//  TestSynthAU
+//
+//  The editor's Channel page: the mix processing of a chosen bus, the drive on the
+//  main outputs and the room reverb, set straight on the synth. These aren't host parameters -
+//  they're saved with the plugin's state instead (see MySynth::saveSettings()).
+//
+
+#ifndef __ChannelStrip_h__
+#define __ChannelStrip_h__
+
+#include "SynthPlugin.h"
+
+class ChannelStrip : public Component,
+                     public SliderListener,
+                     public ComboBoxListener,
+                     public ButtonListener,
+                     public Timer
+{
+public:
+    ChannelStrip (MySynth& owner)
+    :   synth(owner), iBus(0), lastVersion(-1)
+    {
+        addAndMakeVisible(&busList);
+        addAndMakeVisible(&keyList);
+        keyList.addItem("Own signal", 1);
+        for(int b = 0; b < synth.getNumBuses(); b++){
+            busList.addItem(synth.getBusName(b), b + 1);
+            keyList.addItem(synth.getBusName(b), b + 2);
+        }
+        busList.setSelectedId(1, dontSendNotification);
+        busList.addListener(this);
+        keyList.addListener(this);
+        addAndMakeVisible(&keyLabel);
+        keyLabel.setText("Key", dontSendNotification);
+        keyLabel.setFont(Font(11.0f));
+        keyLabel.setJustificationType(Justification::centredBottom);
+
+        for(int k = 0; k < kNumKnobs; k++){
+            Slider* pKnob = knobs.add(new Slider());
+            addAndMakeVisible(pKnob);
+            pKnob->setSliderStyle(Slider::Rotary);
+            pKnob->setTextBoxStyle(Slider::TextBoxBelow, false, kKnobWidth, 16);
+            pKnob->setRange(getKnob(k).min, getKnob(k).max, getKnob(k).interval);
+            if(getKnob(k).mid > getKnob(k).min)
+                pKnob->setSkewFactorFromMidPoint(getKnob(k).mid);
+            pKnob->addListener(this);
+
+            Label* pLabel = labels.add(new Label(String::empty, getKnob(k).name));
+            pLabel->setFont(Font(11.0f));
+            pLabel->setJustificationType(Justification::centredBottom);
+            addAndMakeVisible(pLabel);
+        }
+
+        for(int c = 0; c < BusSaturation::kNumCurves; c++)
+            curveList.addItem(BusSaturation::getCurveName((BusSaturation::Curve)c), c + 1);
+        oversamplingList.addItem("Off", 1);
+        oversamplingList.addItem("2x", 2);
+        oversamplingList.addItem("4x", 4);
+        for(int i = 0; i < 2; i++){
+            ComboBox& list = i == 0 ? curveList : oversamplingList;
+            Label& label = i == 0 ? curveLabel : oversamplingLabel;
+            addAndMakeVisible(&list);
+            list.addListener(this);
+            addAndMakeVisible(&label);
+            label.setText(i == 0 ? "Curve" : "Oversampling", dontSendNotification);
+            label.setFont(Font(11.0f));
+            label.setJustificationType(Justification::centredBottom);
+        }
+
+        addAndMakeVisible(&loadImpulse);
+        loadImpulse.setButtonText("Load Room...");
+        loadImpulse.addListener(this);
+        addAndMakeVisible(&clearImpulse);
+        clearImpulse.setButtonText("Clear");
+        clearImpulse.addListener(this);
+        addAndMakeVisible(&impulseName);
+        impulseName.setFont(Font(11.0f));
+
+        setSize(kColumnWidth * 12 + 16, kTop + kRowHeight * kNumRows);
+        refresh();
+        startTimer(100);
+    }
+
+    //==============================================================================
+    void paint (Graphics& g)
+    {
+        static const char* const rows[kNumRows] = { "EQ", "Dynamics", "Drive", "Room" };
+
+        g.setColour(Colours::white);
+        g.setFont(Font(12.0f, Font::bold));
+        for(int r = 0; r < kNumRows; r++)
+            g.drawText(rows[r], 8, kTop + kRowHeight * r - 16, 200, 14, Justification::centredLeft, false);
+    }
+
+    void resized()
+    {
+        busList.setBounds(8, 8, 160, 22);
+
+        for(int k = 0; k < kNumKnobs; k++){
+            const int x = 8 + kColumnWidth * getKnob(k).column;
+            const int y = kTop + kRowHeight * getKnob(k).row;
+            labels[k]->setBounds(x - 4, y, kKnobWidth + 8, 14);
+            knobs[k]->setBounds(x, y + 14, kKnobWidth, 62);
+        }
+
+        const int dynamicsY = kTop + kRowHeight * kDynamicsRow;
+        keyLabel.setBounds(8 + kColumnWidth * 7, dynamicsY, 110, 14);
+        keyList.setBounds(8 + kColumnWidth * 7, dynamicsY + 14 + 20, 110, 22);
+
+        const int driveY = kTop + kRowHeight * kDriveRow;
+        curveLabel.setBounds(8 + kColumnWidth * 4, driveY, 96, 14);
+        curveList.setBounds(8 + kColumnWidth * 4, driveY + 14 + 20, 96, 22);
+        oversamplingLabel.setBounds(8 + kColumnWidth * 6, driveY, 96, 14);
+        oversamplingList.setBounds(8 + kColumnWidth * 6, driveY + 14 + 20, 96, 22);
+
+        const int roomY = kTop + kRowHeight * kRoomRow + 14;
+        loadImpulse.setBounds(8 + kColumnWidth * 2, roomY, 96, 22);
+        clearImpulse.setBounds(8 + kColumnWidth * 2 + 100, roomY, 48, 22);
+        impulseName.setBounds(8 + kColumnWidth * 2, roomY + 26, 300, 20);
+    }
+
+    // shows settings loaded with a new state
+    void timerCallback()
+    {
+        if(synth.getSettingsVersion() != lastVersion)
+            refresh();
+    }
+
+    void comboBoxChanged (ComboBox* comboBox)
+    {
+        if(comboBox == &busList){
+            iBus = busList.getSelectedId() - 1;
+            refresh();
+        }else if(comboBox == &keyList){
+            synth.dynamics.setSidechain(iBus, keyList.getSelectedId() - 2);
+        }else if(comboBox == &curveList){
+            synth.drive.setCurve((BusSaturation::Curve)(curveList.getSelectedId() - 1));
+        }else if(comboBox == &oversamplingList){
+            // (the master drive is oversampled alike - it keeps its tube curve)
+            synth.drive.setOversampling(oversamplingList.getSelectedId());
+            synth.masterDrive.setOversampling(oversamplingList.getSelectedId());
+        }
+    }
+
+    void sliderValueChanged (Slider* slider)
+    {
+        const int k = knobs.indexOf(slider);
+        const float value = (float) slider->getValue();
+        if(k >= kEQFirst && k <= kEQLast)
+            setEQ(getKnob(k).band);
+        else if(k >= kThreshold && k <= kMakeup)
+            synth.dynamics.setCompressor(iBus, (float) knobs[kThreshold]->getValue(), (float) knobs[kRatio]->getValue(),
+                                         (float) knobs[kAttack]->getValue(), (float) knobs[kRelease]->getValue(),
+                                         (float) knobs[kMakeup]->getValue());
+        else if(k == kTransientAttack || k == kTransientSustain)
+            synth.dynamics.setTransientShaper(iBus, (float) knobs[kTransientAttack]->getValue(), (float) knobs[kTransientSustain]->getValue());
+        else if(k == kLookahead)
+            synth.dynamics.setLookahead(value);
+        else if(k >= kDrive && k <= kDriveMix)
+            synth.drive.setBus(iBus, (float) knobs[kDrive]->getValue(), (float) knobs[kDriveOutput]->getValue(),
+                               (float) knobs[kDriveMix]->getValue());
+        else if(k >= kMasterDrive && k <= kMasterMix){
+            for(int channel = 0; channel < 2; channel++)
+                synth.masterDrive.setBus(channel, (float) knobs[kMasterDrive]->getValue(), (float) knobs[kMasterOutput]->getValue(),
+                                         (float) knobs[kMasterMix]->getValue());
+        }
+        else if(k == kReverbSend)
+            synth.setReverbSend(iBus, value);
+        else if(k == kReverbReturn)
+            synth.setReverbReturn(value);
+    }
+
+    void buttonClicked (Button* button)
+    {
+        if(button == &loadImpulse){
+            FileChooser chooser ("Room impulse", synth.getRoomImpulse(), "*.wav;*.aif;*.aiff;*.flac");
+            if(chooser.browseForFileToOpen())
+                synth.loadRoomImpulse(chooser.getResult());
+        }else if(button == &clearImpulse){
+            synth.loadRoomImpulse(File::nonexistent);
+        }
+        refresh();
+    }
+
+private:
+    enum Knob {
+        kHighPass, kHighPassQ, kLowShelf, kLowShelfGain, kBell1, kBell1Gain, kBell1Q,
+        kBell2, kBell2Gain, kBell2Q, kHighShelf, kHighShelfGain,
+        kThreshold, kRatio, kAttack, kRelease, kMakeup, kTransientAttack, kTransientSustain, kLookahead,
+        kDrive, kDriveOutput, kDriveMix, kMasterDrive, kMasterOutput, kMasterMix,
+        kReverbSend, kReverbReturn,
+        kNumKnobs,
+        kEQFirst = kHighPass, kEQLast = kHighShelfGain
+    };
+    enum { kDynamicsRow = 1, kDriveRow = 2, kRoomRow = 3, kNumRows = 4, kTop = 56, kRowHeight = 96, kColumnWidth = 52, kKnobWidth = 48 };
+
+    // Where a knob sits, its range (skewed about mid, if that's within it) and, for
+    // the EQ, its band and which of the band's settings it sets (0 the frequency, 1
+    // the gain, 2 the q) - with the frequency a bypassed band shows. (The lookahead,
+    // the master drive and the room's return are the same whichever bus is shown; a
+    // drive's mix of 0 bypasses it.)
+    struct KnobLayout
+    {
+        const char* name;
+        int row, column;
+        float min, max, interval, mid;
+        int band, setting;
+        float initial;
+    };
+
+    static const KnobLayout& getKnob (int k)
+    {
+        // (the high-pass is off at 0Hz; the shelves and bells at 0dB)
+        static const KnobLayout knobs[kNumKnobs] = {
+            //  name,       row, column,  min,    max,     interval, mid,   band,               setting, initial
+            {   "HP",       0,   0,       0.0f,   500.0f,  1.0f,     80.0f,   BusEQ::kHighPass,   0,  0.0f     },
+            {   "HP Q",     0,   1,       0.3f,   2.0f,    0.01f,    0.0f,    BusEQ::kHighPass,   2,  0.0f     },
+            {   "Low",      0,   2,       30.0f,  500.0f,  1.0f,     120.0f,  BusEQ::kLowShelf,   0,  100.0f   },
+            {   "Low dB",   0,   3,       -18.0f, 18.0f,   0.1f,     0.0f,    BusEQ::kLowShelf,   1,  0.0f     },
+            {   "Mid 1",    0,   4,       40.0f,  16000.0f, 1.0f,    800.0f,  BusEQ::kBell1,      0,  400.0f   },
+            {   "Mid 1 dB", 0,   5,       -18.0f, 18.0f,   0.1f,     0.0f,    BusEQ::kBell1,      1,  0.0f     },
+            {   "Mid 1 Q",  0,   6,       0.1f,   10.0f,   0.01f,    1.0f,    BusEQ::kBell1,      2,  0.0f     },
+            {   "Mid 2",    0,   7,       40.0f,  16000.0f, 1.0f,    800.0f,  BusEQ::kBell2,      0,  2500.0f  },
+            {   "Mid 2 dB", 0,   8,       -18.0f, 18.0f,   0.1f,     0.0f,    BusEQ::kBell2,      1,  0.0f     },
+            {   "Mid 2 Q",  0,   9,       0.1f,   10.0f,   0.01f,    1.0f,    BusEQ::kBell2,      2,  0.0f     },
+            {   "High",     0,   10,      1000.0f, 16000.0f, 1.0f,   4000.0f, BusEQ::kHighShelf,  0,  8000.0f  },
+            {   "High dB",  0,   11,      -18.0f, 18.0f,   0.1f,     0.0f,    BusEQ::kHighShelf,  1,  0.0f     },
+            {   "Threshold", 1,  0,       -60.0f, 0.0f,    0.1f,     0.0f,    -1,                 -1, 0.0f     },
+            {   "Ratio",    1,   1,       1.0f,   20.0f,   0.1f,     4.0f,    -1,                 -1, 0.0f     },
+            {   "Attack",   1,   2,       0.1f,   100.0f,  0.1f,     10.0f,   -1,                 -1, 0.0f     },
+            {   "Release",  1,   3,       10.0f,  1000.0f, 1.0f,     100.0f,  -1,                 -1, 0.0f     },
+            {   "Makeup",   1,   4,       0.0f,   24.0f,   0.1f,     0.0f,    -1,                 -1, 0.0f     },
+            {   "Punch",    1,   5,       -1.0f,  1.0f,    0.01f,    0.0f,    -1,                 -1, 0.0f     },
+            {   "Sustain",  1,   6,       -1.0f,  1.0f,    0.01f,    0.0f,    -1,                 -1, 0.0f     },
+            {   "Lookahead", 1,  11,      0.0f,   5.0f,    0.1f,     0.0f,    -1,                 -1, 0.0f     },
+            {   "Drive",    2,   0,       0.0f,   36.0f,   0.1f,     0.0f,    -1,                 -1, 0.0f     },
+            {   "Output",   2,   1,       -24.0f, 6.0f,    0.1f,     0.0f,    -1,                 -1, 0.0f     },
+            {   "Mix",      2,   2,       0.0f,   1.0f,    0.01f,    0.0f,    -1,                 -1, 0.0f     },
+            {   "Master",   2,   9,       0.0f,   36.0f,   0.1f,     0.0f,    -1,                 -1, 0.0f     },
+            {   "Mstr Out", 2,   10,      -24.0f, 6.0f,    0.1f,     0.0f,    -1,                 -1, 0.0f     },
+            {   "Mstr Mix", 2,   11,      0.0f,   1.0f,    0.01f,    0.0f,    -1,                 -1, 0.0f     },
+            {   "Send",     3,   0,       0.0f,   1.0f,    0.01f,    0.0f,    -1,                 -1, 0.0f     },
+            {   "Return",   3,   1,       0.0f,   2.0f,    0.01f,    0.0f,    -1,                 -1, 0.0f     },
+        };
+        return knobs[k];
+    }
+
+    //==============================================================================
+    // shows the current bus's settings
+    void refresh()
+    {
+        lastVersion = synth.getSettingsVersion();
+
+        knobs[kThreshold]->setValue(synth.dynamics.getThreshold(iBus), dontSendNotification);
+        knobs[kRatio]->setValue(synth.dynamics.getRatio(iBus), dontSendNotification);
+        knobs[kAttack]->setValue(synth.dynamics.getAttack(iBus), dontSendNotification);
+        knobs[kRelease]->setValue(synth.dynamics.getRelease(iBus), dontSendNotification);
+        knobs[kMakeup]->setValue(synth.dynamics.getMakeup(iBus), dontSendNotification);
+        knobs[kTransientAttack]->setValue(synth.dynamics.getTransientAttack(iBus), dontSendNotification);
+        knobs[kTransientSustain]->setValue(synth.dynamics.getTransientSustain(iBus), dontSendNotification);
+        knobs[kLookahead]->setValue(synth.dynamics.getLookahead(), dontSendNotification);
+        keyList.setSelectedId(synth.dynamics.getSidechain(iBus) + 2, dontSendNotification);
+
+        knobs[kDrive]->setValue(synth.drive.getDrive(iBus), dontSendNotification);
+        knobs[kDriveOutput]->setValue(synth.drive.getOutput(iBus), dontSendNotification);
+        knobs[kDriveMix]->setValue(synth.drive.getMix(iBus), dontSendNotification);
+        knobs[kMasterDrive]->setValue(synth.masterDrive.getDrive(0), dontSendNotification);
+        knobs[kMasterOutput]->setValue(synth.masterDrive.getOutput(0), dontSendNotification);
+        knobs[kMasterMix]->setValue(synth.masterDrive.getMix(0), dontSendNotification);
+        curveList.setSelectedId(synth.drive.getCurve() + 1, dontSendNotification);
+        oversamplingList.setSelectedId(synth.drive.getOversampling(), dontSendNotification);
+
+        knobs[kReverbSend]->setValue(synth.getReverbSend(iBus), dontSendNotification);
+        knobs[kReverbReturn]->setValue(synth.getReverbReturn(), dontSendNotification);
+        const File impulse (synth.getRoomImpulse());
+        impulseName.setText(impulse != File::nonexistent ? impulse.getFileName() : String("No room impulse"), dontSendNotification);
+
+        for(int k = kEQFirst; k <= kEQLast; k++){
+            const int band = getKnob(k).band;
+            float value;
+            switch(getKnob(k).setting){
+                case 0:  value = synth.eq.getFrequency(iBus, band); break;
+                case 1:  value = synth.eq.getGain(iBus, band); break;
+                default: value = synth.eq.getQ(iBus, band); break;
+            }
+            if(getKnob(k).setting == 0 && value <= 0.0f)
+                value = getKnob(k).initial;
+            knobs[k]->setValue(value, dontSendNotification);
+        }
+    }
+
+    // sets a band of the current bus's EQ from its knobs
+    void setEQ (int band)
+    {
+        float settings[3] = { 0.0f, 0.0f, 0.7071f };
+        for(int k = kEQFirst; k <= kEQLast; k++){
+            if(getKnob(k).band == band)
+                settings[getKnob(k).setting] = (float) knobs[k]->getValue();
+        }
+        synth.eq.setBand(iBus, band, settings[0], settings[1], settings[2]);
+    }
+
+    MySynth& synth;
+    int iBus;
+    int lastVersion;
+
+    ComboBox busList, keyList, curveList, oversamplingList;
+    Label keyLabel, curveLabel, oversamplingLabel;
+    OwnedArray<Slider> knobs;
+    OwnedArray<Label> labels;
+    TextButton loadImpulse, clearImpulse;
+    Label impulseName;
+
+    JUCE_DECLARE_NON_COPYABLE (ChannelStrip)
+};
+
+#endif
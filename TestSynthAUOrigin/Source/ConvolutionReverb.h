@@ -0,0 +1,454 @@
+//
+//  ConvolutionReverb.h
+//  TestSynthAU
+//
+//  A convolution reverb for the room send, using partitioned overlap-save
+//  convolution on dRowAudio's FFTOperation (vDSP on the Mac, FFTReal elsewhere).
+//  Impulses are loaded, and their partitions transformed, on a background thread;
+//  the audio thread swaps the finished kernel in at the start of a block.
+//
+
+#ifndef __ConvolutionReverb_h__
+#define __ConvolutionReverb_h__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "RealtimeGuard.h"
+
+class ConvolutionReverb
+{
+public:
+    enum { kMaxChannels = 2 };
+
+    ConvolutionReverb()
+    :   pCurrent(nullptr), loader(*this)
+    {
+    }
+
+    ~ConvolutionReverb()
+    {
+        loader.stopThread(10000);
+        delete pCurrent;
+        delete pendingKernel.exchange(nullptr);
+        delete retiredKernel.exchange(nullptr);
+    }
+
+    //==============================================================================
+    // Loads a (mono or stereo) impulse from an audio file, resampled to sampleRate.
+    // This returns at once - the previous impulse keeps playing until the new one is
+    // ready. The input is convolved in blocks of blockSize samples, which sets the
+    // latency. With a tailBlockSize, the partitions beyond the first tailBlockSize
+    // samples of the impulse are tailBlockSize long (non-uniform partitioning), which
+    // costs far less for long impulses; 0 keeps every partition blockSize long.
+    void loadImpulse(const File& file, double sampleRate, int blockSize = 64, int tailBlockSize = 1024)
+    {
+        const GuardedCriticalSection::ScopedLockType sl (requestLock);
+        request.file = file;
+        request.fSampleRate = sampleRate;
+        request.iBlockSize = nextPowerOfTwo(jlimit(16, 8192, blockSize));
+        request.iTailBlockSize = tailBlockSize > request.iBlockSize ? nextPowerOfTwo(jmin(65536, tailBlockSize)) : 0;
+        request.bPending = true;
+        request.iSerial = ++numRequests;
+
+        if(!loader.isThreadRunning())
+            loader.startThread(3);
+        loader.notify();
+    }
+
+    // removes the impulse (from the next block)
+    void clearImpulse() { loadImpulse(File::nonexistent, 44100.0); }
+
+    // the impulse last asked for, and the rate it was asked for at
+    File getImpulseFile() const { const GuardedCriticalSection::ScopedLockType sl (requestLock); return request.file; }
+    double getImpulseSampleRate() const { const GuardedCriticalSection::ScopedLockType sl (requestLock); return request.fSampleRate; }
+
+    // (offline renders) Waits until the impulse last asked for is ready, so that the
+    // next block starts with it. Returns false if it takes longer than timeoutMs.
+    bool waitForImpulse(int timeoutMs)
+    {
+        const uint32 start = Time::getMillisecondCounter();
+        while(numLoaded.get() != numRequests.get()){
+            if(Time::getMillisecondCounter() - start > (uint32) timeoutMs)
+                return false;
+            Thread::sleep(1);
+        }
+
+        // (the kernel is only swapped in once the previous one has been freed)
+        delete retiredKernel.exchange(nullptr);
+        return true;
+    }
+
+    // true once an impulse has been swapped in (as seen by the audio thread)
+    bool isLoaded() const { return pCurrent != nullptr && pCurrent->getLength() > 0; }
+
+    // the delay of the reverb's output relative to its input, in samples
+    int getLatency() const { return pCurrent != nullptr ? pCurrent->getLatency() : 0; }
+
+    //==============================================================================
+    // Audio thread: swaps in a newly loaded kernel, handing the old one back to the
+    // loader to free (once it has freed the last one). process() does this itself -
+    // call it first to have isLoaded() right for the whole of the block.
+    void update()
+    {
+        if(retiredKernel.get() == nullptr){
+            Kernel* pNew = pendingKernel.exchange(nullptr);
+            if(pNew != nullptr){
+                retiredKernel.set(pCurrent);
+                pCurrent = pNew;
+            }
+        }
+    }
+
+    // Audio thread: convolves numSamples of the (mono) send with the impulse,
+    // replacing the contents of numOutputs output channels. A mono impulse feeds
+    // every output.
+    void process(const float* input, float** outputs, int numOutputs, int numSamples)
+    {
+        update();
+
+        if(pCurrent == nullptr || pCurrent->getLength() == 0){
+            for(int c=0; c<numOutputs; c++)
+                FloatVectorOperations::clear(outputs[c], numSamples);
+            return;
+        }
+
+        pCurrent->process(input, outputs, numOutputs, numSamples);
+    }
+
+private:
+    //==============================================================================
+    /** One uniformly partitioned overlap-save convolver: the impulse from irStart is
+        split into partitions of P samples, each zero-padded to 2P and transformed.
+        Every P input samples, the last 2P inputs are transformed into the frequency-
+        domain delay line, multiplied with the partitions and summed, giving P output
+        samples from the inverse transform.                                        */
+    class Segment
+    {
+    public:
+        Segment(const AudioSampleBuffer& ir, int irStart, int irEnd, int partitionSize)
+        :   P(partitionSize), N(partitionSize * 2), fft(getLog2(partitionSize * 2)),
+            numChannels(ir.getNumChannels()), fdlPos(0), fScale(1.0f)
+        {
+            numPartitions = jmax(1, (irEnd - irStart + P - 1) / P);
+
+            irSpectra.calloc((size_t)(numChannels * numPartitions * N));
+            fdl.calloc((size_t)(numPartitions * N));
+            window.calloc((size_t)N);
+            accum.calloc((size_t)N);
+            timeOut.calloc((size_t)N);
+            output.calloc((size_t)(numChannels * P));
+
+            fScale = 1.0f / measureGain();
+
+            for(int c=0; c<numChannels; c++){
+                for(int k=0; k<numPartitions; k++){
+                    const int start = irStart + k * P;
+                    const int n = jmin(P, irEnd - start);
+                    FloatVectorOperations::clear(window, N);
+                    if(n > 0)
+                        FloatVectorOperations::copy(window, ir.getSampleData(c, start), n);
+                    fft.performFFT(window);
+                    FloatVectorOperations::copy(getSpectrum(c, k), fft.getFFTBuffer().realp, N);
+                }
+            }
+            FloatVectorOperations::clear(window, N);
+        }
+
+        int getPartitionSize() const { return P; }
+
+        // consumes P input samples, leaving P output samples per channel in getOutput()
+        void processBlock(const float* input)
+        {
+            // slide the input window along a block
+            FloatVectorOperations::copy(window, window + P, P);
+            FloatVectorOperations::copy(window + P, input, P);
+
+            fft.performFFT(window);
+            FloatVectorOperations::copy(fdl + fdlPos * N, fft.getFFTBuffer().realp, N);
+
+            for(int c=0; c<numChannels; c++){
+                FloatVectorOperations::clear(accum, N);
+                for(int k=0; k<numPartitions; k++){
+                    const int slot = (fdlPos + numPartitions - k) % numPartitions;
+                    multiplyAccumulate(accum, fdl + slot * N, getSpectrum(c, k));
+                }
+
+                FloatVectorOperations::copy(fft.getFFTBuffer().realp, accum, N);
+                fft.performIFFT(timeOut);
+
+                // the second half of the window is the part free of wrap-around
+                FloatVectorOperations::copyWithMultiply(output + c * P, timeOut + P, fScale, P);
+            }
+
+            fdlPos = (fdlPos + 1) % numPartitions;
+        }
+
+        const float* getOutput(int channel) const { return output + channel * P; }
+
+    private:
+        float* getSpectrum(int channel, int partition) { return irSpectra + (channel * numPartitions + partition) * N; }
+
+        // Spectra are packed as N/2 real parts then N/2 imaginary parts, with the DC
+        // and Nyquist bins (both purely real) sharing the first real/imaginary slots.
+        void multiplyAccumulate(float* acc, const float* x, const float* h) const
+        {
+            const int half = N / 2;
+            float* accRe = acc;
+            float* accIm = acc + half;
+            const float* xRe = x;
+            const float* xIm = x + half;
+            const float* hRe = h;
+            const float* hIm = h + half;
+
+            accRe[0] += xRe[0] * hRe[0];
+            accIm[0] += xIm[0] * hIm[0];
+
+            for(int i=1; i<half; i++){
+                accRe[i] += xRe[i] * hRe[i] - xIm[i] * hIm[i];
+                accIm[i] += xRe[i] * hIm[i] + xIm[i] * hRe[i];
+            }
+        }
+
+        // The platform FFTs scale differently, so the round-trip gain is measured by
+        // convolving a unit impulse with a unit impulse.
+        float measureGain()
+        {
+            FloatVectorOperations::clear(window, N);
+            window[0] = 1.0f;
+            fft.performFFT(window);
+            FloatVectorOperations::copy(accum, fft.getFFTBuffer().realp, N);
+
+            FloatVectorOperations::clear(window, N);
+            window[P] = 1.0f;
+            fft.performFFT(window);
+            FloatVectorOperations::copy(timeOut, fft.getFFTBuffer().realp, N);
+
+            FloatVectorOperations::clear(fdl, N);
+            multiplyAccumulate(fdl, timeOut, accum);
+            FloatVectorOperations::copy(fft.getFFTBuffer().realp, fdl, N);
+            fft.performIFFT(timeOut);
+
+            const float fGain = timeOut[P];
+            FloatVectorOperations::clear(fdl, N);
+            FloatVectorOperations::clear(accum, N);
+            FloatVectorOperations::clear(window, N);
+            return fGain != 0.0f ? fGain : 1.0f;
+        }
+
+        static int getLog2(int n) { int l = 0; while((1 << l) < n) l++; return l; }
+
+        const int P, N;
+        drow::FFTOperation fft;
+        const int numChannels;
+        int numPartitions;
+        int fdlPos;
+        float fScale;
+
+        HeapBlock<float> irSpectra;     // [channel][partition][N]
+        HeapBlock<float> fdl;           // [partition][N], the input spectra
+        HeapBlock<float> window, accum, timeOut;
+        HeapBlock<float> output;        // [channel][P]
+
+        JUCE_DECLARE_NON_COPYABLE (Segment)
+    };
+
+    //==============================================================================
+    /** A loaded impulse: a head segment of small partitions (which sets the latency)
+        and optionally a tail segment of larger ones, covering the impulse from where
+        the head ends. Each adds its output into an output ring at the samples' times,
+        read out blockSize samples after the input arrived.                        */
+    class Kernel
+    {
+    public:
+        Kernel(const AudioSampleBuffer& ir, int blockSize, int tailBlockSize)
+        :   iLength(ir.getNumSamples()), numChannels(ir.getNumChannels()), B(blockSize), T(0), H(0),
+            headFill(0), tailFill(0), ring(1, 1), iRingSize(1), iTime(0)
+        {
+            if(iLength == 0)
+                return;
+
+            // the head must cover at least one tail block, for the tail to be ready in time
+            H = iLength;
+            if(tailBlockSize > blockSize && iLength > tailBlockSize){
+                T = tailBlockSize;
+                H = T;
+                tail = new Segment(ir, H, iLength, T);
+                tailInput.calloc((size_t)T);
+            }
+            head = new Segment(ir, 0, H, B);
+            headInput.calloc((size_t)B);
+
+            iRingSize = nextPowerOfTwo(H + T + B + 1);
+            ring.setSize(numChannels, iRingSize);
+            ring.clear();
+        }
+
+        int getLength() const { return iLength; }
+        int getLatency() const { return B; }
+
+        void process(const float* input, float** outputs, int numOutputs, int numSamples)
+        {
+            const int mask = iRingSize - 1;
+
+            for(int done=0; done<numSamples;){
+                // never run past the end of a head (or tail) block
+                int n = jmin(numSamples - done, B - headFill);
+                if(tail != nullptr)
+                    n = jmin(n, T - tailFill);
+
+                // read out the (finished) samples from blockSize ago
+                for(int c=0; c<numOutputs; c++){
+                    float* ringData = ring.getSampleData(jmin(c, numChannels - 1));
+                    for(int s=0; s<n; s++)
+                        outputs[c][done + s] = ringData[(int)((iTime - B + s) & mask)];
+                }
+                for(int c=0; c<numChannels; c++){
+                    float* ringData = ring.getSampleData(c);
+                    for(int s=0; s<n; s++)
+                        ringData[(int)((iTime - B + s) & mask)] = 0.0f;
+                }
+
+                FloatVectorOperations::copy(headInput + headFill, input + done, n);
+                if(tail != nullptr)
+                    FloatVectorOperations::copy(tailInput + tailFill, input + done, n);
+                headFill += n;
+                tailFill += n;
+                iTime += n;
+
+                if(headFill == B){
+                    head->processBlock(headInput);
+                    addToRing(*head, iTime - B);
+                    headFill = 0;
+                }
+                if(tail != nullptr && tailFill == T){
+                    tail->processBlock(tailInput);
+                    addToRing(*tail, iTime - T + H);
+                    tailFill = 0;
+                }
+
+                done += n;
+            }
+        }
+
+    private:
+        // adds a segment's output block to the ring, from sample time 'time'
+        void addToRing(const Segment& segment, int64 time)
+        {
+            const int mask = iRingSize - 1;
+            const int size = segment.getPartitionSize();
+            const int start = (int)(time & mask);
+            const int first = jmin(size, iRingSize - start);
+
+            for(int c=0; c<numChannels; c++){
+                float* ringData = ring.getSampleData(c);
+                FloatVectorOperations::add(ringData + start, segment.getOutput(c), first);
+                if(first < size)
+                    FloatVectorOperations::add(ringData, segment.getOutput(c) + first, size - first);
+            }
+        }
+
+        const int iLength, numChannels;
+        const int B;
+        int T, H;
+
+        ScopedPointer<Segment> head, tail;
+        HeapBlock<float> headInput, tailInput;
+        int headFill, tailFill;
+
+        AudioSampleBuffer ring;
+        int iRingSize;
+        int64 iTime;
+
+        JUCE_DECLARE_NON_COPYABLE (Kernel)
+    };
+
+    //==============================================================================
+    struct Request
+    {
+        Request() : fSampleRate(44100.0), iBlockSize(64), iTailBlockSize(0), bPending(false), iSerial(0) {}
+
+        File file;
+        double fSampleRate;
+        int iBlockSize, iTailBlockSize;
+        bool bPending;
+        int iSerial;    // counts the requests made
+    };
+
+    // reads, resamples and partitions requested impulses, off the audio thread
+    class Loader : public Thread
+    {
+    public:
+        Loader(ConvolutionReverb& owner) : Thread("Impulse Loader"), reverb(owner) {}
+
+        void run()
+        {
+            AudioFormatManager formats;
+            formats.registerBasicFormats();
+
+            while(!threadShouldExit()){
+                // free the kernel the audio thread last swapped out
+                delete reverb.retiredKernel.exchange(nullptr);
+
+                Request next;
+                {
+                    const GuardedCriticalSection::ScopedLockType sl (reverb.requestLock);
+                    next = reverb.request;
+                    reverb.request.bPending = false;
+                }
+
+                if(!next.bPending){
+                    wait(500);
+                    continue;
+                }
+
+                AudioSampleBuffer ir(1, 0);
+                readImpulse(formats, next, ir);
+                delete reverb.pendingKernel.exchange(new Kernel(ir, next.iBlockSize, next.iTailBlockSize));
+                reverb.numLoaded = next.iSerial;
+            }
+        }
+
+    private:
+        enum { kMaxImpulseSeconds = 10 };
+
+        static void readImpulse(AudioFormatManager& formats, const Request& next, AudioSampleBuffer& ir)
+        {
+            ScopedPointer<AudioFormatReader> reader(next.file.existsAsFile() ? formats.createReaderFor(next.file) : nullptr);
+            if(reader == nullptr || reader->lengthInSamples <= 0 || reader->sampleRate <= 0.0)
+                return;
+
+            const int numChannels = jmin((int)kMaxChannels, (int)reader->numChannels);
+            const int length = (int)jmin(reader->lengthInSamples, (int64)(reader->sampleRate * kMaxImpulseSeconds));
+
+            AudioSampleBuffer source(numChannels, length);
+            reader->read(&source, 0, length, 0, true, numChannels > 1);
+
+            const double ratio = reader->sampleRate / next.fSampleRate;
+            if(ratio == 1.0){
+                ir = source;
+                return;
+            }
+
+            const int outLength = (int)(length / ratio);
+            ir.setSize(numChannels, outLength);
+            for(int c=0; c<numChannels; c++){
+                LagrangeInterpolator interpolator;
+                interpolator.process(ratio, source.getSampleData(c), ir.getSampleData(c), outLength);
+            }
+        }
+
+        ConvolutionReverb& reverb;
+    };
+
+    Kernel* pCurrent;                   // owned by the audio thread
+    Atomic<Kernel*> pendingKernel;      // loader -> audio thread
+    Atomic<Kernel*> retiredKernel;      // audio thread -> loader
+
+    GuardedCriticalSection requestLock;
+    Request request;
+    Atomic<int> numRequests, numLoaded;
+    Loader loader;
+
+    JUCE_DECLARE_NON_COPYABLE (ConvolutionReverb)
+};
+
+#endif
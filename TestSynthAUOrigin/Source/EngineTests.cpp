@@ -0,0 +1,469 @@
+//
+//  EngineTests.cpp
+//  TestSynthAU
+//
+//  Unit tests for the engine's building blocks, each driven on its own rather than
+//  through a whole render (RenderTests.cpp covers those). Compiled in with
+//  TESTSYNTHAU_UNIT_TESTS - see Tools/RenderTests, which runs them.
+//
+
+#include "PluginProcessor.h"    // (ahead of BusSaturation.h's PluginWrapper.h)
+#include "RenderWorkers.h"
+#include "BusEQ.h"
+#include "BusDynamics.h"
+#include "BusSaturation.h"
+#include "ConvolutionReverb.h"
+
+#if TESTSYNTHAU_UNIT_TESTS
+
+//==============================================================================
+class RenderWorkerPoolTests  : public UnitTest
+{
+public:
+    RenderWorkerPoolTests() : UnitTest ("RenderWorkerPoolTests") {}
+
+    void runTest()
+    {
+        beginTest ("Back to back runs");
+
+        // (on a thread of its own, so a run that never returns fails the test rather
+        // than hanging it)
+        ScopedPointer<Runner> runner (new Runner());
+        runner->startThread();
+        if (! runner->waitForThreadToExit (60000))
+        {
+            expect (false, "run() never returned");
+            // (left spinning - it can't be stopped, and is ended with the process)
+            runner.release();
+            return;
+        }
+
+        expectEquals (runner->numMissed, 0, "items not rendered exactly once");
+    }
+
+private:
+    enum { kNumRuns = 10000, kMaxItems = 97, kNumHelpers = 3 };
+
+    // Renders each item by counting it, after a little work that varies by item, so
+    // helpers are still stealing at the end of one run when the next is dealt out.
+    class Job  : public RenderWorkerPool::Job
+    {
+    public:
+        void renderItem (int item, int)
+        {
+            volatile float x = 0.0f;
+            for (int i = 0; i < (item * 37) % 200; ++i)
+                x = x + 1.0f;
+
+            ++counts[item];
+        }
+
+        Atomic<int> counts[kMaxItems];
+    };
+
+    class Runner  : public Thread
+    {
+    public:
+        Runner() : Thread ("Render worker test"), numMissed (0) {}
+
+        void run()
+        {
+            RenderWorkerPool pool (kNumHelpers);
+            Job job;
+
+            for (int r = 0; r < kNumRuns; ++r)
+            {
+                const int numItems = (r * 7919) % kMaxItems;
+                for (int i = 0; i < numItems; ++i)
+                    job.counts[i] = 0;
+
+                pool.run (job, numItems);
+
+                for (int i = 0; i < numItems; ++i)
+                    if (job.counts[i].get() != 1)
+                        ++numMissed;
+            }
+        }
+
+        int numMissed;
+    };
+};
+
+static RenderWorkerPoolTests renderWorkerPoolTests;
+
+//==============================================================================
+// a sine on every channel of a buffer
+static void fillWithSine (AudioSampleBuffer& buffer, double frequency, double sampleRate)
+{
+    for (int s = 0; s < buffer.getNumSamples(); ++s)
+    {
+        const float value = (float) sin (2.0 * double_Pi * frequency * s / sampleRate);
+        for (int c = 0; c < buffer.getNumChannels(); ++c)
+            *buffer.getSampleData (c, s) = value;
+    }
+}
+
+//==============================================================================
+class BusEQTests  : public UnitTest
+{
+public:
+    BusEQTests() : UnitTest ("BusEQTests") {}
+
+    void runTest()
+    {
+        beginTest ("A bell's gain at its centre");
+        {
+            BusEQ eq (2);
+            eq.setSampleRate (kSampleRate);
+            eq.setBand (0, BusEQ::kBell1, 1000.0f, 6.0f, 1.0f);
+
+            expectNear (measureGain (eq, 0, 1000.0), 6.0, "+6dB bell at 1kHz");
+            expectNear (measureGain (eq, 1, 1000.0), 0.0, "bus without a band");
+        }
+
+        beginTest ("A high-pass at its cut-off");
+        {
+            BusEQ eq (1);
+            eq.setSampleRate (kSampleRate);
+            eq.setBand (0, BusEQ::kHighPass, 1000.0f);
+
+            expectNear (measureGain (eq, 0, 1000.0), -3.01, "high-pass at 1kHz");
+        }
+
+        beginTest ("Saving and loading");
+        {
+            BusEQ eq (3);
+            eq.setBand (0, BusEQ::kHighPass, 80.0f, 0.0f, 0.9f);
+            eq.setBand (2, BusEQ::kBell2, 3000.0f, -4.5f, 2.0f);
+
+            XmlElement xml ("EQ");
+            eq.saveSettings (xml);
+
+            BusEQ loaded (3);
+            loaded.setBand (1, BusEQ::kLowShelf, 100.0f, 3.0f);
+            loaded.loadSettings (xml);
+
+            for (int b = 0; b < 3; ++b)
+            {
+                for (int k = 0; k < BusEQ::kNumBands; ++k)
+                {
+                    expectEquals (loaded.getFrequency (b, k), eq.getFrequency (b, k));
+                    expectEquals (loaded.getGain (b, k), eq.getGain (b, k));
+                    expectEquals (loaded.getQ (b, k), eq.getQ (b, k));
+                }
+            }
+        }
+    }
+
+private:
+    static const double kSampleRate;
+
+    // Filters a second and a half of a sine on every bus, returning the gain (in dB)
+    // of the given bus over the last second, once the filters have settled.
+    static double measureGain (BusEQ& eq, int bus, double frequency)
+    {
+        const int length = (int) (kSampleRate * 1.5), settled = length - (int) kSampleRate;
+
+        AudioSampleBuffer buses (BusEQ::kMaxBuses, length);
+        fillWithSine (buses, frequency, kSampleRate);
+        const float inputRms = buses.getRMSLevel (bus, settled, length - settled);
+
+        eq.reset();
+        for (int done = 0; done < length; done += 512)
+        {
+            float* channels[BusEQ::kMaxBuses];
+            for (int b = 0; b < BusEQ::kMaxBuses; ++b)
+                channels[b] = buses.getSampleData (b, done);
+            eq.process (channels, 0, jmin (512, length - done));
+        }
+
+        return 20.0 * log10 (buses.getRMSLevel (bus, settled, length - settled) / inputRms);
+    }
+
+    void expectNear (double actual, double expected, const String& what)
+    {
+        expect (std::abs (actual - expected) < 0.01, what + " measured " + String (actual, 3) + "dB, not " + String (expected, 3));
+    }
+};
+
+const double BusEQTests::kSampleRate = 48000.0;
+
+static BusEQTests busEQTests;
+
+//==============================================================================
+class ConvolutionReverbTests  : public UnitTest
+{
+public:
+    ConvolutionReverbTests() : UnitTest ("ConvolutionReverbTests") {}
+
+    void runTest()
+    {
+        beginTest ("Uniform partitions against direct convolution");
+
+        // a stereo impulse of decaying noise, long enough for a tail segment
+        AudioSampleBuffer impulse (2, kImpulseLength);
+        Random random (1);
+        for (int c = 0; c < 2; ++c)
+            for (int s = 0; s < kImpulseLength; ++s)
+                *impulse.getSampleData (c, s) = (random.nextFloat() - 0.5f) * expf (-4.0f * s / kImpulseLength);
+
+        const File file (File::getSpecialLocation (File::tempDirectory).getNonexistentChildFile ("Impulse", ".wav", false));
+        {
+            WavAudioFormat wav;
+            ScopedPointer<AudioFormatWriter> writer (wav.createWriterFor (new FileOutputStream (file), kSampleRate, 2, 32,
+                                                                          StringPairArray(), 0));
+            expect (writer != nullptr && writer->writeFromAudioSampleBuffer (impulse, 0, kImpulseLength),
+                    "can't write " + file.getFullPathName());
+        }
+
+        testAgainstDirectConvolution (file, impulse, 0);
+
+        beginTest ("Non-uniform partitions against direct convolution");
+        testAgainstDirectConvolution (file, impulse, 1024);
+
+        file.deleteFile();
+    }
+
+private:
+    enum { kSampleRate = 44100, kImpulseLength = 3000, kBlockSize = 64, kLength = 8192 };
+
+    // Convolves noise, in ragged blocks, and compares it with the sum itself (delayed
+    // by the reverb's latency).
+    void testAgainstDirectConvolution (const File& file, const AudioSampleBuffer& impulse, int tailBlockSize)
+    {
+        ConvolutionReverb reverb;
+        reverb.loadImpulse (file, kSampleRate, kBlockSize, tailBlockSize);
+        expect (reverb.waitForImpulse (10000), "the impulse didn't load");
+
+        AudioSampleBuffer input (1, kLength), output (2, kLength);
+        Random random (2);
+        for (int s = 0; s < kLength; ++s)
+            *input.getSampleData (0, s) = random.nextFloat() - 0.5f;
+
+        for (int done = 0, n = 1; done < kLength; done += n, n = (n * 7 + 3) % 300 + 1)
+        {
+            n = jmin (n, kLength - done);
+            float* outputs[] = { output.getSampleData (0, done), output.getSampleData (1, done) };
+            reverb.process (input.getSampleData (0, done), outputs, 2, n);
+        }
+
+        expect (reverb.isLoaded(), "the impulse wasn't swapped in");
+        expectEquals (reverb.getLatency(), (int) kBlockSize);
+
+        double maxError = 0.0;
+        const float* x = input.getSampleData (0);
+        for (int c = 0; c < 2; ++c)
+        {
+            const float* h = impulse.getSampleData (c);
+            for (int s = 0; s < kLength; ++s)
+            {
+                double sum = 0.0;
+                for (int k = 0; k < kImpulseLength && k <= s - kBlockSize; ++k)
+                    sum += (double) h[k] * x[s - kBlockSize - k];
+                maxError = jmax (maxError, std::abs (sum - *output.getSampleData (c, s)));
+            }
+        }
+
+        expect (maxError < 1.0e-4, "off by " + String (maxError));
+    }
+};
+
+static ConvolutionReverbTests convolutionReverbTests;
+
+//==============================================================================
+class BusDynamicsTests  : public UnitTest
+{
+public:
+    BusDynamicsTests() : UnitTest ("BusDynamicsTests") {}
+
+    void runTest()
+    {
+        beginTest ("Steady-state gain reduction");
+        {
+            // 4:1 above -20dB, fed -6.02dB: (20 - 6.02) * (1 - 1/4) = 10.49dB of reduction
+            BusDynamics dynamics (2);
+            dynamics.setSampleRate (kSampleRate);
+            dynamics.setCompressor (0, -20.0f, 4.0f, 1.0f, 50.0f);
+            dynamics.setCompressor (1, -20.0f, 4.0f, 1.0f, 50.0f, 3.0f);
+
+            const float levels[] = { 0.5f, 0.5f };
+            double gains[2];
+            measureGains (dynamics, levels, gains);
+
+            const double reduction = (20.0 + 20.0 * log10 (0.5)) * 0.75;
+            expectNear (gains[0], -reduction, "4:1 at -6dB");
+            expectNear (gains[1], 3.0 - reduction, "4:1 at -6dB, with 3dB of makeup");
+        }
+
+        beginTest ("No reduction below the threshold");
+        {
+            BusDynamics dynamics (1);
+            dynamics.setSampleRate (kSampleRate);
+            dynamics.setCompressor (0, -20.0f, 4.0f, 1.0f, 50.0f);
+
+            const float levels[] = { 0.05f, 0.0f };
+            double gains[2];
+            measureGains (dynamics, levels, gains);
+            expectNear (gains[0], 0.0, "4:1 at -26dB");
+        }
+
+        beginTest ("Keyed from another bus");
+        {
+            BusDynamics dynamics (2);
+            dynamics.setSampleRate (kSampleRate);
+            dynamics.setCompressor (1, -20.0f, 4.0f, 1.0f, 50.0f);
+            dynamics.setSidechain (1, 0);
+
+            const float levels[] = { 0.5f, 0.05f };
+            double gains[2];
+            measureGains (dynamics, levels, gains);
+
+            expectNear (gains[0], 0.0, "the key bus");
+            expectNear (gains[1], -(20.0 + 20.0 * log10 (0.5)) * 0.75, "the keyed bus");
+        }
+
+        beginTest ("Saving and loading");
+        {
+            BusDynamics dynamics (3);
+            dynamics.setCompressor (0, -18.0f, 3.0f, 2.0f, 120.0f, 4.0f);
+            dynamics.setTransientShaper (2, 0.5f, -0.25f);
+            dynamics.setSidechain (2, 0);
+            dynamics.setLookahead (2.0f);
+
+            XmlElement xml ("DYNAMICS");
+            dynamics.saveSettings (xml);
+
+            BusDynamics loaded (3);
+            loaded.setCompressor (1, -10.0f, 2.0f);
+            loaded.loadSettings (xml);
+
+            expectEquals (loaded.getLookahead(), dynamics.getLookahead());
+            for (int b = 0; b < 3; ++b)
+            {
+                expectEquals (loaded.getThreshold (b), dynamics.getThreshold (b));
+                expectEquals (loaded.getRatio (b), dynamics.getRatio (b));
+                expectEquals (loaded.getAttack (b), dynamics.getAttack (b));
+                expectEquals (loaded.getRelease (b), dynamics.getRelease (b));
+                expectEquals (loaded.getMakeup (b), dynamics.getMakeup (b));
+                expectEquals (loaded.getTransientAttack (b), dynamics.getTransientAttack (b));
+                expectEquals (loaded.getTransientSustain (b), dynamics.getTransientSustain (b));
+                expectEquals (loaded.getSidechain (b), dynamics.getSidechain (b));
+            }
+        }
+    }
+
+private:
+    enum { kSampleRate = 48000 };
+
+    // Compresses a second of a square wave on buses 0 and 1, at the given levels (a
+    // square wave's level is steady, so the reduction settles without ripple),
+    // returning each one's gain (in dB) over its last 10ms.
+    static void measureGains (BusDynamics& dynamics, const float* levels, double* gains)
+    {
+        const int length = kSampleRate, settled = length - kSampleRate / 100;
+
+        AudioSampleBuffer buses (BusDynamics::kMaxBuses, length);
+        buses.clear();
+        for (int s = 0; s < length; ++s)
+            for (int b = 0; b < 2; ++b)
+                *buses.getSampleData (b, s) = levels[b] * (s % 96 < 48 ? 1.0f : -1.0f);
+
+        for (int done = 0; done < length; done += 512)
+        {
+            float* channels[BusDynamics::kMaxBuses];
+            for (int b = 0; b < BusDynamics::kMaxBuses; ++b)
+                channels[b] = buses.getSampleData (b, done);
+            dynamics.process (channels, 0, jmin (512, length - done));
+        }
+
+        for (int b = 0; b < 2; ++b)
+            gains[b] = levels[b] > 0.0f ? 20.0 * log10 (buses.getRMSLevel (b, settled, length - settled) / levels[b]) : 0.0;
+    }
+
+    void expectNear (double actual, double expected, const String& what)
+    {
+        expect (std::abs (actual - expected) < 0.01, what + " measured " + String (actual, 3) + "dB, not " + String (expected, 3));
+    }
+};
+
+static BusDynamicsTests busDynamicsTests;
+
+//==============================================================================
+class BusSaturationTests  : public UnitTest
+{
+public:
+    BusSaturationTests() : UnitTest ("BusSaturationTests") {}
+
+    void runTest()
+    {
+        beginTest ("Undriven buses delayed by the latency");
+        {
+            const int factors[] = { 1, 2, 4 };
+            const int latencies[] = { 0, 31, 36 };
+            for (int f = 0; f < numElementsInArray (factors); ++f)
+            {
+                // bus 0 is driven, so every bus is delayed; bus 1 should come out
+                // exactly as it went in, getLatency() samples later
+                BusSaturation saturation (2);
+                saturation.setOversampling (factors[f]);
+                saturation.setBus (0, 12.0f);
+                const int latency = saturation.getLatency();
+                expectEquals (latency, latencies[f], String (factors[f]) + "x latency");
+
+                const int length = 2000;
+                AudioSampleBuffer input (2, length), buses (2, length);
+                Random random (f + 1);
+                for (int b = 0; b < 2; ++b)
+                    for (int s = 0; s < length; ++s)
+                        *input.getSampleData (b, s) = random.nextFloat() * 2.0f - 1.0f;
+                buses.copyFrom (0, 0, input, 0, 0, length);
+                buses.copyFrom (1, 0, input, 1, 0, length);
+
+                // (in odd-sized blocks, so the delay carries across them)
+                for (int done = 0; done < length; done += 333)
+                {
+                    float* channels[] = { buses.getSampleData (0, done), buses.getSampleData (1, done) };
+                    saturation.process (channels, 0, jmin (333, length - done));
+                }
+
+                int mismatches = 0;
+                for (int s = 0; s < length; ++s)
+                {
+                    const float expected = s >= latency ? *input.getSampleData (1, s - latency) : 0.0f;
+                    if (*buses.getSampleData (1, s) != expected)
+                        ++mismatches;
+                }
+                expectEquals (mismatches, 0, String (factors[f]) + "x undriven bus");
+            }
+        }
+
+        beginTest ("Saving and loading");
+        {
+            BusSaturation saturation (3);
+            saturation.setCurve (BusSaturation::kTube);
+            saturation.setOversampling (4);
+            saturation.setBus (0, 12.0f, -3.0f, 0.5f);
+            saturation.setBus (2, 6.0f);
+
+            XmlElement xml ("DRIVE");
+            saturation.saveSettings (xml);
+
+            BusSaturation loaded (3);
+            loaded.setBus (1, 20.0f);
+            loaded.loadSettings (xml);
+
+            expectEquals ((int) loaded.getCurve(), (int) BusSaturation::kTube);
+            expectEquals (loaded.getOversampling(), 4);
+            for (int b = 0; b < 3; ++b)
+            {
+                expectEquals (loaded.getDrive (b), saturation.getDrive (b));
+                expectEquals (loaded.getOutput (b), saturation.getOutput (b));
+                expectEquals (loaded.getMix (b), saturation.getMix (b));
+            }
+        }
+    }
+};
+
+static BusSaturationTests busSaturationTests;
+
+#endif // TESTSYNTHAU_UNIT_TESTS
@@ -0,0 +1,180 @@
+//
+//  KitCache.h
+//  TestSynthAU
+//
+//  Remembers what loading a kit found out about each of its recordings - its peak
+//  (to normalise it), its length once the tail is trimmed, and its alignment with
+//  the other mics of the hit - so that later loads can skip those passes. Kept in
+//  the user's application data (one file per kit folder), and checked against each
+//  source file's modification time and size.
+//
+
+#ifndef __KitCache_h__
+#define __KitCache_h__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <map>
+
+class KitCache
+{
+public:
+    struct Entry
+    {
+        Entry() : modTime(0), fileSize(0), fPeak(1.0f), numFrames(0), startOffset(0), hash(0), bCurrent(false) {}
+
+        int64 modTime, fileSize;    // of the file the recording was read from
+        float fPeak;                // in the file's own units
+        int numFrames;              // once the tail is trimmed
+        int startOffset;            // see DrumKit::alignMics()
+        int64 hash;                 // of the trimmed, normalised samples
+        bool bCurrent;              // (not saved) matches the file as it is now
+    };
+
+    explicit KitCache(const String& kitPath)
+    :   lock("TestSynthAU.KitCache"), bChanged(false)
+    {
+        PropertiesFile::Options options;
+        options.applicationName = "Kit " + String::toHexString(kitPath.hashCode64());
+        options.filenameSuffix = "kitcache";
+       #if JUCE_LINUX
+        // (on Linux the folder is taken from the home directory itself)
+        options.folderName = ".config/TestSynthAU";
+       #else
+        options.folderName = "TestSynthAU";
+       #endif
+        options.osxLibrarySubFolder = "Application Support";
+        options.storageFormat = PropertiesFile::storeAsBinary;
+        options.millisecondsBeforeSaving = -1;
+        options.processLock = &lock;
+        properties = new PropertiesFile(options);
+
+        const StringPairArray& values = properties->getAllProperties();
+        for(int k = 0; k < values.size(); k++){
+            Entry entry;
+            if(parse(values.getAllValues()[k], entry))
+                entries[values.getAllKeys()[k]] = entry;
+        }
+    }
+
+    ~KitCache()
+    {
+        save();
+    }
+
+    // The recording's entry, if it was made from the source file as it is now (or
+    // NULL, in which case the recording has to be analysed and set()).
+    const Entry* find(const String& name, const File& source)
+    {
+        const Entries::iterator found = entries.find(name);
+        if(found == entries.end())
+            return NULL;
+
+        Entry& entry = found->second;
+        entry.bCurrent = entry.modTime == source.getLastModificationTime().toMilliseconds()
+                         && entry.fileSize == source.getSize();
+        return entry.bCurrent ? &entry : NULL;
+    }
+
+    // Stores a recording's analysis. If the samples are the same as when the old
+    // entry was made (the file was only touched), its alignment still holds.
+    void set(const String& name, const File& source, float fPeak, const float* samples, int numFrames)
+    {
+        const Entries::iterator found = entries.find(name);
+        Entry entry;
+        entry.modTime = source.getLastModificationTime().toMilliseconds();
+        entry.fileSize = source.getSize();
+        entry.fPeak = fPeak;
+        entry.numFrames = numFrames;
+        entry.hash = hashSamples(samples, numFrames);
+
+        if(found != entries.end() && found->second.hash == entry.hash){
+            entry.startOffset = found->second.startOffset;
+            entry.bCurrent = true;
+        }
+
+        entries[name] = entry;
+        bChanged = true;
+    }
+
+    // the recording's entry if it's current (found or set unchanged this load)
+    const Entry* getCurrent(const String& name) const
+    {
+        const Entries::const_iterator found = entries.find(name);
+        return found != entries.end() && found->second.bCurrent ? &found->second : NULL;
+    }
+
+    // stores a recording's alignment (which then holds until the recording changes)
+    void setStartOffset(const String& name, int offset)
+    {
+        const Entries::iterator found = entries.find(name);
+        if(found != entries.end()){
+            Entry& entry = found->second;
+            entry.startOffset = offset;
+            entry.bCurrent = true;
+            bChanged = true;
+        }
+    }
+
+    void save()
+    {
+        if(!bChanged)
+            return;
+
+        for(Entries::const_iterator i = entries.begin(); i != entries.end(); ++i)
+            properties->setValue(i->first, format(i->second));
+        properties->saveIfNeeded();
+        bChanged = false;
+    }
+
+private:
+    // (the peak is stored as its bits, so it comes back exactly)
+    static String format(const Entry& entry)
+    {
+        uint32 peakBits;
+        memcpy(&peakBits, &entry.fPeak, sizeof(peakBits));
+
+        String value;
+        value << entry.modTime << " " << entry.fileSize << " " << String::toHexString((int)peakBits)
+              << " " << entry.numFrames << " " << entry.startOffset << " " << String::toHexString(entry.hash);
+        return value;
+    }
+
+    static bool parse(const String& value, Entry& entry)
+    {
+        const StringArray fields (StringArray::fromTokens(value, " ", String::empty));
+        if(fields.size() != 6)
+            return false;
+
+        const uint32 peakBits = (uint32)fields[2].getHexValue32();
+        entry.modTime = fields[0].getLargeIntValue();
+        entry.fileSize = fields[1].getLargeIntValue();
+        memcpy(&entry.fPeak, &peakBits, sizeof(peakBits));
+        entry.numFrames = fields[3].getIntValue();
+        entry.startOffset = fields[4].getIntValue();
+        entry.hash = fields[5].getHexValue64();
+        return entry.numFrames > 0 && entry.fPeak > 0.0f;
+    }
+
+    // FNV-1a, over the samples' bytes
+    static int64 hashSamples(const float* samples, int numSamples)
+    {
+        uint64 hash = 14695981039346656037ULL;
+        const uint8* pBytes = reinterpret_cast<const uint8*>(samples);
+        for(size_t b = 0; samples != NULL && b < sizeof(float) * (size_t)numSamples; b++){
+            hash ^= pBytes[b];
+            hash *= 1099511628211ULL;
+        }
+        return (int64)hash;
+    }
+
+    typedef std::map<String, Entry> Entries;
+
+    InterProcessLock lock;
+    ScopedPointer<PropertiesFile> properties;
+    Entries entries;
+    bool bChanged;
+
+    JUCE_DECLARE_NON_COPYABLE (KitCache)
+};
+
+#endif
@@ -0,0 +1,321 @@
+//
+//  KitFile.h
+//  TestSynthAU
+//
+//  The packed kit: every recording of a kit in one file, so that loading a kit maps
+//  that file once rather than opening and parsing a few hundred WAVs. The file is a
+//  header and an index (one entry per recording) followed by the PCM itself, as
+//  normalised mono 32-bit floats (the voices play each mic's recording as a single
+//  channel), with each recording starting on a page boundary. Everything is
+//  little-endian.
+//
+//  KitFileWriter packs a folder of the kit's WAVs (see Tools/KitPacker); KitFile maps
+//  a packed kit and finds its recordings.
+//
+
+#ifndef __KitFile_h__
+#define __KitFile_h__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+/** How a kit's recordings are numbered, and named in its WAV folder. Articulations
+    0-6 are the drums (one mic each) and 7-14 the cymbals (kNumCymbalMics each). */
+struct KitLayout
+{
+    enum {
+        kNumDrums = 7,
+        kNumCymbals = 8,
+        kNumArticulations = kNumDrums + kNumCymbals,
+        kNumCymbalMics = 5,
+        kNumVelocities = 6,
+        kNumRoundRobins = 6
+    };
+
+    static int getNumMics(int articulation) { return articulation < kNumDrums ? 1 : kNumCymbalMics; }
+
+    // the recording's WAV, e.g. "Hats Open OH L 6_3.wav"
+    static String getFileName(int articulation, int mic, int velocity, int roundRobin)
+    {
+        static const char* const articulations[kNumArticulations] = {
+            "Bass Drum In ",
+            "Bass Drum Out ",
+            "Snare Up ",
+            "Snare Down ",
+            "High Tom ",
+            "Mid Tom ",
+            "Floor Tom ",
+            "Hats Closed Tip ",
+            "Hats Closed Shaft ",
+            "Hats Rock Sizzle ",
+            //    "Hats Tight Sizzle ",
+            "Hats Open ",
+            //    "Hats Pedal ",
+            "Ride Tip ",
+            "Ride Bell ",
+            "Splash Crash ",
+            "Crash Crash ",
+            //    "Crash Bell ",
+            //    "Crash Tip "
+        };
+        static const char* const cymbalMics[kNumCymbalMics] = {
+            "Close Mic ",
+            "OH L ",
+            "OH R ",
+            "Room L ",
+            "Room R "
+        };
+
+        String name (articulations[articulation]);
+        if(articulation >= kNumDrums)
+            name << cymbalMics[mic];
+        return name << (velocity + 1) << "_" << (roundRobin + 1) << ".wav";
+    }
+};
+
+//==============================================================================
+/** A packed kit, mapped into memory. Recordings are read straight from the mapping,
+    which stays valid for as long as the KitFile exists.                           */
+class KitFile
+{
+public:
+    enum {
+        kMagic = 0x54494b44,    // "DKIT"
+        kVersion = 1,
+        kPageSize = 4096
+    };
+
+    struct Header
+    {
+        uint32 magic, version, numEntries, reserved;
+    };
+
+    struct Entry
+    {
+        uint8 articulation, mic, velocity, roundRobin;
+        uint32 sampleRate;
+        uint32 numFrames;
+        uint16 numChannels, reserved;     // (always 1)
+        uint64 offset;      // of the PCM, from the start of the file
+        float peak;         // of the recording before it was normalised
+        uint32 reserved2;
+    };
+
+    // the packed kit's name, in a kit's folder
+    static const char* getDefaultFileName() { return "Kit.drumkit"; }
+
+    explicit KitFile(const File& file) : pEntries(NULL), numEntries(0)
+    {
+        for(int i = 0; i < kIndexSize; i++)
+            index[i] = -1;
+
+        // the index is read in place, so only little-endian hosts can use it (the
+        // kit's WAVs are loaded instead)
+       #if ! JUCE_BIG_ENDIAN
+        if(file.existsAsFile()){
+            map = new MemoryMappedFile(file, MemoryMappedFile::readOnly);
+            if(map->getData() == NULL || !readIndex())
+                map = nullptr;
+        }
+       #endif
+    }
+
+    bool isValid() const { return map != nullptr; }
+    int getNumEntries() const { return numEntries; }
+
+    // the recording's entry, or NULL if the kit doesn't have it
+    const Entry* find(int articulation, int mic, int velocity, int roundRobin) const
+    {
+        if(!isValid() || articulation < 0 || articulation >= KitLayout::kNumArticulations
+           || mic < 0 || mic >= KitLayout::kNumCymbalMics
+           || velocity < 0 || velocity >= KitLayout::kNumVelocities
+           || roundRobin < 0 || roundRobin >= KitLayout::kNumRoundRobins)
+            return NULL;
+
+        const int i = index[getIndex(articulation, mic, velocity, roundRobin)];
+        return i >= 0 ? pEntries + i : NULL;
+    }
+
+    const float* getSamples(const Entry& entry) const
+    {
+        return reinterpret_cast<const float*>(static_cast<const char*>(map->getData()) + entry.offset);
+    }
+
+private:
+    enum { kIndexSize = KitLayout::kNumArticulations * KitLayout::kNumCymbalMics * KitLayout::kNumVelocities * KitLayout::kNumRoundRobins };
+
+    static int getIndex(int articulation, int mic, int velocity, int roundRobin)
+    {
+        return ((articulation * KitLayout::kNumCymbalMics + mic) * KitLayout::kNumVelocities + velocity) * KitLayout::kNumRoundRobins + roundRobin;
+    }
+
+    // checks the header and that every entry is mono and lies within the file, and
+    // indexes them
+    bool readIndex()
+    {
+        const char* pData = static_cast<const char*>(map->getData());
+        const uint64 size = (uint64)map->getSize();
+        if(size < sizeof(Header))
+            return false;
+
+        const Header* pHeader = reinterpret_cast<const Header*>(pData);
+        if(pHeader->magic != (uint32)kMagic || pHeader->version != (uint32)kVersion
+           || (uint64)pHeader->numEntries > (size - sizeof(Header)) / sizeof(Entry))
+            return false;
+
+        pEntries = reinterpret_cast<const Entry*>(pData + sizeof(Header));
+        numEntries = (int)pHeader->numEntries;
+
+        for(int e = 0; e < numEntries; e++){
+            const Entry& entry = pEntries[e];
+            const uint64 bytes = (uint64)entry.numFrames * entry.numChannels * sizeof(float);
+            if(entry.articulation >= KitLayout::kNumArticulations || entry.mic >= KitLayout::kNumCymbalMics
+               || entry.velocity >= KitLayout::kNumVelocities || entry.roundRobin >= KitLayout::kNumRoundRobins
+               || entry.numChannels != 1 || entry.sampleRate == 0
+               || entry.offset % sizeof(float) != 0 || entry.offset > size || bytes > size - entry.offset)
+                return false;
+
+            index[getIndex(entry.articulation, entry.mic, entry.velocity, entry.roundRobin)] = e;
+        }
+        return true;
+    }
+
+    ScopedPointer<MemoryMappedFile> map;
+    const Entry* pEntries;
+    int numEntries;
+    int index[kIndexSize];
+
+    JUCE_DECLARE_NON_COPYABLE (KitFile)
+};
+
+//==============================================================================
+/** Packs a kit's folder of WAVs into a KitFile. Recordings are normalised as they
+    are packed, just as they are when the WAVs are loaded one by one.            */
+class KitFileWriter
+{
+public:
+    // Packs every recording KitLayout names that's in the folder, returning how many
+    // were packed (or 0 if none were, or the output couldn't be written).
+    static int write(const File& wavFolder, const File& output)
+    {
+        WavAudioFormat wav;
+        OwnedArray<Recording> recordings;
+
+        for(int a = 0; a < KitLayout::kNumArticulations; a++){
+            for(int m = 0; m < KitLayout::getNumMics(a); m++){
+                for(int v = 0; v < KitLayout::kNumVelocities; v++){
+                    for(int r = 0; r < KitLayout::kNumRoundRobins; r++){
+                        const File file (wavFolder.getChildFile(KitLayout::getFileName(a, m, v, r)));
+                        if(!file.existsAsFile())
+                            continue;
+
+                        ScopedPointer<AudioFormatReader> reader (wav.createReaderFor(new FileInputStream(file), true));
+                        if(reader == nullptr || reader->lengthInSamples <= 0){
+                            printf("KitPacker - can't read %s\n", file.getFullPathName().toRawUTF8());
+                            continue;
+                        }
+
+                        Recording* pRecording = recordings.add(new Recording());
+                        pRecording->entry.articulation = (uint8)a;
+                        pRecording->entry.mic = (uint8)m;
+                        pRecording->entry.velocity = (uint8)v;
+                        pRecording->entry.roundRobin = (uint8)r;
+                        pRecording->read(*reader);
+                    }
+                }
+            }
+        }
+
+        if(recordings.size() == 0)
+            return 0;
+
+        // the PCM starts on the first page after the index, and each recording on a
+        // page of its own
+        uint64 offset = alignToPage(sizeof(KitFile::Header) + recordings.size() * sizeof(KitFile::Entry));
+        for(int e = 0; e < recordings.size(); e++){
+            recordings[e]->entry.offset = offset;
+            offset = alignToPage(offset + recordings[e]->pcm.getSize());
+        }
+
+        TemporaryFile temp (output);
+        {
+            FileOutputStream out (temp.getFile());
+            if(out.failedToOpen())
+                return 0;
+
+            out.writeInt(KitFile::kMagic);
+            out.writeInt(KitFile::kVersion);
+            out.writeInt(recordings.size());
+            out.writeInt(0);
+
+            for(int e = 0; e < recordings.size(); e++){
+                const KitFile::Entry& entry = recordings[e]->entry;
+                out.writeByte((char)entry.articulation);
+                out.writeByte((char)entry.mic);
+                out.writeByte((char)entry.velocity);
+                out.writeByte((char)entry.roundRobin);
+                out.writeInt((int)entry.sampleRate);
+                out.writeInt((int)entry.numFrames);
+                out.writeShort((short)entry.numChannels);
+                out.writeShort(0);
+                out.writeInt64((int64)entry.offset);
+                out.writeFloat(entry.peak);
+                out.writeInt(0);
+            }
+
+            for(int e = 0; e < recordings.size(); e++){
+                out.writeRepeatedByte(0, (size_t)((int64)recordings[e]->entry.offset - out.getPosition()));
+                // (the floats are written as they are held, so this assumes a
+                // little-endian host)
+                out.write(recordings[e]->pcm.getData(), recordings[e]->pcm.getSize());
+            }
+
+            out.flush();
+            if(out.getStatus().failed())
+                return 0;
+        }
+
+        return temp.overwriteTargetFileWithTemporary() ? recordings.size() : 0;
+    }
+
+private:
+    struct Recording
+    {
+        Recording() { zerostruct(entry); }
+
+        // reads the WAV's PCM as mono (a stereo file's first two channels are mixed
+        // down), normalising it to a peak of 1
+        void read(AudioFormatReader& reader)
+        {
+            const int numFrames = (int)reader.lengthInSamples;
+            const int numChannels = jmin(2, (int)reader.numChannels);
+            AudioSampleBuffer samples (numChannels, numFrames);
+            reader.read(&samples, 0, numFrames, 0, true, numChannels > 1);
+
+            if(numChannels > 1){
+                samples.applyGain(0, 0, numFrames, 0.5f);
+                samples.addFrom(0, 0, samples, 1, 0, numFrames, 0.5f);
+            }
+            const float fPeak = samples.getMagnitude(0, 0, numFrames);
+
+            entry.sampleRate = (uint32)reader.sampleRate;
+            entry.numFrames = (uint32)numFrames;
+            entry.numChannels = 1;
+            entry.peak = fPeak;
+
+            pcm.setSize(sizeof(float) * numFrames);
+            FloatVectorOperations::copyWithMultiply(static_cast<float*>(pcm.getData()), samples.getSampleData(0),
+                                                    fPeak > 0.0f ? 1.0f / fPeak : 1.0f, numFrames);
+        }
+
+        KitFile::Entry entry;
+        MemoryBlock pcm;
+    };
+
+    static uint64 alignToPage(uint64 offset)
+    {
+        return (offset + KitFile::kPageSize - 1) & ~(uint64)(KitFile::kPageSize - 1);
+    }
+};
+
+#endif
@@ -0,0 +1,228 @@
+//
+//  MeterBridge.h
+//  TestSynthAU
+//
+//  Lock-free bus level metering (MeterLevels) and the segmented meter bridge
+//  component (MeterBridge) that displays it in the mixer.
+//
+
+#ifndef __MeterBridge_h__
+#define __MeterBridge_h__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+/** Peak and RMS levels for each mix bus, written by the audio thread and read by
+    the UI without locks. Each value holds the maximum published since the UI last
+    took it, so no peaks are missed between (slower) UI refreshes.               */
+class MeterLevels
+{
+public:
+    enum { kMaxBuses = 19 };
+
+    // audio thread: measures a block of a bus and publishes its peak and RMS
+    void process(int bus, const float* samples, int numSamples)
+    {
+        if(bus < 0 || bus >= kMaxBuses || numSamples <= 0)
+            return;
+
+        float fMin, fMax;
+        FloatVectorOperations::findMinAndMax(samples, numSamples, fMin, fMax);
+
+        float fSum = 0.0f;
+        for(int s=0; s<numSamples; s++)
+            fSum += samples[s] * samples[s];
+
+        storeMax(peaks[bus], jmax(fMax, -fMin));
+        storeMax(rms[bus], sqrtf(fSum / numSamples));
+    }
+
+    // UI thread: returns the highest peak / RMS since the last call and resets it
+    float takePeak(int bus) { return bus >= 0 && bus < kMaxBuses ? toFloat(peaks[bus].exchange(0)) : 0.0f; }
+    float takeRms(int bus)  { return bus >= 0 && bus < kMaxBuses ? toFloat(rms[bus].exchange(0)) : 0.0f; }
+
+private:
+    static float toFloat(int bits) { union { int i; float f; } u; u.i = bits; return u.f; }
+    static int toBits(float value) { union { int i; float f; } u; u.f = value; return u.i; }
+
+    // positive floats order the same as their bit patterns, so compare as ints
+    static void storeMax(Atomic<int>& store, float value)
+    {
+        const int bits = toBits(value);
+        int current = store.get();
+        while(bits > current && !store.compareAndSetBool(bits, current))
+            current = store.get();
+    }
+
+    Atomic<int> peaks[kMaxBuses];
+    Atomic<int> rms[kMaxBuses];
+};
+
+//==============================================================================
+/** A bridge of segmented meters (one per channel strip), based on dRowAudio's
+    SegmentedMeter. Segment images are rendered once per strip size; the timer
+    polls MeterLevels, applies the decay and only repaints a strip when its number
+    of lit segments (or RMS segment) changes. The bridge draws nothing between its
+    strips and ignores the mouse, so it can sit on top of the mixer controls.   */
+class MeterBridge : public Component, public Timer
+{
+public:
+    MeterBridge(MeterLevels& meterLevels)
+    :   levels(meterLevels), numRedSeg(2), numYellowSeg(4), numGreenSeg(9), decibelsPerSeg(3.0f), fDecay(0.8f)
+    {
+        setInterceptsMouseClicks(false, false);
+    }
+
+    // adds a meter at the given area, showing the loudest of numBuses from firstBus
+    void addStrip(const Rectangle<int>& area, int firstBus, int numBuses = 1)
+    {
+        Strip* pStrip = strips.add(new Strip());
+        pStrip->area = area;
+        pStrip->firstBus = firstBus;
+        pStrip->numBuses = numBuses;
+        renderImages(*pStrip);
+    }
+
+    void setStripBounds(int strip, const Rectangle<int>& area)
+    {
+        if(strip >= 0 && strip < strips.size() && strips[strip]->area != area){
+            repaint(strips[strip]->area);
+            strips[strip]->area = area;
+            renderImages(*strips[strip]);
+            repaint(area);
+        }
+    }
+
+    void start(int framesPerSecond = 30)
+    {
+        startTimer(1000 / jlimit(1, 60, framesPerSecond));
+    }
+
+    void timerCallback()
+    {
+        for(int i=0; i<strips.size(); i++){
+            Strip& strip = *strips.getUnchecked(i);
+
+            float fPeak = 0.0f, fRms = 0.0f;
+            for(int b=strip.firstBus; b<strip.firstBus + strip.numBuses; b++){
+                fPeak = jmax(fPeak, levels.takePeak(b));
+                fRms = jmax(fRms, levels.takeRms(b));
+            }
+
+            // instant attack, exponential decay
+            strip.fLevel = jmax(fPeak, strip.fLevel * fDecay);
+            strip.fRms = jmax(fRms, strip.fRms * fDecay);
+
+            const int litSegs = toSegments(strip.fLevel);
+            const int rmsSeg = toSegments(strip.fRms);
+            if(litSegs != strip.litSegs || rmsSeg != strip.rmsSeg){
+                strip.litSegs = litSegs;
+                strip.rmsSeg = rmsSeg;
+                repaint(strip.area);
+            }
+        }
+    }
+
+    void paint(Graphics& g)
+    {
+        const int totalNumSegs = getTotalNumSegments();
+
+        for(int i=0; i<strips.size(); i++){
+            const Strip& strip = *strips.getUnchecked(i);
+            if(!g.clipRegionIntersects(strip.area) || !strip.onImage.isValid())
+                continue;
+
+            const int x = strip.area.getX(), y = strip.area.getY();
+            const int w = strip.area.getWidth(), h = strip.area.getHeight();
+            const int offHeight = h - roundToInt((strip.litSegs / (float)totalNumSegs) * h);
+
+            g.drawImage(strip.offImage, x, y, w, offHeight, 0, 0, w, offHeight, false);
+            g.drawImage(strip.onImage, x, y + offHeight, w, h - offHeight, 0, offHeight, w, h - offHeight, false);
+
+            if(strip.rmsSeg > 0){
+                const int rmsY = y + h - roundToInt((strip.rmsSeg / (float)totalNumSegs) * h);
+                g.setColour(Colours::white);
+                g.drawHorizontalLine(rmsY, (float)x + 2, (float)(x + w - 2));
+            }
+        }
+    }
+
+    int getTotalNumSegments() const { return numRedSeg + numYellowSeg + numGreenSeg; }
+
+private:
+    struct Strip
+    {
+        Strip() : firstBus(0), numBuses(1), fLevel(0.0f), fRms(0.0f), litSegs(0), rmsSeg(0) {}
+
+        Rectangle<int> area;
+        int firstBus, numBuses;
+        float fLevel, fRms;
+        int litSegs, rmsSeg;
+        Image onImage, offImage;
+    };
+
+    int toSegments(float level) const
+    {
+        if(level <= 0.0f)
+            return 0;
+        const float fDecibels = (float) Decibels::gainToDecibels(level, -100.0f);
+        return jlimit(0, getTotalNumSegments(), roundToInt((fDecibels / decibelsPerSeg) + (getTotalNumSegments() - numRedSeg)));
+    }
+
+    // pre-renders the lit and unlit segment images (as SegmentedMeter::resized)
+    void renderImages(Strip& strip)
+    {
+        const int m = 2;
+        const int w = strip.area.getWidth();
+        const int h = strip.area.getHeight();
+        if(w <= 0 || h <= 0)
+            return;
+
+        strip.onImage = Image(Image::RGB, w, h, false);
+        strip.offImage = Image(Image::RGB, w, h, false);
+
+        Graphics gOn(strip.onImage);
+        Graphics gOff(strip.offImage);
+
+        const int numSegments = getTotalNumSegments();
+        const float segmentHeight = (h - m) / (float) numSegments;
+        const float segWidth = w - (2.0f * m);
+
+        for(int i=1; i<=numSegments; ++i){
+            if(i <= numGreenSeg){
+                gOn.setColour(Colours::green.brighter(0.8f));
+                gOff.setColour(Colours::green.darker());
+            }else if(i <= (numYellowSeg + numGreenSeg)){
+                gOn.setColour(Colours::orange.brighter());
+                gOff.setColour(Colours::orange.darker());
+            }else{
+                gOn.setColour(Colours::red.brighter());
+                gOff.setColour(Colours::red.darker());
+            }
+
+            gOn.fillRect((float) m, h - m - (i * segmentHeight), segWidth, segmentHeight);
+            gOn.setColour(Colours::black);
+            gOn.drawLine((float) m, h - m - (i * segmentHeight), (float) w - m, h - m - (i * segmentHeight), (float) m);
+
+            gOff.fillRect((float) m, h - m - (i * segmentHeight), segWidth, segmentHeight);
+            gOff.setColour(Colours::black);
+            gOff.drawLine((float) m, h - m - (i * segmentHeight), (float) w - m, h - m - (i * segmentHeight), (float) m);
+        }
+
+        gOn.setColour(Colours::black);
+        gOn.drawRect(0, 0, w, h, m);
+        gOff.setColour(Colours::black);
+        gOff.drawRect(0, 0, w, h, m);
+    }
+
+    MeterLevels& levels;
+    OwnedArray<Strip> strips;
+
+    int numRedSeg, numYellowSeg, numGreenSeg;
+    float decibelsPerSeg;
+    float fDecay;
+
+    JUCE_DECLARE_NON_COPYABLE (MeterBridge)
+};
+
+#endif
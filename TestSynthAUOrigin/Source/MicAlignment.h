@@ -0,0 +1,124 @@
+//
+//  MicAlignment.h
+//  TestSynthAU
+//
+//  Measures how much later one mic's recording of a hit arrives than another's, from
+//  the peak of their cross-correlation (computed with dRowAudio's FFTOperation). Used
+//  when a kit loads, to line each hit's distant mics up with its close mic.
+//
+
+#ifndef __MicAlignment_h__
+#define __MicAlignment_h__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+class MicAligner
+{
+public:
+    // the start of each recording that's compared (the onset and the first of its
+    // ring - later, the distant mics are mostly room reflections)
+    enum { kWindowSize = 8192, kFFTSizeLog2 = 14 };
+
+    MicAligner()
+    :   fft(kFFTSizeLog2), N(1 << kFFTSizeLog2), fReferenceEnergy(0.0f), fGain(1.0f)
+    {
+        reference.calloc((size_t)N);
+        spectrum.calloc((size_t)N);
+        buffer.calloc((size_t)N);
+        fGain = measureGain();
+    }
+
+    // sets the recording the others are measured against (e.g. the close mic)
+    void setReference(const float* samples, int numSamples)
+    {
+        fReferenceEnergy = transform(samples, numSamples);
+        FloatVectorOperations::copy(reference, fft.getFFTBuffer().realp, N);
+    }
+
+    // Returns how many samples later the recording's content arrives than the
+    // reference's, within +/-maxLag (negative if it arrives earlier). Returns 0 when
+    // the two are too unalike (a normalised correlation below fMinCorrelation) for
+    // the peak to mean anything.
+    int findDelay(const float* samples, int numSamples, int maxLag, float fMinCorrelation = 0.2f)
+    {
+        const float fEnergy = transform(samples, numSamples);
+        if(fEnergy <= 0.0f || fReferenceEnergy <= 0.0f)
+            return 0;
+
+        // conj(reference) x recording, which reads the same in both platforms' packing
+        multiplyConjugate(spectrum, reference, fft.getFFTBuffer().realp);
+        FloatVectorOperations::copy(fft.getFFTBuffer().realp, spectrum, N);
+        fft.performIFFT(buffer);
+
+        // lag k is at buffer[k], and negative lags wrap round to the end
+        maxLag = jlimit(0, (int)kWindowSize - 1, maxLag);
+        int best = 0;
+        float fBest = buffer[0];
+        for(int k=1; k<=maxLag; k++){
+            if(buffer[k] > fBest){ fBest = buffer[k]; best = k; }
+            if(buffer[N - k] > fBest){ fBest = buffer[N - k]; best = -k; }
+        }
+
+        const float fCorrelation = fBest / (fGain * sqrtf(fEnergy * fReferenceEnergy));
+        return fCorrelation >= fMinCorrelation ? best : 0;
+    }
+
+private:
+    // zero-pads the start of a recording (to twice the window, so the correlation
+    // doesn't wrap) and transforms it, returning its energy
+    float transform(const float* samples, int numSamples)
+    {
+        const int n = jlimit(0, (int)kWindowSize, numSamples);
+        FloatVectorOperations::clear(buffer, N);
+        if(samples != NULL && n > 0)
+            FloatVectorOperations::copy(buffer, samples, n);
+
+        float fEnergy = 0.0f;
+        for(int s=0; s<n; s++)
+            fEnergy += buffer[s] * buffer[s];
+
+        fft.performFFT(buffer);
+        return fEnergy;
+    }
+
+    // Spectra are packed as N/2 real parts then N/2 imaginary parts, with the DC
+    // and Nyquist bins (both purely real) sharing the first real/imaginary slots.
+    void multiplyConjugate(float* out, const float* a, const float* b) const
+    {
+        const int half = N / 2;
+        out[0] = a[0] * b[0];
+        out[half] = a[half] * b[half];
+
+        for(int i=1; i<half; i++){
+            const float aRe = a[i], aIm = a[half + i], bRe = b[i], bIm = b[half + i];
+            out[i] = aRe * bRe + aIm * bIm;
+            out[half + i] = aRe * bIm - aIm * bRe;
+        }
+    }
+
+    // The platform FFTs scale differently, so the round-trip gain is measured by
+    // correlating a unit impulse with itself.
+    float measureGain()
+    {
+        const float fImpulse = 1.0f;
+        setReference(&fImpulse, 1);
+        transform(&fImpulse, 1);
+        multiplyConjugate(spectrum, reference, fft.getFFTBuffer().realp);
+        FloatVectorOperations::copy(fft.getFFTBuffer().realp, spectrum, N);
+        fft.performIFFT(buffer);
+
+        const float fMeasured = buffer[0];
+        fReferenceEnergy = 0.0f;
+        return fMeasured != 0.0f ? fMeasured : 1.0f;
+    }
+
+    drow::FFTOperation fft;
+    const int N;
+    HeapBlock<float> reference, spectrum, buffer;
+    float fReferenceEnergy;
+    float fGain;
+
+    JUCE_DECLARE_NON_COPYABLE (MicAligner)
+};
+
+#endif
@@ -0,0 +1,183 @@
+//
+//  NoteInjector.h
+//  TestSynthAU
+//
+//  Notes played from the editor reach the audio thread through a wait-free FIFO,
+//  rather than through MidiKeyboardState::processNextMidiBuffer(), which takes the
+//  lock the message thread holds while the on-screen keyboard is being clicked.
+//  Each note is stamped with the time it was played, and the audio thread places it
+//  in the next block as far from the block's end as it was played from the last
+//  callback - so the UI's notes keep their spacing, at a steady latency of a block,
+//  rather than all landing on the block's first sample.
+//
+//  The other way round, the host's notes are queued for the message thread to show
+//  on the keyboard (see updateKeyboard()).
+//
+
+#ifndef __NoteInjector_h__
+#define __NoteInjector_h__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+class NoteInjector : public MidiKeyboardStateListener
+{
+public:
+    enum { kCapacity = 256, kMaxEventsPerBlock = 4096 };
+
+    NoteInjector()
+    :   uiFifo(kCapacity), hostFifo(kCapacity), fSamplesPerMs(44.1), bApplyingHostNotes(false)
+    {
+    }
+
+    //==============================================================================
+    // UI (one thread at a time - the message thread): queues a note-on (velocity 0-1,
+    // 0 for a note-off) for the next block, played at the given time (on the
+    // Time::getMillisecondCounterHiRes() clock). Returns false, dropping the note,
+    // if the audio thread has fallen a whole queue behind.
+    bool play (int channel, int note, float velocity, double time = Time::getMillisecondCounterHiRes())
+    {
+        if(!isPositiveAndBelow(note, 128))
+            return false;
+
+        int start1, size1, start2, size2;
+        uiFifo.prepareToWrite(1, start1, size1, start2, size2);
+        if(size1 == 0)
+            return false;
+
+        Note& slot = uiNotes[start1];
+        slot.fTime = time;
+        slot.status = (uint8) ((velocity > 0.0f ? 0x90 : 0x80) | ((jlimit(1, 16, channel) - 1) & 0xf));
+        slot.note = (uint8) note;
+        slot.velocity = (uint8) (velocity > 0.0f ? jlimit(1, 127, roundToInt(velocity * 127.0f)) : 0);
+        uiFifo.finishedWrite(1);
+        return true;
+    }
+
+    // MidiKeyboardStateListener - the on-screen keyboard's keys
+    void handleNoteOn (MidiKeyboardState*, int channel, int note, float velocity)
+    {
+        if(!bApplyingHostNotes)
+            play(channel, note, jmax(velocity, 1.0f / 127.0f));
+    }
+
+    void handleNoteOff (MidiKeyboardState*, int channel, int note)
+    {
+        if(!bApplyingHostNotes)
+            play(channel, note, 0.0f);
+    }
+
+    // message thread: shows the host's latest notes on the keyboard state (if the
+    // queue overflowed while nothing was draining it, every key is let go)
+    void updateKeyboard (MidiKeyboardState& state)
+    {
+        bApplyingHostNotes = true;
+
+        int start1, size1, start2, size2;
+        hostFifo.prepareToRead(hostFifo.getNumReady(), start1, size1, start2, size2);
+        applyHostNotes(state, start1, size1);
+        applyHostNotes(state, start2, size2);
+        hostFifo.finishedRead(size1 + size2);
+
+        if(bHostOverflow.exchange(0) != 0)
+            state.reset();
+
+        bApplyingHostNotes = false;
+    }
+
+    //==============================================================================
+    // audio thread (before playing): the rate notes are placed at
+    void prepare (double sampleRate)
+    {
+        fSamplesPerMs = sampleRate / 1000.0;
+        merged.ensureSize(kMaxEventsPerBlock);
+    }
+
+    // Audio thread: the block's events - the host's alone, or (when the UI has played
+    // anything since the last block) merged with the UI's, in a buffer of its own.
+    MidiBuffer& addToBlock (MidiBuffer& hostEvents, int numSamples)
+    {
+        queueHostNotes(hostEvents);
+
+        int start1, size1, start2, size2;
+        uiFifo.prepareToRead(uiFifo.getNumReady(), start1, size1, start2, size2);
+        if(size1 + size2 == 0)
+            return hostEvents;
+
+        // the last callback was a block ago, so a note played t ms ago goes t ms
+        // before the end of this one
+        const double now = Time::getMillisecondCounterHiRes();
+        merged.clear();
+        merged.addEvents(hostEvents, 0, numSamples, 0);
+        addNotes(start1, size1, now, numSamples);
+        addNotes(start2, size2, now, numSamples);
+        uiFifo.finishedRead(size1 + size2);
+        return merged;
+    }
+
+private:
+    struct Note
+    {
+        double fTime;
+        uint8 status, note, velocity;
+    };
+
+    void addNotes (int start, int size, double now, int numSamples)
+    {
+        for(int i = start; i < start + size; i++){
+            const Note& n = uiNotes[i];
+            const int ago = (int) ((now - n.fTime) * fSamplesPerMs);
+            const uint8 bytes[3] = { n.status, n.note, n.velocity };
+            merged.addEvent(bytes, 3, jlimit(0, numSamples - 1, numSamples - 1 - ago));
+        }
+    }
+
+    void queueHostNotes (const MidiBuffer& events)
+    {
+        MidiBuffer::Iterator iterator (events);
+        const uint8* data;
+        int numBytes, position;
+        while(iterator.getNextEvent(data, numBytes, position)){
+            const uint8 type = (uint8) (data[0] & 0xf0);
+            if(numBytes < 3 || (type != 0x80 && type != 0x90))
+                continue;
+
+            int start1, size1, start2, size2;
+            hostFifo.prepareToWrite(1, start1, size1, start2, size2);
+            if(size1 == 0){
+                bHostOverflow = 1;
+                return;
+            }
+            Note& slot = hostNotes[start1];
+            slot.fTime = 0.0;
+            slot.status = data[0];
+            slot.note = data[1];
+            slot.velocity = data[2];
+            hostFifo.finishedWrite(1);
+        }
+    }
+
+    void applyHostNotes (MidiKeyboardState& state, int start, int size)
+    {
+        for(int i = start; i < start + size; i++){
+            const Note& n = hostNotes[i];
+            const int channel = (n.status & 0xf) + 1;
+            if((n.status & 0xf0) == 0x90 && n.velocity > 0)
+                state.noteOn(channel, n.note & 127, n.velocity / 127.0f);
+            else
+                state.noteOff(channel, n.note & 127);
+        }
+    }
+
+    AbstractFifo uiFifo, hostFifo;
+    Note uiNotes[kCapacity];
+    Note hostNotes[kCapacity];
+    Atomic<int> bHostOverflow;
+
+    MidiBuffer merged;
+    double fSamplesPerMs;
+    bool bApplyingHostNotes;    // (message thread)
+
+    JUCE_DECLARE_NON_COPYABLE (NoteInjector)
+};
+
+#endif
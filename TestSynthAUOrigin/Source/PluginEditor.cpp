@@ -1,12 +1,13 @@
 #include "PluginProcessor.h"
+#include "ChannelStrip.h"  // (ahead of the editor's dRowAudio namespace)
 #include "PluginEditor.h"
 
 //==============================================================================
 PluginAudioProcessorEditor::PluginAudioProcessorEditor (PluginAudioProcessor* ownerFilter)
 : AudioProcessorEditor (ownerFilter),
 midiKeyboard (ownerFilter->keyboardState, MidiKeyboardComponent::horizontalKeyboard),
-scope_mode(SCOPE_VISIBLE|SCOPE_SONOGRAM), oscilloscope(NULL), spectrum(NULL), sonogram(NULL), scopeThread("Scope Thread"),
-tabScope(TabbedButtonBar::TabsAtTop), infoLabel (String::empty)
+currentTab(-1), previousTab(-1), scope_mode(SCOPE_VISIBLE|SCOPE_SONOGRAM), oscilloscope(NULL), spectrum(NULL), sonogram(NULL), scopeThread("Scope Thread"),
+tabScope(TabbedButtonBar::TabsAtTop), infoLabel (String::empty), meterBridge(ownerFilter->synth->meterLevels), stepClock(*this), nextStep(-1), lastChangeCount(0)
 {
     // add controls..
     for(int c=0; c<kNumberOfControls; c++){
@@ -31,22 +32,14 @@ tabScope(TabbedButtonBar::TabsAtTop), infoLabel (String::empty)
                 label[c].setJustificationType(Justification::centredBottom);
             } break;
             case SLIDERBAR:
-            {   controls[c] = new Slider();
-                Slider* pSlider = (Slider*)controls[c];
-                
-                //                addAndMakeVisible (pSlider);
-                tabScope.addAndMakeVisible(pSlider);
-                pSlider->setSliderStyle (UI_CONTROLS[c].type == ROTARY ? Slider::Rotary : Slider::LinearBarVertical);
-                pSlider->setTextBoxStyle (Slider::TextBoxBelow, false, 50, 20);
-                pSlider->addListener (this);
-                pSlider->setRange (UI_CONTROLS[c].min, UI_CONTROLS[c].max, 0.001);
-                pSlider->setTextBoxIsEditable(false);
-                pSlider->setEnabled(false);
-                // add a label
-                label[c].setText(UI_CONTROLS[c].name, dontSendNotification);
-                label[c].attachToComponent(controls[c], false);
-                label[c].setFont (Font (11.0f));
-                label[c].setJustificationType(Justification::centred);
+            {   // meters are drawn by the meter bridge rather than individual sliders
+                // (the overheads strip shows the loudest of the cymbal mic buses)
+                controls[c] = NULL;
+                const int strip = UI_CONTROLS[c].parameter - kParam8;
+                if(strip < 7)
+                    meterBridge.addStrip(UI_CONTROLS[c].size, strip);
+                else
+                    meterBridge.addStrip(UI_CONTROLS[c].size, 7, 9);
             } break;
                 
             case TOGGLE:
@@ -79,21 +72,42 @@ tabScope(TabbedButtonBar::TabsAtTop), infoLabel (String::empty)
         }
         
     }
-    /*
-     
-     // add an oscilloscope..
-     oscilloscope = new AudioOscilloscope();
-     oscilloscope->setHorizontalZoom(0.001);
-     oscilloscope->setTraceColour(Colours::white);
-     
-     spectrum = new Spectroscope(10);
-     spectrum->setLogFrequencyDisplay(true);
-     
-     sonogram = new Sonogram(10);
-     sonogram->setLogFrequencyDisplay(true);
-     */
+    // add the analysis scopes: the master's waveform and spectrum, and a sonogram of
+    // a chosen bus (fed through the synth's analysis tap, never by the audio thread)
+    oscilloscope = new AudioOscilloscope();
+    oscilloscope->setHorizontalZoom(0.001);
+    oscilloscope->setTraceColour(Colours::white);
+    
+    spectrum = new Spectroscope(11);
+    spectrum->setLogFrequencyDisplay(true);
+    
+    sonogram = new Sonogram(10);
+    sonogram->setLogFrequencyDisplay(true);
+    
+    for(int i = 0; i < ownerFilter->getNumBuses(); i++)
+        analysisBus.addItem(ownerFilter->getBusName(i), i + 1);
+    analysisBus.setSelectedId(ownerFilter->synth->analysis.getBus() + 1, dontSendNotification);
+    analysisBus.addListener(this);
+    
+    analysisFeed = new AnalysisFeed(ownerFilter->synth->analysis, oscilloscope, spectrum, sonogram);
+    scopeThread.addTimeSliceClient(spectrum);
+    scopeThread.addTimeSliceClient(sonogram);
+    scopeThread.addTimeSliceClient(analysisFeed);
+    scopeThread.startThread(3);
+    
+    // the channel page, for a synth with mix processing to set (see ChannelStrip.h)
+    if(MySynth* pSynth = dynamic_cast<MySynth*>(ownerFilter->synth)){
+        channelStrip = new ChannelStrip(*pSynth);
+        channelView.setViewedComponent(channelStrip, false);
+        channelView.setScrollBarsShown(true, false);
+    }
 
+    // the step grid: a row of 16ths for each drum
+    static const char* const rowNames[6] = { "Kick", "Snare", "High Tom", "Mid Tom", "Floor Tom", "Hats" };
+    static const int rowNotes[6] = { 48, 50, 57, 55, 53, 54 };
     for(int a = 0; a < 6; a++){
+        stepSequencer[a].note = rowNotes[a];
+        stepSequencer[a].held = false;
         for (int b = 0; b < 16; b++){
             stepSequencer[a].stepButtons[b] = new TextButton;
             TextButton* pButton = (TextButton*)stepSequencer[a].stepButtons[b];
@@ -101,18 +115,25 @@ tabScope(TabbedButtonBar::TabsAtTop), infoLabel (String::empty)
             pButton->addListener(this);
             pButton->setClickingTogglesState(TOGGLE);
             pButton->setBounds(100 + 30 * (b + 1), 30 * (a + 1), 25, 25);
-            sequenceLabel[a].setBounds(20, 30 * (b + 1), 25, 25);
-            addAndMakeVisible(&sequenceLabel[a]);
-            sequenceLabel[a].setFont (Font (11.0f));
-            sequenceLabel[a].setText(String(a), dontSendNotification);
         }
+        sequenceLabel[a].setBounds(20, 30 * (a + 1), 100, 25);
+        addAndMakeVisible(&sequenceLabel[a]);
+        sequenceLabel[a].setFont (Font (11.0f));
+        sequenceLabel[a].setText(rowNames[a], dontSendNotification);
     }
+    stepClock.startTimer(2);
 
     
+    tabScope.addAndMakeVisible(&meterBridge);
+    meterBridge.start(30);
+    
     addAndMakeVisible(&tabScope);
     tabScope.addTab("Mixer", Colours::grey, 0, false, 0);
     
     tabScope.addTab("Sequencer", Colours::grey, 0, false, 1);
+    tabScope.addTab("Analysis", Colours::grey, 0, false, 2);
+    if(channelStrip != nullptr)
+        tabScope.addTab("Channel", Colours::grey, 0, false, 3);
     tabScope.setTabBarDepth(24);
     tabScope.setIndent(4);
     
@@ -127,6 +148,11 @@ tabScope(TabbedButtonBar::TabsAtTop), infoLabel (String::empty)
     setSize (  ownerFilter->lastUIWidth,
              ownerFilter->lastUIHeight);
     
+    // bring every control up to date once, after which only changed ones are touched
+    lastChangeCount = ownerFilter->getParameterChangeCount();
+    for(int c=0; c<kNumberOfControls; c++)
+        refreshControl(c);
+    
     startTimer (50);
     
     midiKeyboard.grabKeyboardFocus();
@@ -135,11 +161,19 @@ tabScope(TabbedButtonBar::TabsAtTop), infoLabel (String::empty)
 PluginAudioProcessorEditor::~PluginAudioProcessorEditor()
 {
     scope_mode = SCOPE_HIDDEN;
+    getProcessor()->synth->analysis.setEnabled(false);
     
     removeChildComponent(&tabScope);
+    channelView.setViewedComponent(nullptr, false);
     
+    scopeThread.removeTimeSliceClient(analysisFeed);
+    scopeThread.removeTimeSliceClient(spectrum);
+    scopeThread.removeTimeSliceClient(sonogram);
     scopeThread.stopThread(1000);
+    analysisFeed = nullptr;
     stopTimer();
+    stepClock.stopTimer();
+    releaseSteps(Time::getMillisecondCounterHiRes());
     
     for(int c=0; c<kNumberOfControls; c++){
         delete controls[c];
@@ -197,12 +231,26 @@ void PluginAudioProcessorEditor::resized()
             size = UI_CONTROLS[c].size;
         }
         
+        if(!controls[c])
+            continue;
+        
         controls[c]->setBounds (size.getX(), size.getY(), size.getWidth(), size.getHeight());
         label[c].setTopLeftPosition(size.getX() - 20, size.getY() - 20);
         label[c].setSize(size.getWidth() + 40, 20);
     }
     
     tabScope.setBounds(0, 0, getWidth(), getHeight() - keyboardHeight);
+    meterBridge.setBounds(tabScope.getLocalBounds());
+    
+    // the analysis tab: scope and spectrum side by side, the bus sonogram below
+    const Rectangle<int> area = Rectangle<int>(0, tabScope.getTabBarDepth(), tabScope.getWidth(), tabScope.getHeight() - tabScope.getTabBarDepth()).reduced(8);
+    const int scopeHeight = (area.getHeight() - 32) / 2;
+    oscilloscope->setBounds(area.getX(), area.getY(), area.getWidth() / 2 - 4, scopeHeight);
+    spectrum->setBounds(area.getCentreX() + 4, area.getY(), area.getWidth() / 2 - 4, scopeHeight);
+    analysisBus.setBounds(area.getX(), area.getY() + scopeHeight + 4, 140, 24);
+    sonogram->setBounds(area.getX(), area.getY() + scopeHeight + 32, area.getWidth(), area.getBottom() - (area.getY() + scopeHeight + 32));
+    
+    channelView.setBounds(0, tabScope.getTabBarDepth(), tabScope.getWidth(), tabScope.getHeight() - tabScope.getTabBarDepth());
     
     midiKeyboard.setBounds (4, getHeight() - keyboardHeight - 4, getWidth() - 8, keyboardHeight);
     
@@ -223,14 +271,19 @@ void PluginAudioProcessorEditor::timerCallback()
         if (previousTab != currentTab){
             printf("Mixer");
             for (int i = 0; i < kNumberOfControls; i++){
+                if(!controls[i])
+                    continue;
                 tabScope.addAndMakeVisible(controls[i]);
                 tabScope.addAndMakeVisible(&label[i]);
             }
+            tabScope.addAndMakeVisible(&meterBridge);
             for(int a = 0; a < 6; a++){
                 for (int b = 0; b < 16; b++){
                     tabScope.removeChildComponent(stepSequencer[a].stepButtons[b]);
                 }
             }
+            showAnalysis(false);
+            showChannel(false);
             previousTab = 0;
         }
       
@@ -240,52 +293,195 @@ void PluginAudioProcessorEditor::timerCallback()
         if (previousTab != currentTab){
             printf("Sequencer");
             for (int i = 0; i < kNumberOfControls; i++){
+                if(!controls[i])
+                    continue;
                 tabScope.removeChildComponent(controls[i]);
                 tabScope.removeChildComponent(&label[i]);
             }
+            tabScope.removeChildComponent(&meterBridge);
             for(int a = 0; a < 6; a++){
                 for (int b = 0; b < 16; b++){
                     tabScope.addAndMakeVisible(stepSequencer[a].stepButtons[b]);
                     
                 }
             }
+            showAnalysis(false);
+            showChannel(false);
             previousTab = 1;
         }
        
     }
-    //loop that counts 16 and resets to 0
-    //check each button
-    //play samples
-    //
+    else if (tabScope.getCurrentTabIndex() == 2){
+        currentTab = 2;
+        if (previousTab != currentTab){
+            for (int i = 0; i < kNumberOfControls; i++){
+                if(!controls[i])
+                    continue;
+                tabScope.removeChildComponent(controls[i]);
+                tabScope.removeChildComponent(&label[i]);
+            }
+            tabScope.removeChildComponent(&meterBridge);
+            for(int a = 0; a < 6; a++){
+                for (int b = 0; b < 16; b++){
+                    tabScope.removeChildComponent(stepSequencer[a].stepButtons[b]);
+                }
+            }
+            showAnalysis(true);
+            showChannel(false);
+            previousTab = 2;
+        }
+    }
+    else if (tabScope.getCurrentTabIndex() == 3){
+        currentTab = 3;
+        if (previousTab != currentTab){
+            for (int i = 0; i < kNumberOfControls; i++){
+                if(!controls[i])
+                    continue;
+                tabScope.removeChildComponent(controls[i]);
+                tabScope.removeChildComponent(&label[i]);
+            }
+            tabScope.removeChildComponent(&meterBridge);
+            for(int a = 0; a < 6; a++){
+                for (int b = 0; b < 16; b++){
+                    tabScope.removeChildComponent(stepSequencer[a].stepButtons[b]);
+                }
+            }
+            showAnalysis(false);
+            showChannel(true);
+            previousTab = 3;
+        }
+    }
     PluginAudioProcessor* ourProcessor = getProcessor();
     
     AudioPlayHead::CurrentPositionInfo newPos (ourProcessor->lastPosInfo);
     
+    // light the keys the host is playing
+    ourProcessor->updateKeyboardState();
+    
+    // tell the host if the bus processing's delay has changed
+    ourProcessor->updateLatency();
+    
     if (lastDisplayedPosition != newPos)
         displayPositionInfo (newPos);
     
-    for(int c=0; c<kNumberOfControls && controls[c]; c++){
-        switch (UI_CONTROLS[c].type){
-            case ROTARY:
-            case SLIDER:
-                ((Slider*)controls[c])->setValue (ourProcessor->getParameter(c), dontSendNotification);
-                break;
-            case SLIDERBAR://EDIT GEORGEDEMNER 4/12/15
-                ((Slider*)controls[c])->setValue (ourProcessor->getParameter(c), dontSendNotification);
-                break;
-                
-            case MENU:
-                ((ComboBox*)controls[c])->setSelectedId(ourProcessor->getParameter(c)+1, dontSendNotification);
-                break;
-            case BUTTON:
-                break;
-            case TOGGLE:
-                ((TextButton*)controls[c])->setToggleState(ourProcessor->getParameter(c) != 0.0, sendNotification);
-                break;
+    // only touch the controls whose parameters have changed since the last tick
+    const int changeCount = ourProcessor->getParameterChangeCount();
+    if (changeCount != lastChangeCount)
+    {
+        lastChangeCount = changeCount;
+        
+        for(int word=0; word * 32 < kNumberOfControls; word++){
+            uint32 changed = ourProcessor->takeChangedParameters(word);
+            for(int bit=0; changed != 0; bit++, changed >>= 1){
+                if(changed & 1)
+                    refreshControl(word * 32 + bit);
+            }
+        }
+    }
+}
+
+// Plays the grid's steps that have come due since the last call, while the host is
+// playing: 16ths, looping every 16. Each is played through playNote() stamped with
+// the time it came due, worked out from where the host's timeline was at the last
+// block, so it lands a block later with the steps' spacing kept (as long as the
+// clock gets to it before the next block, which its couple of milliseconds allow).
+void PluginAudioProcessorEditor::playSteps()
+{
+    PluginAudioProcessor* ourProcessor = getProcessor();
+    const AudioPlayHead::CurrentPositionInfo pos (ourProcessor->lastPosInfo);
+    const double posTime = ourProcessor->lastPosTime;
+    
+    if(!pos.isPlaying || pos.bpm <= 0.0){
+        if(nextStep >= 0)
+            releaseSteps(Time::getMillisecondCounterHiRes());
+        nextStep = -1;
+        return;
+    }
+    
+    const double msPerStep = 15000.0 / pos.bpm;
+    const double stepNow = pos.ppqPosition * 4.0 + (Time::getMillisecondCounterHiRes() - posTime) / msPerStep;
+    const int64 lastDue = (int64) std::floor(stepNow);
+    
+    // starting, or the host has jumped: pick up from the nearest step (one that's
+    // only just gone is played late rather than missed)
+    if(nextStep < 0 || nextStep > lastDue + 1 || lastDue - nextStep >= 16)
+        nextStep = (int64) std::floor(stepNow + 0.5);
+    
+    for(; nextStep <= lastDue; nextStep++){
+        const double due = posTime + (nextStep - pos.ppqPosition * 4.0) * msPerStep;
+        const int b = (int) (((nextStep % 16) + 16) % 16);
+        
+        releaseSteps(due);
+        for(int a = 0; a < 6; a++){
+            if(stepSequencer[a].stepButtons[b]->getToggleState())
+                stepSequencer[a].held = ourProcessor->playNote(stepSequencer[a].note, 100 / 127.0f, due);
         }
     }
 }
 
+// Lets go of the notes the grid is holding, at the given time
+void PluginAudioProcessorEditor::releaseSteps (double time)
+{
+    for(int a = 0; a < 6; a++){
+        if(stepSequencer[a].held)
+            getProcessor()->playNote(stepSequencer[a].note, 0.0f, time);
+        stepSequencer[a].held = false;
+    }
+}
+
+// Shows or hides the analysis scopes, only tapping the synth's audio while they're up
+void PluginAudioProcessorEditor::showAnalysis (bool shouldShow)
+{
+    Component* scopes[] = { oscilloscope, spectrum, sonogram, &analysisBus };
+    for(int i = 0; i < 4; i++){
+        if(shouldShow)
+            tabScope.addAndMakeVisible(scopes[i]);
+        else
+            tabScope.removeChildComponent(scopes[i]);
+    }
+    spectrum->pause(!shouldShow);
+    sonogram->pause(!shouldShow);
+    
+    getProcessor()->synth->analysis.setEnabled(shouldShow);
+}
+
+// Shows or hides the channel page
+void PluginAudioProcessorEditor::showChannel (bool shouldShow)
+{
+    if(shouldShow && channelStrip != nullptr)
+        tabScope.addAndMakeVisible(&channelView);
+    else
+        tabScope.removeChildComponent(&channelView);
+}
+
+// Updates a single control to show the current value of its parameter.
+void PluginAudioProcessorEditor::refreshControl (int c)
+{
+    if(c < 0 || c >= kNumberOfControls || !controls[c])
+        return;
+    
+    PluginAudioProcessor* ourProcessor = getProcessor();
+    
+    switch (UI_CONTROLS[c].type){
+        case ROTARY:
+        case SLIDER:
+            ((Slider*)controls[c])->setValue (ourProcessor->getParameter(c), dontSendNotification);
+            break;
+        case SLIDERBAR://EDIT GEORGEDEMNER 4/12/15
+            ((Slider*)controls[c])->setValue (ourProcessor->getParameter(c), dontSendNotification);
+            break;
+            
+        case MENU:
+            ((ComboBox*)controls[c])->setSelectedId(ourProcessor->getParameter(c)+1, dontSendNotification);
+            break;
+        case BUTTON:
+            break;
+        case TOGGLE:
+            ((TextButton*)controls[c])->setToggleState(ourProcessor->getParameter(c) != 0.0, dontSendNotification);
+            break;
+    }
+}
+
 // This is our Slider::Listener callback, when the user drags a slider.
 void PluginAudioProcessorEditor::sliderValueChanged (Slider* slider)
 {
@@ -305,6 +501,9 @@ void PluginAudioProcessorEditor::sliderValueChanged (Slider* slider)
 
 void PluginAudioProcessorEditor::comboBoxChanged (ComboBox* comboBox)
 {
+    if (comboBox == &analysisBus)
+        getProcessor()->synth->analysis.setBus(analysisBus.getSelectedId() - 1);
+    
     for(int c=0; c<kNumberOfControls; c++){
         if (comboBox == controls[c])
         {
@@ -15,9 +15,12 @@ enum UI_MODE
     SCOPE_SEQUENCER = 4,
     SCOPE_SONOGRAM = 8
 };
+class ChannelStrip;
+
 struct drumSequencer{
     Button* stepButtons[16];
-    
+    int note;       // the drum the row plays
+    bool held;      // (its note-off goes out on the next step)
 };
 //==============================================================================
 /** This is the editor component that our filter will display.
@@ -66,6 +69,7 @@ private:
     
     Label label[kNumberOfControls];
     Component* controls[kNumberOfControls];
+    MeterBridge meterBridge;
     Component* mixer;
     ScopedPointer<ResizableCornerComponent> resizer;
     ComponentBoundsConstrainer resizeLimits;
@@ -77,7 +81,36 @@ private:
         return static_cast <PluginAudioProcessor*> (getAudioProcessor());
     }
 
+    // Plays the step grid along with the host's transport (see playSteps()), on a
+    // timer of its own - the editor's is too slow to keep the steps in time.
+    class StepClock : public Timer
+    {
+    public:
+        StepClock (PluginAudioProcessorEditor& owner) : editor(owner) {}
+        void timerCallback() { editor.playSteps(); }
+    private:
+        PluginAudioProcessorEditor& editor;
+    };
+    StepClock stepClock;
+    int64 nextStep;     // in 16ths from the start of the host's timeline (-1 when stopped)
+    
+    void playSteps();
+    void releaseSteps (double time);
+    
     void displayPositionInfo (const AudioPlayHead::CurrentPositionInfo& pos);
+    void refreshControl (int c);
+    void showAnalysis (bool shouldShow);
+    void showChannel (bool shouldShow);
+    
+    int lastChangeCount;
+    
+    // drains the synth's analysis tap into the scopes, on the scope thread
+    ScopedPointer<AnalysisFeed> analysisFeed;
+    ComboBox analysisBus;
+    
+    // the channel page's mix processing settings (when the synth has them)
+    Viewport channelView;
+    ScopedPointer<ChannelStrip> channelStrip;
 };
 
 
@@ -1,5 +1,6 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "StemExport.h"
 
 AudioProcessor* JUCE_CALLTYPE createPluginFilter();
 Voice* JUCE_CALLTYPE createVoice(); // callback to student's code to create a single voice instance (e.g. new MyVoice())
@@ -7,12 +8,13 @@ Synth* JUCE_CALLTYPE createSynth(); // callback to create the synthesiser instan
 
 //==============================================================================
 PluginAudioProcessor::PluginAudioProcessor()
-: pEditor(NULL)
+: pEditor(NULL), bDeterministic(false), iSlicePosition(0)
 {
     lastUIWidth = 640;
-    lastUIHeight = 320;
+    lastUIHeight = 420;
 
     lastPosInfo.resetToDefault();
+    lastPosTime = 0.0;
 
     synth = createSynth();
     synth->addSound (new SimpleSound());
@@ -24,10 +26,13 @@ PluginAudioProcessor::PluginAudioProcessor()
         pVoice->setSynthesiser(reinterpret_cast<MySynth*>(synth));
         synth->addVoice (pVoice);   // These voices will play our custom sine-wave sounds..
     }
+    
+    keyboardState.addListener (&noteInjector);
 }
 
 PluginAudioProcessor::~PluginAudioProcessor()
 {
+    keyboardState.removeListener (&noteInjector);
     delete synth;
     synth = NULL;
 }
@@ -64,15 +69,67 @@ const String PluginAudioProcessor::getParameterText (int index)
     return String (getParameter (index), 2);
 }
 
+int PluginAudioProcessor::getParameterChangeCount() const
+{
+    return synth->getParameterChangeCount();
+}
+
+uint32 PluginAudioProcessor::takeChangedParameters (int word)
+{
+    return synth->takeChangedParameters(word);
+}
+
 //==============================================================================
-void PluginAudioProcessor::prepareToPlay (double sampleRate, int /*samplesPerBlock*/)
+void PluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
     synth->setCurrentPlaybackSampleRate (sampleRate);
+    synth->prepareToPlay (sampleRate, samplesPerBlock);
+    updateLatency();
     keyboardState.reset();
+    noteInjector.prepare (sampleRate);
+    sliceMidi.ensureSize (4096);
+    iSlicePosition = 0;
     
     stk::Stk::setSampleRate(sampleRate);
+    
+    // JUCE reads the CPU's features (from /proc/cpuinfo, on Linux) the first time
+    // FloatVectorOperations needs them - do it now rather than in the first block
+    SystemStats::hasSSE2();
+    
+    // spread voice rendering over (up to) three more cores, leaving one for the host
+    // (deterministic renders are serial, so they don't need the helpers)
+    synth->setParallelRendering (bDeterministic ? 0 : jmin (3, SystemStats::getNumCpus() - 2), getNumOutputChannels(), samplesPerBlock);
+}
+
+void PluginAudioProcessor::renderBlock (AudioSampleBuffer& buffer, MidiBuffer& midiMessages)
+{
+    const int numSamples = buffer.getNumSamples();
+    
+    // get the synth to process these midi events and generate its output.
+    synth->renderNextBlock (buffer, midiMessages, 0, numSamples);
+    synth->postProcess(buffer.getArrayOfChannels(), getNumOutputChannels(), numSamples);
+}
+
+void PluginAudioProcessor::setDeterministic (bool enabled, int64 seed)
+{
+    bDeterministic = enabled;
+    iSlicePosition = 0;
+    synth->setDeterministic (enabled, seed);
+}
+
+void PluginAudioProcessor::setStreamPosition (int64 position)
+{
+    // the slices stay lined up with the stream
+    iSlicePosition = (int) (position % kDeterministicSliceSize);
+    synth->setStreamPosition (position);
+}
+
+Result PluginAudioProcessor::exportStems (const MidiMessageSequence& sequence, const File& folder, const StemExportOptions& options)
+{
+    StemExport stemExport (*this, sequence, folder, options);
+    return stemExport.run();
 }
 
 void PluginAudioProcessor::releaseResources()
@@ -91,11 +148,13 @@ void PluginAudioProcessor::reset()
 
 void PluginAudioProcessor::processBlock (AudioSampleBuffer& buffer, MidiBuffer& midiMessages)
 {
+    // (in debug builds, reports anything that may block from here on - see RealtimeGuard)
+    const RealtimeGuard::Scope realtime;
     const int numSamples = buffer.getNumSamples();
     
-    // Pass any incoming midi messages to our keyboard state object, and let it
-    // add messages to the buffer if the user is clicking on the on-screen keys
-    keyboardState.processNextMidiBuffer (midiMessages, 0, numSamples, true);
+    // add the notes played on the editor since the last block, at the offsets they
+    // were played at (lock-free - see NoteInjector)
+    MidiBuffer& events = noteInjector.addToBlock (midiMessages, numSamples);
 
     // In case we have more outputs than inputs, we'll clear any output
     // channels that didn't contain input data, (because these aren't
@@ -103,22 +162,30 @@ void PluginAudioProcessor::processBlock (AudioSampleBuffer& buffer, MidiBuffer&
     for (int i = getNumInputChannels(); i < getNumOutputChannels(); ++i)
         buffer.clear (i, 0, numSamples);
     
-    // and now get the synth to process these midi events and generate its output.
-    synth->renderNextBlock (buffer, midiMessages, 0, numSamples);
-    synth->postProcess(buffer.getArrayOfChannels(), getNumOutputChannels(), numSamples);
+    if (!bDeterministic)
+    {
+        renderBlock (buffer, events);
+    }
+    else
+    {
+        // Fixed slices, each with its own events (moved to the slice's start). The
+        // slices line up with the stream rather than the block, so they're the same
+        // whatever size the host's blocks are.
+        for (int start = 0; start < numSamples;)
+        {
+            const int n = jmin ((int) kDeterministicSliceSize - iSlicePosition, numSamples - start);
+            AudioSampleBuffer slice (buffer.getArrayOfChannels(), buffer.getNumChannels(), start, n);
+            sliceMidi.clear();
+            sliceMidi.addEvents (events, start, n, -start);
+            renderBlock (slice, sliceMidi);
+            
+            start += n;
+            iSlicePosition = (iSlicePosition + n) % kDeterministicSliceSize;
+        }
+    }
     
-//    if (pEditor){
-//        PluginAudioProcessorEditor& editor = *((PluginAudioProcessorEditor*)pEditor);
-//
-//        if(editor.scope_mode & SCOPE_VISIBLE){
-//            if(editor.oscilloscope && (editor.scope_mode & SCOPE_OSCILLOSCOPE))
-//                editor.oscilloscope->processBlock(buffer.getSampleData(0), numSamples);
-//            else if(editor.spectrum && (editor.scope_mode & SCOPE_SPECTRUM))
-//                editor.spectrum->copySamples(buffer.getSampleData(0), numSamples);
-//            else if(editor.sonogram)
-//                editor.sonogram->copySamples(buffer.getSampleData(0), numSamples);
-//        }
-//    }
+    // hand the output to the editor's scopes (a copy, analysed on their own thread)
+    synth->analysis.pushMaster(buffer.getArrayOfChannels(), getNumOutputChannels(), numSamples);
     
     // ask the host for the current time so we can display it...
     AudioPlayHead::CurrentPositionInfo newTime;
@@ -127,6 +194,7 @@ void PluginAudioProcessor::processBlock (AudioSampleBuffer& buffer, MidiBuffer&
     {
         // Successfully got the current time from the host..
         lastPosInfo = newTime;
+        lastPosTime = Time::getMillisecondCounterHiRes();
     }
     else
     {
@@ -142,6 +210,20 @@ AudioProcessorEditor* PluginAudioProcessor::createEditor()
 }
 
 //==============================================================================
+// A parameter's attribute in the state: its control's name, less anything XML won't
+// take in a name (an unnamed control - the pans and meters - goes by its index, as an
+// empty name would leave the whole state unreadable)
+static String getParameterTagName (int index)
+{
+    String name;
+    for (String::CharPointerType t (UI_CONTROLS[index].name.getCharPointer()); ! t.isEmpty(); ++t){
+        if(t.isLetterOrDigit() || *t == '_' || *t == '-' || *t == ':'){
+            name += *t;
+        }
+    }
+    return name.isNotEmpty() && ! CharacterFunctions::isDigit (name[0]) ? name : "Param" + String(index);
+}
+
 void PluginAudioProcessor::getStateInformation (MemoryBlock& destData)
 {
     // You should use this method to store your parameters in the memory block.
@@ -154,15 +236,11 @@ void PluginAudioProcessor::getStateInformation (MemoryBlock& destData)
     xml.setAttribute ("uiWidth", lastUIWidth);
     xml.setAttribute ("uiHeight", lastUIHeight);
     
-    for(int p=0; p<getNumParameters(); p++){
-        String name;
-        for (String::CharPointerType t (UI_CONTROLS[p].name.getCharPointer()); ! t.isEmpty(); ++t){
-            if(t.isLetterOrDigit() || *t == '_' || *t == '-' || *t == ':'){
-                name += *t;
-            }
-        }
-        xml.setAttribute(name, getParameter(p));
-    }
+    for(int p=0; p<getNumParameters(); p++)
+        xml.setAttribute(getParameterTagName(p), getParameter(p));
+    
+    // and whatever else the synth keeps (see Synth::saveSettings())
+    synth->saveSettings(*xml.createNewChildElement("SYNTH"));
 
     // then use this helper function to stuff it into the binary blob and return it..
     copyXmlToBinary (xml, destData);
@@ -185,15 +263,13 @@ void PluginAudioProcessor::setStateInformation (const void* data, int sizeInByte
             lastUIWidth  = xmlState->getIntAttribute ("uiWidth", lastUIWidth);
             lastUIHeight = xmlState->getIntAttribute ("uiHeight", lastUIHeight);
 
-            for(int p=0; p<getNumParameters(); p++){
-                String name;
-                for (String::CharPointerType t (UI_CONTROLS[p].name.getCharPointer()); ! t.isEmpty(); ++t){
-                    if(t.isLetterOrDigit() || *t == '_' || *t == '-' || *t == ':'){
-                        name += *t;
-                    }
-                }
-                setParameter(p, (float) xmlState->getDoubleAttribute (name, getParameter(p)));
-            }
+            for(int p=0; p<getNumParameters(); p++)
+                setParameter(p, (float) xmlState->getDoubleAttribute (getParameterTagName(p), getParameter(p)));
+            
+            const XmlElement* synthSettings = xmlState->getChildByName("SYNTH");
+            synth->loadSettings(synthSettings != nullptr ? *synthSettings : XmlElement("SYNTH"));
+            // (they may change the lookahead)
+            updateLatency();
         }
     }
 }
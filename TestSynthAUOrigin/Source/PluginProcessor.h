@@ -3,6 +3,7 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "modules/stk_module/stk.h"
+#include "RealtimeGuard.h"
 
 class IPluginParameters
 {
@@ -14,6 +15,10 @@ public:
     virtual void setParameter (int index, float newValue) = 0;
     virtual const String getParameterName (int index) const = 0;
     virtual const String getParameterText (int index) const = 0;
+    
+    // change tracking, so the UI only has to refresh controls whose values moved
+    virtual int getParameterChangeCount() const = 0;
+    virtual uint32 takeChangedParameters (int word) = 0;
 };
 
 #include "SynthEditor.h"
@@ -43,8 +48,17 @@ public:
     
     void setParameter (int index, float newValue)
     {
-        if(index >= 0 && index < COUNT)
+        if(index >= 0 && index < COUNT && parameters[index] != newValue){
             parameters[index] = newValue;
+            
+            // flag the parameter as changed, then publish a new change count
+            Atomic<uint32>& word = changed[index / 32];
+            const uint32 bit = 1u << (index % 32);
+            uint32 flags = word.get();
+            while(!word.compareAndSetBool(flags | bit, flags))
+                flags = word.get();
+            ++changeCount;
+        }
     }
     
     const String getParameterName (int index) const
@@ -58,31 +72,317 @@ public:
     {
         return String (getParameter (index), 2);
     }
+    
+    //==============================================================================
+    // incremented (from any thread) every time a parameter value changes
+    int getParameterChangeCount() const
+    {
+        return changeCount.get();
+    }
+    
+    // returns and clears the changed flags for parameters [32 * word, 32 * word + 31]
+    uint32 takeChangedParameters (int word)
+    {
+        if(word >= 0 && word < kChangedWords)
+            return changed[word].exchange(0);
+        return 0;
+    }
+    
+    enum { kChangedWords = (COUNT + 31) / 32 };
+    
 private:
     float parameters[COUNT];
+    
+    Atomic<uint32> changed[kChangedWords];
+    Atomic<int> changeCount;
 };
 
 static float SAMPLE_RATE = 0.0f;
 static float getSampleRate() { return SAMPLE_RATE; }
 
 #include "PluginWrapper.h"
+#include "MeterBridge.h"
+#include "AnalysisTap.h"
+#include "RenderWorkers.h"
+#include "NoteInjector.h"
 
-class Synth : public Synthesiser, public PluginParameters<kNumberOfParameters> {
+class Synth : public Synthesiser, public PluginParameters<kNumberOfParameters>, public RenderWorkerPool::Job {
 public:
-    Synth() : Synthesiser() {
+    Synth() : Synthesiser(), iWorkerBlockSize(0), bDeterministic(false), iStreamPosition(0), pRenderOutput(NULL), iRenderStartSample(0),
+              iRenderNumSamples(0), pBusCapture(NULL), iBusCapturePosition(0) {
         SAMPLE_RATE = 44100.0; // sample rate potentially not valid before playback
         
         for(int p=0; p<kNumberOfParameters; p++)
             setParameter(p, UI_CONTROLS[p].initial);
+        
+        for(int w=0; w<kMaxRenderWorkers; w++)
+            bWorkerUsed[w] = false;
     }
     
+    // Called by the processor's prepareToPlay() (so not on the audio thread), once the
+    // playback rate is set - for anything that depends on the host's rate or block size.
+    virtual void prepareToPlay (double sampleRate, int samplesPerBlock) {}
+    
+    // the delay (in samples) postProcess() adds to the output, for the host to
+    // compensate for - see PluginAudioProcessor::updateLatency()
+    virtual int getLatency() const { return 0; }
+    
     virtual void postProcess(float** outputBuffer, int numChannels, int numSamples) {}
     
+    // the submix buses voices write to alongside the main output (none by default)
+    virtual int getNumBuses() const { return 0; }
+    virtual float** getBuses() { return NULL; }
+    virtual String getBusName (int bus) const { return "Bus " + String (bus + 1); }
+    
+    // Settings saved in the plugin's state along with the parameters (see
+    // PluginAudioProcessor::getStateInformation()), for subclasses with more to keep
+    // than their parameters - the mix processing, say. loadSettings() is given an
+    // empty element for a state saved without any, and should go back to defaults.
+    virtual void saveSettings (XmlElement& xml) const {}
+    virtual void loadSettings (const XmlElement& xml) {}
+    
+    // (offline renders) Waits for anything the synth loads in the background after
+    // its settings or rate change - returning false if it takes over timeoutMs.
+    virtual bool waitUntilReady (int timeoutMs) { return true; }
+    
+    // (soak tests) the voices holding a note, and the hits still sounding in subclasses
+    // that play them outside their voices - both should fall to 0 in silence
+    int getNumActiveVoices() const {
+        int numActive = 0;
+        for(int v=0; v<voices.size(); v++)
+            if(voices.getUnchecked(v)->getCurrentlyPlayingNote() >= 0)
+                numActive++;
+        return numActive;
+    }
+    virtual int getNumSoundingHits() const { return 0; }
+    
+    // Sets up parallel voice rendering with numThreads helper threads (0 renders
+    // serially) for blocks of up to maxBlockSize samples. Each helper renders into its
+    // own copy of the output and buses, summed back by the audio thread, so voices
+    // never write to shared memory concurrently. Call while the audio isn't running.
+    void setParallelRendering (int numThreads, int numOutputChannels, int maxBlockSize)
+    {
+        const ScopedLock sl (lock);
+        
+        workers = nullptr;
+        workerOutputs.clear();
+        workerBuses.clear();
+        iWorkerBlockSize = 0;
+        
+        numThreads = jmin(numThreads, (int) kMaxRenderWorkers - 1);
+        if(numThreads <= 0 || maxBlockSize <= 0)
+            return;
+        
+        for(int w=0; w<=numThreads; w++){
+            workerOutputs.add(new AudioSampleBuffer(jmax(1, numOutputChannels), maxBlockSize));
+            workerBuses.add(new AudioSampleBuffer(jmax(1, getNumBuses()), maxBlockSize));
+        }
+        activeVoices.ensureStorageAllocated(jmax(64, voices.size()));
+        
+        iWorkerBlockSize = maxBlockSize;
+        workers = new RenderWorkerPool(numThreads);
+    }
+    
+    // Deterministic rendering (for tests and exports): voices are rendered serially,
+    // always in the same order, and subclasses restart anything random from the seed.
+    virtual void setDeterministic (bool enabled, int64 seed) { bDeterministic = enabled; iStreamPosition = 0; }
+    bool isDeterministic() const { return bDeterministic; }
+    
+    // When deterministic, the sample the next block starts at in the stream (counted
+    // from setDeterministic()) - each note-on is passed to prepareNote() with its own.
+    // An export renders a stretch of the stream by starting here (see StemExport.h).
+    void setStreamPosition (int64 position) { iStreamPosition = position; }
+    
+    // Called, when deterministic, just before a note-on is handled, with its position
+    // in the stream. Anything a hit draws at random should come from these alone, so
+    // a render started part way through makes the same choices.
+    virtual void prepareNote (int note, int64 position) {}
+    
+    // (tests and exports) Copies the buses into the buffer as they're mixed, one
+    // channel per bus, from its start and for as long as it has room. NULL stops it.
+    void setBusCapture (AudioSampleBuffer* buffer) { pBusCapture = buffer; iBusCapturePosition = 0; }
+    
+    // Drum render path (hides Synthesiser::renderNextBlock). Rather than splitting the
+    // block at every MIDI event and re-rendering every voice for each fragment, all of
+    // the block's events are handled first, each started voice remembering the offset
+    // of its note-on (and each stopped voice that of its note-off). Every voice is then
+    // rendered exactly once for the whole block, from its offset, so the cost doesn't
+    // grow with event density. (Other events take effect from the start of the block.)
+    void renderNextBlock (AudioSampleBuffer& outputBuffer, const MidiBuffer& midiData, int startSample, int numSamples)
+    {
+        const ScopedLock sl (lock);
+        
+        MidiBuffer::Iterator midiIterator (midiData);
+        midiIterator.setNextSamplePosition (startSample);
+        MidiMessage m (0xf4, 0.0);
+        int midiEventPos;
+        
+        while (midiIterator.getNextEvent (m, midiEventPos) && midiEventPos < startSample + numSamples)
+        {
+            if (bDeterministic && m.isNoteOn())
+                prepareNote (m.getNoteNumber(), iStreamPosition + jmax (0, midiEventPos - startSample));
+            
+            handleMidiEvent (m);
+            
+            if (m.isNoteOn())
+            {
+                for (int i = voices.size(); --i >= 0;)
+                    static_cast<Voice*> (voices.getUnchecked (i))->setStartOffset (jmax (0, midiEventPos - startSample));
+            }
+            
+            // (a note-on can stop a voice too, when it retriggers a sounding note)
+            if (m.isNoteOnOrOff() || m.isAllNotesOff() || m.isAllSoundOff())
+            {
+                for (int i = voices.size(); --i >= 0;)
+                    static_cast<Voice*> (voices.getUnchecked (i))->setStopOffset (jmax (0, midiEventPos - startSample));
+            }
+        }
+        
+        renderVoices (outputBuffer, startSample, numSamples);
+        
+        if (bDeterministic)
+            iStreamPosition += numSamples;
+    }
+    
+    // Renders the sounding voices into the block, once its MIDI has been handled.
+    virtual void renderVoices (AudioSampleBuffer& outputBuffer, int startSample, int numSamples)
+    {
+        activeVoices.clearQuick();
+        for (int i = voices.size(); --i >= 0;)
+        {
+            if (voices.getUnchecked (i)->getCurrentlyPlayingNote() >= 0)
+                activeVoices.add (static_cast<Voice*> (voices.getUnchecked (i)));
+        }
+        
+        if (!renderInParallel (outputBuffer, startSample, numSamples, activeVoices.size()))
+        {
+            for (int i = 0; i < activeVoices.size(); i++)
+                activeVoices.getUnchecked (i)->renderNextBlock (outputBuffer, startSample, numSamples);
+        }
+    }
+    
+    // RenderWorkerPool::Job - renders one active voice on the given worker
+    virtual void renderItem (int item, int worker)
+    {
+        Voice* pVoice = activeVoices.getUnchecked (item);
+        
+        pVoice->setBusTarget (worker > 0 ? getWorkerBuses (worker) : NULL);
+        pVoice->renderNextBlock (getWorkerOutput (worker), getRenderStartSample(), getRenderNumSamples());
+        pVoice->setBusTarget (NULL);
+    }
+    
     void setCurrentPlaybackSampleRate (const double newRate){
         Synthesiser::setCurrentPlaybackSampleRate(SAMPLE_RATE = newRate);
     }
+    
+    // bus levels published by postProcess() for the editor's meter bridge
+    MeterLevels meterLevels;
+    // the master output and a selected bus, copied out for the editor's scopes
+    AnalysisTap analysis;
+    
+protected:
+    // Renders numItems items (see renderItem()) across the worker pool, then sums
+    // the helpers' private output and buses back into the block. Returns false,
+    // having rendered nothing, when there's no pool or too few items to be worth
+    // handing off (below a handful, the hand-off costs more than it saves).
+    bool renderInParallel (AudioSampleBuffer& outputBuffer, int startSample, int numSamples, int numItems)
+    {
+        if (workers == nullptr || bDeterministic || numItems < kMinParallelItems
+             || startSample + numSamples > iWorkerBlockSize
+             || outputBuffer.getNumChannels() > workerOutputs[0]->getNumChannels())
+            return false;
+        
+        pRenderOutput = &outputBuffer;
+        iRenderStartSample = startSample;
+        iRenderNumSamples = numSamples;
+        for (int w = 0; w < workers->getNumWorkers(); w++)
+            bWorkerUsed[w] = false;
+        
+        workers->run (*this, numItems);
+        
+        float** ppBuses = getBuses();
+        for (int w = 1; w < workers->getNumWorkers(); w++)
+        {
+            if (!bWorkerUsed[w])
+                continue;
+            
+            for (int c = 0; c < outputBuffer.getNumChannels(); c++)
+                outputBuffer.addFrom (c, startSample, *workerOutputs[w], c, startSample, numSamples);
+            
+            for (int b = 0; ppBuses != NULL && b < getNumBuses(); b++)
+                FloatVectorOperations::add (ppBuses[b] + startSample, workerBuses[w]->getSampleData (b, startSample), numSamples);
+        }
+        
+        pRenderOutput = NULL;
+        return true;
+    }
+    
+    // Where a worker renders to during renderInParallel(): the audio thread (worker 0)
+    // writes straight into the block and buses, the helpers into private copies
+    // (cleared on first use in the block).
+    AudioSampleBuffer& getWorkerOutput (int worker)
+    {
+        if (worker == 0)
+            return *pRenderOutput;
+        prepareWorker (worker);
+        return *workerOutputs.getUnchecked (worker);
+    }
+    
+    float** getWorkerBuses (int worker)
+    {
+        if (worker == 0 || getNumBuses() == 0)
+            return getBuses();
+        prepareWorker (worker);
+        return workerBuses.getUnchecked (worker)->getArrayOfChannels();
+    }
+    
+    int getRenderStartSample() const { return iRenderStartSample; }
+    int getRenderNumSamples() const { return iRenderNumSamples; }
+    
+    // for postProcess(), once the buses are final (see setBusCapture())
+    void captureBuses (float** buses, int numBuses, int numSamples)
+    {
+        if (pBusCapture == NULL)
+            return;
+        
+        const int n = jmin (numSamples, pBusCapture->getNumSamples() - iBusCapturePosition);
+        for (int b = 0; b < numBuses && b < pBusCapture->getNumChannels() && n > 0; b++)
+            pBusCapture->copyFrom (b, iBusCapturePosition, buses[b], n);
+        iBusCapturePosition += jmax (0, n);
+    }
+    
+private:
+    enum { kMaxRenderWorkers = 8, kMinParallelItems = 8 };
+    
+    void prepareWorker (int worker)
+    {
+        if (!bWorkerUsed[worker])
+        {
+            workerOutputs.getUnchecked (worker)->clear (iRenderStartSample, iRenderNumSamples);
+            workerBuses.getUnchecked (worker)->clear (iRenderStartSample, iRenderNumSamples);
+            bWorkerUsed[worker] = true;
+        }
+    }
+    
+    ScopedPointer<RenderWorkerPool> workers;
+    OwnedArray<AudioSampleBuffer> workerOutputs;    // per worker (index 0 unused)
+    OwnedArray<AudioSampleBuffer> workerBuses;
+    int iWorkerBlockSize;
+    bool bWorkerUsed[kMaxRenderWorkers];
+    bool bDeterministic;
+    int64 iStreamPosition;
+    
+    // the block being rendered, for renderItem()
+    Array<Voice*> activeVoices;
+    AudioSampleBuffer* pRenderOutput;
+    int iRenderStartSample, iRenderNumSamples;
+    
+    AudioSampleBuffer* pBusCapture;
+    int iBusCapturePosition;
 };
 
+struct StemExportOptions;
+
 //==============================================================================
 /**
 */
@@ -122,6 +422,9 @@ public:
     void setParameter (int index, float newValue);
     const String getParameterName (int index);
     const String getParameterText (int index);
+    
+    int getParameterChangeCount() const;
+    uint32 takeChangedParameters (int word);
 
     //==============================================================================
     int getNumPrograms()                                                { return 0; }
@@ -134,13 +437,28 @@ public:
     void getStateInformation (MemoryBlock& destData);
     void setStateInformation (const void* data, int sizeInBytes);
 
-    // this is kept up to date with the midi messages that arrive, and the UI component
-    // registers with it so it can represent the incoming messages
+    // the on-screen keyboard's state: its keys are played through the NoteInjector
+    // (never by the audio thread), which also shows the host's notes on it from
+    // updateKeyboardState()
     MidiKeyboardState keyboardState;
+    
+    // (message thread) plays a drum from the UI - the step grid, say - at the
+    // given time (on the Time::getMillisecondCounterHiRes() clock), in the next block.
+    // A velocity of 0 is a note-off. See NoteInjector.
+    bool playNote (int note, float velocity, double time = Time::getMillisecondCounterHiRes())
+    {
+        return noteInjector.play (1, note, velocity, time);
+    }
+    
+    // (message thread, from the editor's timer) shows the host's latest notes on keyboardState
+    void updateKeyboardState() { noteInjector.updateKeyboard (keyboardState); }
 
     // this keeps a copy of the last set of time info that was acquired during an audio
     // callback - the UI component will read this and display it.
     AudioPlayHead::CurrentPositionInfo lastPosInfo;
+    // when it was acquired, on the Time::getMillisecondCounterHiRes() clock (the step
+    // grid works out where the host's timeline is now from the two)
+    double lastPosTime;
 
     // these are used to persist the UI's size - the values are stored along with the
     // filter's other parameters, and the UI component will update them when it gets
@@ -148,9 +466,48 @@ public:
     int lastUIWidth, lastUIHeight;
     
     void onButtonClicked(int control) {}
+    
+    // Renders reproducibly, for tests and exports: round robins are drawn from the
+    // seed and each hit's position, voices are rendered serially, and every block is
+    // rendered in slices of kDeterministicSliceSize samples - so the output doesn't
+    // depend on the host's block size or on thread timing. Set it before playing.
+    void setDeterministic (bool enabled, int64 seed = 1);
+    bool isDeterministic() const { return bDeterministic; }
+    // (deterministic) where the next block starts in the stream - see Synth::setStreamPosition()
+    void setStreamPosition (int64 position);
+    
+    // Renders a MIDI sequence (timestamps in seconds) offline and writes the mix and
+    // every mic bus to its own file in folder - see StemExport.h. Blocks until done
+    // (or until the calling thread is asked to exit); call it away from the audio thread.
+    Result exportStems (const MidiMessageSequence& sequence, const File& folder, const StemExportOptions& options);
+    
+    // (message thread) reports the synth's current latency to the host, if it has
+    // changed - called by prepareToPlay() and the editor's timer, and by anything else
+    // that changes the lookahead or oversampling
+    void updateLatency() { setLatencySamples (synth->getLatency()); }
+    
+    // (tests and exports) see Synth::setBusCapture()
+    void setBusCapture (AudioSampleBuffer* buffer) { synth->setBusCapture (buffer); }
+    int getNumBuses() const { return synth->getNumBuses(); }
+    String getBusName (int bus) const { return synth->getBusName (bus); }
+    // (tests and exports) see Synth::waitUntilReady()
+    bool waitUntilReady (int timeoutMs = 10000) { return synth->waitUntilReady (timeoutMs); }
+    
+    // (soak tests) see Synth::getNumActiveVoices()
+    int getNumActiveVoices() const { return synth->getNumActiveVoices(); }
+    int getNumSoundingHits() const { return synth->getNumSoundingHits(); }
+    
+    enum { kDeterministicSliceSize = 64 };
 
 private:
+    // the synth's part of processBlock()
+    void renderBlock (AudioSampleBuffer& buffer, MidiBuffer& midiMessages);
+    
     AudioProcessorEditor* pEditor;
+    bool bDeterministic;
+    MidiBuffer sliceMidi;   // a slice's events, when deterministic
+    NoteInjector noteInjector;
+    int iSlicePosition;     // how far into a slice the stream is
     
     Synth* synth;
     
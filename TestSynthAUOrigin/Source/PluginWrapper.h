@@ -37,11 +37,11 @@ public:
     }
     
     void setCutoff(float frequency){
-        Float32 fOmega = M_PI * (frequency/sampleRate());
-		Float32 fKval = tan(fOmega);
-		Float32 fKvalsq = fKval * fKval;
-		Float32 fRootTwo = sqrt(2.0);
-		Float32 ffrac = 1.0 / (1.0 + fRootTwo * fKval + fKvalsq);
+        float fOmega = M_PI * (frequency/sampleRate());
+		float fKval = tan(fOmega);
+		float fKvalsq = fKval * fKval;
+		float fRootTwo = sqrt(2.0);
+		float ffrac = 1.0 / (1.0 + fRootTwo * fKval + fKvalsq);
 		
         setB0(fKvalsq * ffrac);
         setB1(2.0 * fKvalsq * ffrac);
@@ -59,11 +59,11 @@ public:
     }
     
     void setCutoff(float frequency){
-        Float32 fOmega = M_PI * (frequency/sampleRate());
-		Float32 fKval = tan(fOmega);
-		Float32 fKvalsq = fKval * fKval;
-		Float32 fRootTwo = sqrt(2.0);
-		Float32 ffrac = 1.0 / (1.0 + fRootTwo * fKval + fKvalsq);
+        float fOmega = M_PI * (frequency/sampleRate());
+		float fKval = tan(fOmega);
+		float fKvalsq = fKval * fKval;
+		float fRootTwo = sqrt(2.0);
+		float ffrac = 1.0 / (1.0 + fRootTwo * fKval + fKvalsq);
 
         setB0(ffrac);
         setB1(-2.0 * ffrac);
@@ -105,10 +105,10 @@ public:
             bandwidth = 0.24 * fSampleRate;
         }
         
-		Float32 fOmegaA = M_PI * (centre/fSampleRate);
-		Float32 fOmegaB = M_PI * (bandwidth/fSampleRate);
-		Float32 fCval = (tan(fOmegaB) - 1) / (tan(2.0 * fOmegaB) + 1);
-		Float32 fDval = -1.0 * cos(2.0 * fOmegaA);
+		float fOmegaA = M_PI * (centre/fSampleRate);
+		float fOmegaB = M_PI * (bandwidth/fSampleRate);
+		float fCval = (tan(fOmegaB) - 1) / (tan(2.0 * fOmegaB) + 1);
+		float fDval = -1.0 * cos(2.0 * fOmegaA);
 		
 		setB0(-1.0 * fCval);
 		setB1(fDval * (1.0 - fCval));
@@ -137,19 +137,174 @@ public:
     }
 };
 
-class Buffer : public stk::FileWvIn
-{
-public:
-    void openResource(std::string filename){
-        CFBundleRef plugBundle = CFBundleGetBundleWithIdentifier(CFSTR("com.UWE.TestSynthAU"));
+// The resources folder a host has chosen (see setResourcePath()), if any
+inline std::string& getResourcePathOverride(){
+    static std::string path;
+    return path;
+}
+
+// Points getResourcePath() at a folder of the host's choosing (e.g. a render node's
+// copy of the kit), or back to the default if it's empty. Set it before the first
+// PluginAudioProcessor is made.
+inline void setResourcePath(const std::string& path){
+    getResourcePathOverride() = path;
+}
+
+// Returns the resources folder (where the samples are kept): the one the host has
+// set, else $TESTSYNTHAU_RESOURCES, else the plugin bundle's Resources on the Mac or
+// a Resources folder beside the plugin (or executable) elsewhere.
+inline std::string getResourcePath(){
+    if(!getResourcePathOverride().empty())
+        return getResourcePathOverride();
+
+    const String environment (SystemStats::getEnvironmentVariable("TESTSYNTHAU_RESOURCES", String::empty));
+    if(environment.isNotEmpty())
+        return environment.toStdString();
+
+#if JUCE_MAC
+    CFBundleRef plugBundle = CFBundleGetBundleWithIdentifier(CFSTR("com.UWE.TestSynthAU"));
+    if(plugBundle != NULL){
         CFURLRef resourcesURL = CFBundleCopyResourcesDirectoryURL(plugBundle);
         char path[PATH_MAX];
         CFURLGetFileSystemRepresentation(resourcesURL, TRUE, (UInt8 *)path, PATH_MAX);
         CFRelease(resourcesURL);
+
+        return std::string(path);
+    }
+#endif
+
+    // (currentExecutableFile is the shared library itself, when it's a plugin)
+    return File::getSpecialLocation(File::currentExecutableFile).getSiblingFile("Resources").getFullPathName().toStdString();
+}
+
+class Buffer : public stk::FileWvIn
+{
+public:
+    Buffer() : iStartOffset(0) {}
+    
+    // Loads a resource file normalised, returning the peak it was normalised from
+    // (in the file's own units).
+    float openResource(std::string filename){
+        openFile(getResourcePath() + "/" + filename, false, false);
+        const float fPeak = getPeak();
+        scale(fPeak > 0.0f ? 1.0f / fPeak : 1.0f);
+        return fPeak;
+    }
+    
+    // Loads just the first numFrames frames of a resource file, scaled by fGain - for
+    // a file whose peak and trimmed length are already known (see KitCache), so it's
+    // read no further and not scanned.
+    void openResource(std::string filename, int numFrames, float fGain){
+        closeFile();
+        file_.open(getResourcePath() + "/" + filename);
+        chunking_ = false;
         
-        openFile(std::string(path) + "/" + filename);
-        normalize();
+        const unsigned long iFrames = numFrames > 1 ? (unsigned long)numFrames : 1;
+        data_.resize(iFrames < file_.fileSize() ? iFrames : file_.fileSize(), file_.channels());
+        file_.read(data_, 0, false);
+        scale(fGain);
+        
+        lastFrame_.resize(1, file_.channels());
+        setRate(data_.dataRate() / stk::Stk::sampleRate());
+        reset();
+    }
+    
+    // Takes the sample data from memory (e.g. a packed kit) rather than a file:
+    // numFrames frames of numChannels interleaved samples, recorded at fileRate.
+    void loadSamples(const float* samples, int numFrames, int numChannels, double fileRate){
+        closeFile();
+        chunking_ = false;
+        
+        // copied (a single memcpy), as trimTail() edits the data
+        stk::StkFrames source;
+        source.setView(const_cast<stk::StkFloat*>(samples), numFrames, numChannels);
+        data_ = source;
+        data_.setDataRate(fileRate);
+        
+        lastFrame_.resize(1, numChannels);
+        setRate(fileRate / stk::Stk::sampleRate());
+        reset();
+    }
+    
+    // Finds the true end of the sample (the last frame above fThreshold on any
+    // channel), keeps iFadeLength frames beyond it faded linearly to zero, and
+    // shortens the buffer there. Copies of the buffer then only carry the audible
+    // part of the sample, and tick() stops at the new end. Returns the new length.
+    int trimTail(float fThreshold, int iFadeLength){
+        if(chunking_ || data_.empty())
+            return getNumFrames();
+        
+        const unsigned int nChannels = data_.channels();
+        unsigned long iEnd = data_.frames();
+        bool bAudible = false;
+        while(iEnd > 0 && !bAudible){
+            for(unsigned int c=0; c<nChannels; c++){
+                if(fabs(data_(iEnd - 1, c)) > fThreshold)
+                    bAudible = true;
+            }
+            if(!bAudible)
+                iEnd--;
+        }
+        
+        trimTo((int)(iEnd + iFadeLength), iFadeLength);
+        return getNumFrames();
+    }
+    
+    // shortens the buffer to numFrames frames, the last iFadeLength of them faded
+    // out (as trimTail() does, where the end is already known)
+    void trimTo(int numFrames, int iFadeLength){
+        if(chunking_ || data_.empty())
+            return;
+        
+        const unsigned int nChannels = data_.channels();
+        unsigned long iEnd = numFrames > 0 ? (unsigned long)numFrames : 0;
+        if(iEnd > data_.frames())
+            iEnd = data_.frames();
+        
+        const unsigned long iFadeStart = iEnd > (unsigned long)iFadeLength ? iEnd - iFadeLength : 0;
+        for(unsigned long f=iFadeStart; f<iEnd; f++){
+            float fGain = (float)(iEnd - f) / (float)(iEnd - iFadeStart + 1);
+            for(unsigned int c=0; c<nChannels; c++)
+                data_(f, c) *= fGain;
+        }
+        
+        data_.resize(iEnd > 1 ? iEnd : 1, nChannels);
     }
+    
+    // the (mono) sample data, for readers that play it in place, e.g. the voice pool
+    const stk::StkFloat* getSamples() const { return data_.empty() ? NULL : &const_cast<stk::StkFrames&>(data_)[0]; }
+    int getNumFrames() const { return (int)data_.frames(); }
+    
+    // frames skipped at the start of playback, to line the sample up with the other
+    // mics of the same hit (see DrumKit::alignMics())
+    void setStartOffset(int offset) { iStartOffset = offset > 0 ? offset : 0; }
+    int getStartOffset() const { return iStartOffset; }
+    
+    stk::StkFloat tick(unsigned int channel = 0){
+        // stop at the end of the (possibly trimmed) sample data, not the file length
+        if(!chunking_ && !finished_ && time_ > (stk::StkFloat)(data_.frames() - 1)){
+            for(unsigned int i=0; i<lastFrame_.size(); i++)
+                lastFrame_[i] = 0.0;
+            finished_ = true;
+            return 0.0;
+        }
+        return FileWvIn::tick(channel);
+    }
+    
+private:
+    float getPeak() const {
+        float fPeak = 0.0f;
+        for(size_t i=0; i<data_.size(); i++)
+            fPeak = jmax(fPeak, std::abs(data_[i]));
+        return fPeak;
+    }
+    
+    void scale(float fGain){
+        for(size_t i=0; i<data_.size(); i++)
+            data_[i] *= fGain;
+    }
+    
+    int iStartOffset;
 };
 
 
@@ -176,9 +331,21 @@ public:
             Point::y = y;
             next = NULL;
         }
-        Points(){
+        Points() : next(NULL) {}
+        Points(const Points& other) : Point(other), next(other.next ? new Points(*other.next) : NULL) {}
+        ~Points(){
             delete next;
         }
+
+        Points& operator=(const Points& other){
+            if(this != &other){
+                Points* copy = other.next ? new Points(*other.next) : NULL;
+                delete next;
+                Point::operator=(other);
+                next = copy;
+            }
+            return *this;
+        }
         
         Points& operator()(float x, float y){
             last().next = new Points(x, y);
@@ -324,6 +491,231 @@ private:
     STAGE stage;
 };
 
+#if JUCE_INTEL
+ #include <xmmintrin.h>
+ #define BLOCKENVELOPE_SSE 1
+#endif
+
+//==============================================================================
+/** A breakpoint envelope that renders a block of gains at a time, for voices that
+    apply their amplitude (and note-off and choke fades) at block rate. The points
+    are compiled into a flat array of ramps, each a known number of samples long,
+    so process() just fills ramps - with SSE where it's available.              */
+class BlockEnvelope
+{
+public:
+    // Linear ramps go straight from point to point; exponential ones approach each
+    // point's level (reaching within -60dB of it by the point's time), which sounds
+    // more natural for fades.
+    enum Shape { kLinear, kExponential };
+
+    BlockEnvelope() : shape(kLinear), fSampleRate(stk::Stk::sampleRate())
+    {
+        set(Envelope::Points(0.0f, 1.0f));
+    }
+
+    // Compiles the points (x the time in seconds, y the level) and starts from the
+    // first. After the last point the level holds, until release().
+    void set(const Envelope::Points& points, Shape rampShape = kLinear, double sampleRate = stk::Stk::sampleRate())
+    {
+        shape = rampShape;
+        fSampleRate = sampleRate;
+        segments.clear();
+
+        fInitial = points.y;
+        for(const Envelope::Points* pPoint = &points; pPoint->next != NULL; pPoint = pPoint->next)
+            segments.push_back(makeSegment(pPoint->y, pPoint->next->y, pPoint->next->x - pPoint->x));
+
+        start();
+    }
+
+    // (re)starts from the first point
+    void start()
+    {
+        stage = Envelope::ENV_SUSTAIN;
+        iSegment = 0;
+        iPosition = 0;
+        fLevel = fInitial;
+    }
+
+    // fades from the current level to silence over the given time (e.g. a note-off,
+    // or a short one for a choke), after which the envelope is off
+    void release(float time)
+    {
+        const float fFrom = getLevel();
+        releaseSegment = makeSegment(fFrom, 0.0f, time);
+        stage = Envelope::ENV_RELEASE;
+        iPosition = 0;
+        fLevel = fFrom;
+    }
+
+    Envelope::STAGE getStage() const { return stage; }
+    bool isReleasing() const { return stage == Envelope::ENV_RELEASE; }
+    bool isOff() const { return stage == Envelope::ENV_OFF; }
+
+    // the gain the next sample would have
+    float getLevel() const
+    {
+        const Segment* pSegment = getSegment();
+        return pSegment != NULL ? pSegment->valueAt(iPosition) : fLevel;
+    }
+
+    // writes the next numSamples gains
+    void process(float* gainOut, int numSamples)
+    {
+        while(numSamples > 0){
+            const Segment* pSegment = getSegment();
+            if(pSegment == NULL){
+                // holding (after the last point, or off)
+                for(int s=0; s<numSamples; s++)
+                    gainOut[s] = fLevel;
+                return;
+            }
+
+            const int count = jmin(numSamples, pSegment->length - iPosition);
+            render(*pSegment, iPosition, gainOut, count);
+            gainOut += count;
+            numSamples -= count;
+            iPosition += count;
+
+            if(iPosition >= pSegment->length){
+                fLevel = pSegment->fTo;
+                iPosition = 0;
+                if(stage == Envelope::ENV_RELEASE)
+                    stage = Envelope::ENV_OFF;
+                else
+                    iSegment++;
+            }
+        }
+    }
+
+    // multiplies a buffer by the next numSamples gains (using gainOut as scratch)
+    void apply(float* samples, float* gainOut, int numSamples)
+    {
+        process(gainOut, numSamples);
+        FloatVectorOperations::multiply(samples, gainOut, numSamples);
+    }
+
+private:
+    // (exponential ramps restart from an exact powf() every kChunk samples)
+    enum { kChunk = 64 };
+
+    struct Segment
+    {
+        int length;             // in samples (at least 1)
+        float fFrom, fTo;
+        float fIncrement;       // per sample (linear)
+        float fRatio;           // per sample, of the remaining distance (exponential)
+        bool bExponential;
+
+        float valueAt(int position) const
+        {
+            if(bExponential)
+                return fTo + getDistance(position & ~3) * getLanes()[position & 3];
+            return fFrom + fIncrement * position;
+        }
+
+        // (exponential) the distance to go at the start of a group of 4 samples: worked
+        // out afresh every kChunk samples, and stepped 4 at a time in between
+        float getDistance(int group) const
+        {
+            const int anchor = group & ~(kChunk - 1);
+            float fDistance = (fFrom - fTo) * powf(fRatio, (float)anchor);
+            for(int s = anchor; s < group; s += 4)
+                fDistance *= fStep;
+            return fDistance;
+        }
+
+        // the distance's multipliers across a group of 4 (1, r, r^2, r^3)
+        const float* getLanes() const { return fLanes; }
+
+        float fLanes[4];
+        float fStep;            // r^4
+    };
+
+    Segment makeSegment(float fFrom, float fTo, float time) const
+    {
+        Segment segment;
+        segment.length = jmax(1, (int)(time * fSampleRate + 0.5));
+        segment.fFrom = fFrom;
+        segment.fTo = fTo;
+        segment.fIncrement = (fTo - fFrom) / segment.length;
+        segment.fRatio = powf(0.001f, 1.0f / segment.length);
+        segment.fLanes[0] = 1.0f;
+        for(int l=1; l<4; l++)
+            segment.fLanes[l] = segment.fLanes[l - 1] * segment.fRatio;
+        segment.fStep = segment.fLanes[3] * segment.fRatio;
+        segment.bExponential = shape == kExponential;
+        return segment;
+    }
+
+    // the ramp being played, or NULL while holding
+    const Segment* getSegment() const
+    {
+        if(stage == Envelope::ENV_RELEASE)
+            return &releaseSegment;
+        if(stage == Envelope::ENV_SUSTAIN && iSegment < (int)segments.size())
+            return &segments[iSegment];
+        return NULL;
+    }
+
+    // Every gain depends only on its position in the ramp (not on where the blocks
+    // split it), so a ramp renders the same whatever the block sizes.
+    static void render(const Segment& segment, int position, float* gains, int count)
+    {
+        int s = 0;
+        if(segment.bExponential){
+            // the distance still to go shrinks by fRatio each sample - 4 at a time, from
+            // the start of the group of 4 the block starts in
+            const float* lanes = segment.getLanes();
+            int group = position & ~3;
+            float fDistance = segment.getDistance(group);
+            while(s < count){
+               #if BLOCKENVELOPE_SSE
+                if(position + s == group && s + 4 <= count){
+                    _mm_storeu_ps(gains + s, _mm_add_ps(_mm_set1_ps(segment.fTo),
+                                                        _mm_mul_ps(_mm_set1_ps(fDistance), _mm_loadu_ps(lanes))));
+                    s += 4;
+                }else
+               #endif
+                {
+                    for(int l = position + s - group; l < 4 && s < count; l++, s++)
+                        gains[s] = segment.fTo + fDistance * lanes[l];
+                }
+                group += 4;
+                fDistance = (group & (kChunk - 1)) == 0 ? segment.getDistance(group) : fDistance * segment.fStep;
+            }
+        }else{
+            // from the segment's start each time, so that long ramps don't drift
+           #if BLOCKENVELOPE_SSE
+            const __m128 from = _mm_set1_ps(segment.fFrom);
+            const __m128 increment = _mm_set1_ps(segment.fIncrement);
+            __m128 index = _mm_setr_ps((float)position, (float)(position + 1), (float)(position + 2), (float)(position + 3));
+            const __m128 four = _mm_set1_ps(4.0f);
+            for(; s + 4 <= count; s += 4){
+                _mm_storeu_ps(gains + s, _mm_add_ps(from, _mm_mul_ps(increment, index)));
+                index = _mm_add_ps(index, four);
+            }
+           #endif
+            for(; s < count; s++)
+                gains[s] = segment.fFrom + segment.fIncrement * (float)(position + s);
+        }
+    }
+
+    std::vector<Segment> segments;
+    Segment releaseSegment;
+    Shape shape;
+    double fSampleRate;
+    float fInitial;
+
+    Envelope::STAGE stage;
+    int iSegment;       // the ramp being played (while sustaining)
+    int iPosition;      // samples into it
+    float fLevel;       // the level held between ramps
+
+    JUCE_DECLARE_NON_COPYABLE (BlockEnvelope)
+};
+
 class ADSR : public stk::ADSR {};
 
 class Waveshaper {
@@ -335,18 +727,65 @@ public:
 
 typedef float (*Function)(float x);
 
+// A Waveshaper whose curve is sampled from a Function into a table when it's set
+// (so the function can be as costly as it likes), then read with linear
+// interpolation. Inputs beyond +/-range are held at the ends of the curve.
+class TableWaveshaper : public Waveshaper {
+public:
+    TableWaveshaper(Function function = NULL, float range = 8.0f, int size = 8192)
+    : iSize(jmax(2, size)), table(iSize + 2), fRange(range), fScale(iSize / (2.0f * range)) {
+        setFunction(function);
+    }
+
+    // rebuilds the table (no function gives a straight line)
+    void setFunction(Function function){
+        for(int i = 0; i <= iSize; i++){
+            const float x = -fRange + (2.0f * fRange * i) / iSize;
+            table[i] = function ? function(x) : x;
+        }
+        table[iSize + 1] = table[iSize]; // (so the last point can interpolate)
+    }
+
+    // true if the curve is odd (f(-x) == -f(x)), so it adds no DC offset
+    bool isSymmetric() const {
+        for(int i = 0; i <= iSize / 2; i++){
+            if(fabsf(table[i] + table[iSize - i]) > 1.0e-4f)
+                return false;
+        }
+        return true;
+    }
+
+    float tick(float x){
+        float pos = (x + fRange) * fScale;
+        pos = pos > 0.0f ? (pos < iSize ? pos : iSize) : 0.0f;
+        const int i = (int)pos;
+        return table[i] + (pos - i) * (table[i + 1] - table[i]);
+    }
+
+    // shapes a block of samples in place
+    void process(float* samples, int numSamples){
+        const float* t = &table[0];
+        const float last = (float)iSize;
+        for(int s = 0; s < numSamples; s++){
+            float pos = (samples[s] + fRange) * fScale;
+            pos = pos > 0.0f ? (pos < last ? pos : last) : 0.0f;
+            const int i = (int)pos;
+            samples[s] = t[i] + (pos - i) * (t[i + 1] - t[i]);
+        }
+    }
+
+private:
+    int iSize;
+    std::vector<float> table;
+    float fRange, fScale;
+};
+
 class Wavetable : public stk::FileLoop {
 public:
     Wavetable() : FileLoop(), fBaseFrequency(261.626) {}
     
     void openResource(std::string filename){
-        CFBundleRef plugBundle = CFBundleGetBundleWithIdentifier(CFSTR("com.UWE.TestSynthAU"));
-        CFURLRef resourcesURL = CFBundleCopyResourcesDirectoryURL(plugBundle);
-        char path[PATH_MAX];
-        CFURLGetFileSystemRepresentation(resourcesURL, TRUE, (UInt8 *)path, PATH_MAX);
-        CFRelease(resourcesURL);
-        
-        openFile(std::string(path) + "/" + filename);
+        openFile(getResourcePath() + "/" + filename);
         normalize();
     }
         
@@ -495,7 +934,8 @@ class Voice  : public SynthesiserVoice
 {
 public:
     Voice()
-    :   tailOff (0.0), bSilent (true), pParameters(NULL), pSynth(NULL)
+    :   fReleaseTime (kDefaultReleaseTime), iStartOffset (0), iStopOffset (-1), iRenderStart (0), bJustStarted (false),
+        bJustStopped (false), bSilent (true), pParameters(NULL), pSynth(NULL), ppBusTarget (NULL), scratch (2, 4096), fadeGains (1, 4096)
     {
     }
     
@@ -504,6 +944,10 @@ public:
     void setSynthesiser(MySynth* synth) { pSynth = synth; }
     MySynth* getSynthesiser() { return pSynth; }
     
+    // Redirects the voice's bus output (e.g. to a render worker's private buses);
+    // NULL restores the synth's own submixes.
+    void setBusTarget(float** buses){ ppBusTarget = buses; }
+    
     void setParameters(IPluginParameters* parameters){ pParameters = parameters; }
     float getParameter(int index){ return pParameters->getParameter(index); }
     void setParameter(int index, float value){ pParameters->setParameter(index, value); }
@@ -517,37 +961,80 @@ public:
                             SynthesiserSound* /*sound*/, const int /*currentPitchWheelPosition*/)
     {
         level = 1.0;//velocity * 0.5;
-        tailOff = 0.0;
+        fade.set(Envelope::Points(0.0f, 1.0f), BlockEnvelope::kExponential, getSampleRate());
+        iStartOffset = 0;
+        iStopOffset = -1;
+        bJustStopped = false;
         
         onStartNote(midiNoteNumber, velocity);
         bSilent = false;
+        bJustStarted = true;
+    }
+    
+    // Called by the synth after each note-on with the event's position in the current
+    // block - a voice that has just been started will begin rendering at that offset.
+    void setStartOffset(int offset)
+    {
+        if(bJustStarted){
+            iStartOffset = offset;
+            bJustStarted = false;
+            onStartOffset(offset);
+        }
     }
     
+    // Called by the synth after each note-off with the event's position in the
+    // current block - a voice that has just been stopped starts its release there.
+    void setStopOffset(int offset)
+    {
+        if(bJustStopped){
+            bJustStopped = false;
+            if(iStopOffset == 0)
+                iStopOffset = offset;
+            onStopOffset(offset);
+        }
+    }
+    
+    // Ends the note at once, freeing the voice (e.g. when its sound has finished
+    // playing somewhere other than process()).
+    void finishNote()
+    {
+        clearCurrentNote();
+        iStopOffset = -1;
+        bSilent = true;
+    }
+    
+    // how long the voice takes to fade out after a note-off (in ms)
+    void setReleaseTime(float ms) { fReleaseTime = jmax(0.0f, ms); }
+    float getReleaseTime() const { return fReleaseTime; }
+    
     virtual void onStartNote(const int midiNoteNumber, const float velocity) = 0;
+    virtual void onStartOffset(const int offset) {}
     
     virtual void stopNote (const bool allowTailOff)
     {
         if(!onStopNote()){
             // do not kill note
         }else if (allowTailOff){
-            // start a tail-off by setting this flag. The render callback will pick up on
-            // this and do a fade out, calling clearCurrentNote() when it's finished.
+            // schedule a release: the render callback fades out from the note-off's
+            // position in the block (see setStopOffset()), and calls clearCurrentNote()
+            // the moment the fade reaches zero.
             
-            if (tailOff == 0.0) // we only need to begin a tail-off if it's not already doing so - the
-                // stopNote method could be called more than once.
-                tailOff = 1.0;
+            if (iStopOffset < 0 && !fade.isReleasing()) // stopNote may be called more than once
+                iStopOffset = 0;
         }
         else
         {
             // we're being told to stop playing immediately, so reset everything..
             clearCurrentNote();
+            iStopOffset = -1;
             bSilent = true;
         }
         
-
+        bJustStopped = true;
     }
     
     virtual bool onStopNote() = 0;
+    virtual void onStopOffset(const int offset) {}
     
     virtual void onPitchWheel(const int value) {}
     virtual void pitchWheelMoved (const int newValue)
@@ -559,66 +1046,97 @@ public:
     
     virtual void renderNextBlock (AudioSampleBuffer& outputBuffer, int startSample, int numSamples)
     {
-        const int numChannels = outputBuffer.getNumChannels() < 2 ? 2 : outputBuffer.getNumChannels();
-        const int bufferSize = numSamples;
+        // a note started part way through the block only renders from its offset
+        if (iStartOffset > 0)
+        {
+            const int skip = jmin(iStartOffset, numSamples);
+            startSample += skip;
+            numSamples -= skip;
+            iStartOffset -= skip;
+            if (iStopOffset > 0)
+                iStopOffset = jmax(0, iStopOffset - skip);
+        }
         
-        if (!bSilent)
+        if (!bSilent && numSamples > 0)
         {
-            float** pBuffer = new float*[numChannels];
-            float** pSample = new float*[numChannels];
-            for(int c=0; c<numChannels; c++){
-                pBuffer[c] = new float[numSamples];
-                memset(pBuffer[c], 0, sizeof(float) * numSamples);
-                pSample[c] = pBuffer[c];
-            }
+            const int numChannels = outputBuffer.getNumChannels() < 2 ? 2 : outputBuffer.getNumChannels();
+            
+            // reuses the voice's own buffer (only reallocated if the block grows)
+            scratch.setSize(numChannels, numSamples, false, false, true);
+            scratch.clear(0, numSamples);
+            float** pBuffer = scratch.getArrayOfChannels();
             
-            if(!process(pSample, numChannels, numSamples))
+            iRenderStart = startSample;
+            if(!process(pBuffer, numChannels, numSamples))
             {
                 clearCurrentNote();
-                tailOff = 0.0f;
+                iStopOffset = -1;
                 bSilent = true;
             }
             
-            if (tailOff > 0)
+            if (iStopOffset >= 0 || fade.isReleasing())
             {
-                while (--numSamples >= 0)
+                // the release, as a ramp of gains applied to every channel
+                fadeGains.setSize(1, numSamples, false, false, true);
+                float* pGains = fadeGains.getSampleData(0);
+                
+                const int hold = iStopOffset > 0 ? jmin(iStopOffset, numSamples) : 0;
+                fade.process(pGains, hold);
+                if (iStopOffset >= 0 && hold < numSamples)
                 {
-                    for(int c=0; c<numChannels; c++)
-                        *pSample[c]++ *= level * tailOff;
-                    
-                    tailOff *= 0.99;
-                    if (!bSilent && tailOff <= 0.005)
-                    {
-                        clearCurrentNote();
-                        tailOff = 0.0f;
-                        bSilent = true;
-                    }
+                    fade.release(fReleaseTime * 0.001f);
+                    iStopOffset = -1;
+                }
+                else if (iStopOffset > 0)
+                {
+                    iStopOffset -= hold;
+                }
+                fade.process(pGains + hold, numSamples - hold);
+                
+                FloatVectorOperations::multiply(pGains, (float)level, numSamples);
+                for(int c=0; c<numChannels; c++)
+                    FloatVectorOperations::multiply(pBuffer[c], pGains, numSamples);
+                
+                if (fade.isOff())
+                {
+                    clearCurrentNote();
+                    bSilent = true;
                 }
             }
             else
             {
-                while (--numSamples >= 0)
-                {
-                    for(int c=0; c<numChannels; c++)
-                        *pSample[c]++ *= level;
-                }
+                scratch.applyGain(0, numSamples, level);
             }
             
             for(int c=0; c< outputBuffer.getNumChannels(); c++)
-                outputBuffer.addFrom(c, startSample, pBuffer[c], bufferSize);
+                outputBuffer.addFrom(c, startSample, pBuffer[c], numSamples);
         }
     }
     
     virtual bool process (float** outputBuffer, int numChannels, int numSamples) = 0;
     
 protected:
-    double level, tailOff;
+    // position in the host block that the current process() call starts at
+    int getRenderStart() const { return iRenderStart; }
+    // the buses process() should mix into (the synth's, unless redirected)
+    float** getBusTarget(float** synthBuses) const { return ppBusTarget ? ppBusTarget : synthBuses; }
+    
+    double level;
     
 private:
+    enum { kDefaultReleaseTime = 12 };  // ms (about what the old per-sample tail-off took)
+    
+    BlockEnvelope fade;
+    float fReleaseTime;
+    int iStartOffset, iStopOffset, iRenderStart;    // (iStopOffset is -1 with no release pending)
+    bool bJustStarted, bJustStopped;
     bool bSilent;
     IPluginParameters *pParameters;
     
     MySynth* pSynth;
+    float** ppBusTarget;
+    
+    AudioSampleBuffer scratch, fadeGains;
 };
 
 #endif
@@ -0,0 +1,165 @@
+//
+//  RealtimeGuard.h
+//  TestSynthAU
+//
+//  A debug check for real-time safety. The audio thread (and the render workers)
+//  mark themselves real-time while they render, and anything that may block on
+//  those threads - heap allocation, locking a GuardedCriticalSection, or anything
+//  else the engine wraps in an explicit check() - is reported while the mark is set:
+//  counted, and logged with its call site (or a backtrace, for allocations).
+//  Compiled in with REALTIME_GUARD, which defaults on in debug builds; in release
+//  builds it all compiles away.
+//
+//  Allocations are caught by the global operator new / delete hooks in
+//  RealtimeGuardHooks.h, which only the test and soak executables include - so in
+//  the plugin itself they aren't checked.
+//
+
+#ifndef __RealtimeGuard_h__
+#define __RealtimeGuard_h__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#ifndef REALTIME_GUARD
+ #if JUCE_DEBUG
+  #define REALTIME_GUARD 1
+ #else
+  #define REALTIME_GUARD 0
+ #endif
+#endif
+
+#if JUCE_MSVC
+ #define REALTIME_GUARD_THREAD_LOCAL __declspec(thread)
+#else
+ #define REALTIME_GUARD_THREAD_LOCAL __thread
+#endif
+
+class RealtimeGuard
+{
+public:
+    //==============================================================================
+    /** Marks the calling thread real-time for as long as the Scope exists. */
+    class Scope
+    {
+    public:
+        Scope() : bWasActive (setActive (true)) {}
+        ~Scope() { setActive (bWasActive); }
+
+    private:
+        const bool bWasActive;
+        JUCE_DECLARE_NON_COPYABLE (Scope)
+    };
+
+    /** Lets the calling thread do something unsafe deliberately (e.g. the report). */
+    class Exemption
+    {
+    public:
+        Exemption() : bWasActive (setActive (false)) {}
+        ~Exemption() { setActive (bWasActive); }
+
+    private:
+        const bool bWasActive;
+        JUCE_DECLARE_NON_COPYABLE (Exemption)
+    };
+
+    //==============================================================================
+    static bool isActive()
+    {
+       #if REALTIME_GUARD
+        return getFlag();
+       #else
+        return false;
+       #endif
+    }
+
+    // Reports what the calling thread is doing, if it's real-time. Only the first
+    // kMaxReports violations are logged, but every one is counted.
+    static void check (const char* what, const char* file = nullptr, int line = 0)
+    {
+       #if REALTIME_GUARD
+        if(!getFlag())
+            return;
+
+        const Exemption exempt;
+        if(++getCount() > kMaxReports)
+            return;
+
+        String message ("Real-time violation: ");
+        message << what;
+        if(file != nullptr)
+            message << " at " << File::createFileWithoutCheckingPath (file).getFileName() << ":" << line;
+        if(Thread* pThread = Thread::getCurrentThread())
+            message << " on " << pThread->getThreadName();
+        Logger::writeToLog (message);
+
+        if(file == nullptr)
+            Logger::writeToLog (SystemStats::getStackBacktrace());
+       #else
+        (void) what; (void) file; (void) line;
+       #endif
+    }
+
+    // violations since the last reset (e.g. around a rendered test pattern)
+    static int getNumViolations()
+    {
+       #if REALTIME_GUARD
+        return getCount().get();
+       #else
+        return 0;
+       #endif
+    }
+
+    static void resetViolations()
+    {
+       #if REALTIME_GUARD
+        getCount() = 0;
+       #endif
+    }
+
+private:
+    enum { kMaxReports = 50 };
+
+    // sets the calling thread's mark, returning what it was
+    static bool setActive (bool bActive)
+    {
+       #if REALTIME_GUARD
+        const bool bWasActive = getFlag();
+        getFlag() = bActive;
+        return bWasActive;
+       #else
+        return bActive;
+       #endif
+    }
+
+   #if REALTIME_GUARD
+    static bool& getFlag()
+    {
+        static REALTIME_GUARD_THREAD_LOCAL bool bRealtime = false;
+        return bRealtime;
+    }
+
+    static Atomic<int>& getCount()
+    {
+        static Atomic<int> count;
+        return count;
+    }
+   #endif
+};
+
+//==============================================================================
+/** A CriticalSection that reports being locked on a real-time thread. (Lock it
+    with its own ScopedLockType - JUCE's ScopedLock would skip the check.)      */
+class GuardedCriticalSection : public CriticalSection
+{
+public:
+    void enter() const noexcept
+    {
+        RealtimeGuard::check ("CriticalSection::enter()");
+        CriticalSection::enter();
+    }
+
+    typedef GenericScopedLock<GuardedCriticalSection> ScopedLockType;
+    typedef GenericScopedUnlock<GuardedCriticalSection> ScopedUnlockType;
+};
+
+#endif
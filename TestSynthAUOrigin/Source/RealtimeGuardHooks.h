@@ -0,0 +1,68 @@
+//
+//  RealtimeGuardHooks.h
+//  TestSynthAU
+//
+//  The RealtimeGuard's heap hooks: global operator new / delete replacements that
+//  report allocating or freeing on a real-time thread (with a backtrace), then go
+//  ahead as normal. Replacing the global operators replaces them for the whole
+//  process - a plugin's would take over its host's allocator too - so they're kept
+//  out of the plugin. Only the test and soak executables carry them: include this in
+//  exactly one source file of each (it defines the operators, rather than declaring
+//  them).
+//
+
+#ifndef __RealtimeGuardHooks_h__
+#define __RealtimeGuardHooks_h__
+
+#include "RealtimeGuard.h"
+
+#if REALTIME_GUARD
+void* operator new (size_t size)
+{
+    RealtimeGuard::check ("operator new");
+    if(void* p = malloc (size > 0 ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[] (size_t size)
+{
+    RealtimeGuard::check ("operator new[]");
+    if(void* p = malloc (size > 0 ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new (size_t size, const std::nothrow_t&) noexcept
+{
+    RealtimeGuard::check ("operator new");
+    return malloc (size > 0 ? size : 1);
+}
+
+void* operator new[] (size_t size, const std::nothrow_t&) noexcept
+{
+    RealtimeGuard::check ("operator new[]");
+    return malloc (size > 0 ? size : 1);
+}
+
+void operator delete (void* p) noexcept
+{
+    if(p != nullptr){
+        RealtimeGuard::check ("operator delete");
+        free (p);
+    }
+}
+
+void operator delete[] (void* p) noexcept
+{
+    if(p != nullptr){
+        RealtimeGuard::check ("operator delete[]");
+        free (p);
+    }
+}
+
+void operator delete (void* p, const std::nothrow_t&) noexcept { operator delete (p); }
+void operator delete[] (void* p, const std::nothrow_t&) noexcept { operator delete[] (p); }
+#endif
+
+#endif
@@ -0,0 +1,577 @@
+//
+//  RenderTests.cpp
+//  TestSynthAU
+//
+//  Golden-output regression tests. Reference MIDI patterns are rendered through the
+//  PluginAudioProcessor in its deterministic mode (each at its own sample rate, and
+//  from its own state, if it has one) and compared, channel by channel,
+//  with renders kept from before (one 32-bit float WAV per pattern, in the golden
+//  folder - Tests/Golden in the repository: the stereo mix in channels 0-1, then the
+//  19 mic buses). A change to the
+//  render path that's meant to leave the sound alone should keep every channel
+//  within its threshold. A stem export (see StemExport.h), cut into segments, is
+//  held to the same thresholds against a render of the whole pattern - with the
+//  default settings, and with a state that changes each of them. In debug
+//  builds, every render must also get through without a RealtimeGuard violation
+//  on its real-time threads. The kit is also packed (see KitFile.h) and read
+//  back against its WAVs. Compiled in
+//  with TESTSYNTHAU_UNIT_TESTS - see Tools/RenderTests, which runs them (and can
+//  rewrite the golden files).
+//
+
+#include "PluginProcessor.h"
+#include "StemExport.h"
+#include "SynthPlugin.h"
+
+#if TESTSYNTHAU_UNIT_TESTS
+
+//==============================================================================
+namespace RenderTestPatterns
+{
+    struct Event
+    {
+        double beat;        // at 120bpm (a beat is half a second)
+        int note;
+        int velocity;       // 0 for a note-off
+    };
+
+    struct Pattern
+    {
+        const char* name;
+        const Event* events;
+        int numEvents;
+        double lengthInBeats;   // including the tail
+        double sampleRate;
+        void (*setUp) (XmlElement& state);  // writes the state to render with (or nullptr)
+    };
+
+    // kick, snare and closed hats, with a sizzle and an open hat choked by the next
+    static const Event groove[] = {
+        { 0.0, 48, 120 }, { 0.0, 54, 90 }, { 0.5, 54, 60 }, { 1.0, 50, 110 }, { 1.0, 54, 90 },
+        { 1.5, 54, 60 }, { 1.75, 48, 70 }, { 2.0, 48, 120 }, { 2.0, 56, 90 }, { 2.5, 58, 80 },
+        { 3.0, 50, 127 }, { 3.0, 54, 100 }, { 3.25, 50, 40 }, { 3.5, 58, 95 }, { 3.75, 54, 70 }
+    };
+
+    // a tom fill into a crash, then the ride and its bell
+    static const Event fill[] = {
+        { 0.0, 57, 100 }, { 0.25, 57, 80 }, { 0.5, 55, 100 }, { 0.75, 55, 80 }, { 1.0, 53, 110 },
+        { 1.25, 53, 90 }, { 1.5, 50, 120 }, { 1.75, 50, 60 }, { 2.0, 48, 127 }, { 2.0, 60, 120 },
+        { 2.5, 63, 90 }, { 3.0, 63, 70 }, { 3.25, 65, 100 }, { 3.5, 66, 110 }
+    };
+
+    // hits a few samples apart, more than there are voices, with note-offs between -
+    // start offsets, stealing and chokes all at once
+    static const Event flurry[] = {
+        { 0.0, 48, 127 }, { 0.0001, 50, 127 }, { 0.0002, 58, 127 }, { 0.0003, 57, 127 },
+        { 0.0005, 55, 100 }, { 0.0008, 53, 100 }, { 0.001, 54, 90 }, { 0.0013, 60, 120 },
+        { 0.002, 48, 0 }, { 0.002, 63, 110 }, { 0.0021, 65, 90 }, { 0.0025, 66, 100 },
+        { 0.1, 48, 30 }, { 0.1, 50, 30 }, { 0.1, 56, 50 }, { 0.1, 58, 60 }, { 0.1, 57, 20 },
+        { 0.1, 55, 20 }, { 0.1, 53, 20 }, { 0.1, 60, 20 }, { 0.1, 63, 20 }, { 0.1, 65, 20 },
+        { 0.1, 66, 20 }, { 0.1003, 48, 90 }, { 0.1003, 50, 90 }, { 0.1003, 54, 90 },
+        { 0.25, 48, 100 }, { 0.25, 50, 100 }, { 0.25, 57, 100 }, { 0.25, 55, 100 },
+        { 0.25, 53, 100 }, { 0.25, 60, 100 }, { 0.25, 63, 100 }, { 0.25, 65, 100 },
+        { 0.25, 66, 100 }, { 0.25, 58, 100 }, { 0.3, 54, 110 }
+    };
+
+    // A room to load: half a second of decaying stereo noise, always the same,
+    // written once per run to a file of its own (with a shared name, two runs at once
+    // could overwrite each other's room while it's loading).
+    static File getRoomImpulse()
+    {
+        static const TemporaryFile room (".wav");
+        const File& file = room.getFile();
+        if (file.existsAsFile())
+            return file;
+
+        const int length = 22050;
+        AudioSampleBuffer impulse (2, length);
+        Random random (1);
+        for (int c = 0; c < 2; ++c)
+            for (int s = 0; s < length; ++s)
+                *impulse.getSampleData (c, s) = (random.nextFloat() * 2.0f - 1.0f) * 0.2f * expf (-8.0f * s / length);
+
+        WavAudioFormat wav;
+        ScopedPointer<AudioFormatWriter> writer (wav.createWriterFor (new FileOutputStream (file), 44100.0, 2, 32, StringPairArray(), 0));
+        if (writer != nullptr)
+            writer->writeFromAudioSampleBuffer (impulse, 0, length);
+        return file;
+    }
+
+    // Every setting away from its default: the drums retuned with a longer choke, and
+    // the mix processing on a few buses, with a room. (Written out rather than made by
+    // MySynth::saveSettings(), so a setting the state leaves out shows up as a stem
+    // export that doesn't match.)
+    static void setUpProcessed (XmlElement& state)
+    {
+        // (parameters go by their names - see PluginAudioProcessor::getStateInformation())
+        state.setAttribute ("KickTune", 2.0);
+        state.setAttribute ("SnareTune", -1.5);
+
+        const String synth =
+            "<SYNTH>"
+            "  <EQ>"
+            "    <BAND bus='2' band='2' frequency='400' gain='-4' q='1.5'/>"
+            "    <BAND bus='2' band='4' frequency='6000' gain='5' q='0.7071'/>"
+            "    <BAND bus='8' band='0' frequency='200' gain='0' q='0.7071'/>"
+            "  </EQ>"
+            "  <DYNAMICS lookahead='1'>"
+            "    <BUS index='0' threshold='-24' ratio='4' attack='2' release='80' makeup='4'/>"
+            "    <BUS index='3' transientAttack='0.5' transientSustain='-0.3'/>"
+            "  </DYNAMICS>"
+            "  <DRIVE curve='Cubic' oversampling='4'>"
+            "    <BUS index='1' drive='12' output='-6' mix='0.7'/>"
+            "  </DRIVE>"
+            "  <MASTERDRIVE curve='Tube' oversampling='4'>"
+            "    <BUS index='0' drive='3' output='-1' mix='0.5'/>"
+            "    <BUS index='1' drive='3' output='-1' mix='0.5'/>"
+            "  </MASTERDRIVE>"
+            "  <REVERB return='0.8'>"
+            "    <SEND bus='2' level='0.4'/>"
+            "    <SEND bus='10' level='0.6'/>"
+            "  </REVERB>"
+            "  <DRUMS chokeTime='40'>"
+            "    <NOTE note='50' release='120' chokeGroup='0'/>"
+            "    <NOTE note='54' release='0' chokeGroup='1'/>"
+            "    <NOTE note='56' release='0' chokeGroup='1'/>"
+            "    <NOTE note='58' release='0' chokeGroup='1'/>"
+            "  </DRUMS>"
+            "</SYNTH>";
+
+        XmlElement* pSynth = XmlDocument::parse (synth);
+        pSynth->getChildByName ("REVERB")->setAttribute ("impulse", getRoomImpulse().getFullPathName());
+        state.addChildElement (pSynth);
+    }
+
+    static const Pattern patterns[] = {
+        { "Groove", groove, numElementsInArray (groove), 5.0, 44100.0, nullptr },
+        { "Fill", fill, numElementsInArray (fill), 5.0, 44100.0, nullptr },
+        { "Flurry", flurry, numElementsInArray (flurry), 2.0, 44100.0, nullptr },
+        // (the kit resampled to the host's rate)
+        { "Flurry at 48k", flurry, numElementsInArray (flurry), 2.0, 48000.0, nullptr },
+        { "Processed groove", groove, numElementsInArray (groove), 5.0, 44100.0, setUpProcessed }
+    };
+    static const Pattern& processedGroove = patterns[4];
+
+    // (for copyXmlToBinary(), which AudioProcessor keeps to its subclasses)
+    class StateWriter  : public PluginAudioProcessor
+    {
+    public:
+        static void write (const XmlElement& xml, MemoryBlock& data) { copyXmlToBinary (xml, data); }
+    };
+
+    // gives the processor the pattern's state, if it has one
+    static void setUp (PluginAudioProcessor& processor, const Pattern& pattern)
+    {
+        if (pattern.setUp == nullptr)
+            return;
+
+        XmlElement state ("MYPLUGINSETTINGS");
+        pattern.setUp (state);
+        MemoryBlock data;
+        StateWriter::write (state, data);
+        processor.setStateInformation (data.getData(), (int) data.getSize());
+    }
+}
+
+//==============================================================================
+static File goldenFolder;
+static bool bRewriteGolden = false;
+
+// Called by Tools/RenderTests: where the golden WAVs are, and whether to write them
+// from this build's renders rather than test against them.
+void setGoldenRenderOptions (const File& folder, bool rewrite)
+{
+    goldenFolder = folder;
+    bRewriteGolden = rewrite;
+}
+
+//==============================================================================
+class GoldenRenderTests  : public UnitTest
+{
+public:
+    GoldenRenderTests() : UnitTest ("GoldenRenderTests") {}
+
+    void runTest()
+    {
+        const File folder (goldenFolder != File::nonexistent ? goldenFolder
+                                                             : File::getCurrentWorkingDirectory().getChildFile ("Tests/Golden"));
+
+        for (int p = 0; p < numElementsInArray (RenderTestPatterns::patterns); ++p)
+        {
+            const RenderTestPatterns::Pattern& pattern = RenderTestPatterns::patterns[p];
+            beginTest (pattern.name);
+
+            // the same stream in differently sized (and ragged) blocks
+            AudioSampleBuffer render (1, 1), other (1, 1);
+            renderPattern (pattern, 512, render);
+            renderPattern (pattern, 37, other);
+            expect (isIdentical (render, other), "the render depends on the block size");
+
+            const File file (folder.getChildFile (String (pattern.name) + ".wav"));
+            if (bRewriteGolden)
+            {
+                expect (writeWav (file, render, pattern.sampleRate), "can't write " + file.getFullPathName());
+                continue;
+            }
+
+            AudioSampleBuffer golden (1, 1);
+            if (! readWav (file, golden))
+            {
+                expect (false, "no golden render in " + file.getFullPathName());
+                continue;
+            }
+
+            expectEquals (golden.getNumChannels(), render.getNumChannels());
+            expectEquals (golden.getNumSamples(), render.getNumSamples());
+            if (golden.getNumChannels() != render.getNumChannels() || golden.getNumSamples() != render.getNumSamples())
+                continue;
+
+            for (int c = 0; c < render.getNumChannels(); ++c)
+            {
+                const float error = getMaxError (render, golden, c);
+                const float threshold = Decibels::decibelsToGain (getThreshold (c));
+                expect (error <= threshold, getChannelName (c) + " is off by "
+                                              + String (Decibels::gainToDecibels (error), 1) + "dB");
+            }
+        }
+        
+        testStemExport (RenderTestPatterns::patterns[0]);
+        testStemExport (RenderTestPatterns::processedGroove);
+    }
+
+private:
+    enum { kSeed = 1 };
+
+    // Renders a pattern in blocks of blockSize samples - the mix into channels 0-1 of
+    // output, and the buses into the rest - expecting no real-time violations.
+    void renderPattern (const RenderTestPatterns::Pattern& pattern, int blockSize, AudioSampleBuffer& output)
+    {
+        PluginAudioProcessor processor;
+        RenderTestPatterns::setUp (processor, pattern);
+        processor.setPlayConfigDetails (0, 2, pattern.sampleRate, blockSize);
+        processor.setDeterministic (true, kSeed);
+        processor.prepareToPlay (pattern.sampleRate, blockSize);
+        expect (processor.waitUntilReady(), "the room impulse didn't load");
+
+        const int numSamples = getSampleForBeat (pattern.lengthInBeats, pattern.sampleRate);
+        const int numBuses = processor.getNumBuses();
+        output.setSize (2 + numBuses, numSamples);
+        output.clear();
+
+        AudioSampleBuffer buses (jmax (1, numBuses), numSamples);
+        buses.clear();
+        processor.setBusCapture (&buses);
+
+        AudioSampleBuffer block (2, blockSize);
+        MidiBuffer midi;
+        RealtimeGuard::resetViolations();
+
+        for (int start = 0; start < numSamples; start += blockSize)
+        {
+            const int n = jmin (blockSize, numSamples - start);
+
+            midi.clear();
+            for (int e = 0; e < pattern.numEvents; ++e)
+            {
+                const RenderTestPatterns::Event& event = pattern.events[e];
+                const int position = getSampleForBeat (event.beat, pattern.sampleRate);
+                if (position >= start && position < start + n)
+                    midi.addEvent (event.velocity > 0 ? MidiMessage::noteOn (1, event.note, (uint8) event.velocity)
+                                                      : MidiMessage::noteOff (1, event.note),
+                                   position - start);
+            }
+
+            AudioSampleBuffer slice (block.getArrayOfChannels(), 2, n);
+            slice.clear();
+            processor.processBlock (slice, midi);
+
+            for (int c = 0; c < 2; ++c)
+                output.copyFrom (c, start, slice, c, 0, n);
+        }
+
+        expectEquals (RealtimeGuard::getNumViolations(), 0, "real-time violations rendering in blocks of " + String (blockSize));
+
+        processor.setBusCapture (NULL);
+        processor.releaseResources();
+
+        for (int b = 0; b < numBuses; ++b)
+            output.copyFrom (2 + b, 0, buses, b, 0, numSamples);
+    }
+
+    static int getSampleForBeat (double beat, double sampleRate) { return roundToInt (beat * 0.5 * sampleRate); }
+    
+    // Exports the pattern in short segments (each with a pre-roll back to the start,
+    // so nothing's cut) and checks every stem against a render of the whole pattern.
+    void testStemExport (const RenderTestPatterns::Pattern& pattern)
+    {
+        beginTest (String ("Stem export of ") + pattern.name);
+        
+        AudioSampleBuffer render (1, 1);
+        renderPattern (pattern, 512, render);
+        
+        MidiMessageSequence sequence;
+        double lastEvent = 0.0;
+        for (int e = 0; e < pattern.numEvents; ++e)
+        {
+            const RenderTestPatterns::Event& event = pattern.events[e];
+            const double time = getSampleForBeat (event.beat, pattern.sampleRate) / pattern.sampleRate;
+            sequence.addEvent (event.velocity > 0 ? MidiMessage::noteOn (1, event.note, (uint8) event.velocity)
+                                                  : MidiMessage::noteOff (1, event.note), time);
+            lastEvent = jmax (lastEvent, time);
+        }
+        
+        StemExportOptions options;
+        options.bitsPerSample = 32;
+        options.tailSeconds = render.getNumSamples() / pattern.sampleRate - lastEvent;
+        options.segmentSeconds = 0.3;
+        options.preRollSeconds = pattern.lengthInBeats * 0.5;
+        options.numRenderThreads = 3;
+        options.seed = kSeed;
+        
+        // (a randomly named folder, so runs at the same time don't share one)
+        const TemporaryFile stems;
+        const File& folder = stems.getFile();
+        PluginAudioProcessor processor;
+        RenderTestPatterns::setUp (processor, pattern);
+        processor.setPlayConfigDetails (0, 2, pattern.sampleRate, 512);   // (the rate the stems are exported at)
+        RealtimeGuard::resetViolations();
+        const Result result (processor.exportStems (sequence, folder, options));
+        expect (result.wasOk(), result.getErrorMessage());
+        expectEquals (RealtimeGuard::getNumViolations(), 0, "real-time violations exporting the stems");
+        
+        for (int f = 0; result.wasOk() && f <= processor.getNumBuses(); ++f)
+        {
+            const String name (f == 0 ? String ("Mix") : processor.getBusName (f - 1));
+            AudioSampleBuffer stem (1, 1);
+            if (! readWav (folder.getChildFile (name + ".wav"), stem))
+            {
+                expect (false, "no stem for " + name);
+                continue;
+            }
+            
+            for (int c = 0; c < stem.getNumChannels(); ++c)
+            {
+                const int channel = f == 0 ? c : f + 1;
+                const float error = getMaxError (render, channel, stem, c, jmin (render.getNumSamples(), stem.getNumSamples()));
+                expect (error <= Decibels::decibelsToGain (getThreshold (channel)), "the " + name + " stem is off by "
+                                                                                     + String (Decibels::gainToDecibels (error), 1) + "dB");
+            }
+        }
+        
+        folder.deleteRecursively();
+    }
+
+    static bool isIdentical (const AudioSampleBuffer& a, const AudioSampleBuffer& b)
+    {
+        if (a.getNumChannels() != b.getNumChannels() || a.getNumSamples() != b.getNumSamples())
+            return false;
+
+        for (int c = 0; c < a.getNumChannels(); ++c)
+        {
+            if (memcmp (a.getSampleData (c), b.getSampleData (c), sizeof (float) * (size_t) a.getNumSamples()) != 0)
+                return false;
+        }
+        return true;
+    }
+
+    static float getMaxError (const AudioSampleBuffer& a, const AudioSampleBuffer& b, int channel)
+    {
+        return getMaxError (a, channel, b, channel, a.getNumSamples());
+    }
+    
+    static float getMaxError (const AudioSampleBuffer& a, int channelA, const AudioSampleBuffer& b, int channelB, int numSamples)
+    {
+        const float* pA = a.getSampleData (channelA);
+        const float* pB = b.getSampleData (channelB);
+        float error = 0.0f;
+        for (int s = 0; s < numSamples; ++s)
+            error = jmax (error, std::abs (pA[s] - pB[s]));
+        return error;
+    }
+
+    // The worst error (in dB) each channel may have. The mix sums every bus (and the
+    // master drive), so it's allowed a little more than a single bus.
+    static float getThreshold (int channel)
+    {
+        return channel < 2 ? -90.0f : -96.0f;
+    }
+
+    static String getChannelName (int channel)
+    {
+        if (channel < 2)
+            return channel == 0 ? "Mix L" : "Mix R";
+        return "Bus " + String (channel - 2);
+    }
+
+    //==============================================================================
+    static bool writeWav (const File& file, const AudioSampleBuffer& buffer, double sampleRate)
+    {
+        file.getParentDirectory().createDirectory();
+        file.deleteFile();
+
+        WavAudioFormat wav;
+        ScopedPointer<AudioFormatWriter> writer (wav.createWriterFor (new FileOutputStream (file), sampleRate,
+                                                                      (unsigned int) buffer.getNumChannels(), 32,
+                                                                      StringPairArray(), 0));
+        return writer != nullptr && writer->writeFromAudioSampleBuffer (buffer, 0, buffer.getNumSamples());
+    }
+
+    // (every channel - AudioFormatReader's own AudioSampleBuffer read only takes two)
+    static bool readWav (const File& file, AudioSampleBuffer& buffer)
+    {
+        if (! file.existsAsFile())
+            return false;
+
+        WavAudioFormat wav;
+        ScopedPointer<AudioFormatReader> reader (wav.createReaderFor (new FileInputStream (file), true));
+        if (reader == nullptr || ! reader->usesFloatingPointData)
+            return false;
+
+        buffer.setSize ((int) reader->numChannels, (int) reader->lengthInSamples);
+        HeapBlock<int*> channels ((size_t) reader->numChannels + 1, true);
+        for (int c = 0; c < (int) reader->numChannels; ++c)
+            channels[c] = reinterpret_cast<int*> (buffer.getSampleData (c));
+
+        return reader->read (channels, (int) reader->numChannels, 0, (int) reader->lengthInSamples, false);
+    }
+};
+
+static GoldenRenderTests goldenRenderTests;
+
+//==============================================================================
+class SynthStateTests  : public UnitTest
+{
+public:
+    SynthStateTests() : UnitTest ("SynthStateTests") {}
+
+    void runTest()
+    {
+        beginTest ("Drum tuning");
+        {
+            MySynth synth;
+            synth.setCurrentPlaybackSampleRate (44100.0);
+
+            // an octave up on the kick, on top of its 48kHz recording played at 44.1kHz
+            synth.setParameter (kParam24, 12.0f);
+            expectEquals (synth.getPlaybackRate (48, 48000.0), 2.0 * 48000.0 / 44100.0);
+            expectEquals (synth.getPlaybackRate (50, 48000.0), 48000.0 / 44100.0, "the snare isn't tuned");
+            expectEquals (synth.getPlaybackRate (47, 48000.0), 48000.0 / 44100.0, "a note without a drum");
+
+            synth.setParameter (kParam30, -5.0f);
+            expectEquals (synth.getTuningRate (66), pow (2.0, -5.0 / 12.0), "the splash is a cymbal");
+        }
+
+        beginTest ("Parameters kept in the state");
+        {
+            PluginAudioProcessor processor;
+            processor.setParameter (kParam16, 0.25f);   // (a pan, which has no name)
+            processor.setParameter (kParam24, 12.0f);
+            processor.setParameter (kParam30, -5.0f);
+
+            MemoryBlock state;
+            processor.getStateInformation (state);
+            PluginAudioProcessor loaded;
+            loaded.setStateInformation (state.getData(), (int) state.getSize());
+            expectEquals (loaded.getParameter (kParam16), 0.25f);
+            expectEquals (loaded.getParameter (kParam24), 12.0f);
+            expectEquals (loaded.getParameter (kParam25), 0.0f);
+            expectEquals (loaded.getParameter (kParam30), -5.0f);
+        }
+    }
+};
+
+static SynthStateTests synthStateTests;
+
+//==============================================================================
+class KitFileTests  : public UnitTest
+{
+public:
+    KitFileTests() : UnitTest ("KitFileTests") {}
+
+    void runTest()
+    {
+        beginTest ("Packing the kit and reading it back");
+
+        const File folder (getResourcePath());
+        TemporaryFile temp (KitFile::getDefaultFileName());
+        const int numPacked = KitFileWriter::write (folder, temp.getFile());
+        expect (numPacked > 0, "nothing packed from " + folder.getFullPathName());
+
+        const KitFile packed (temp.getFile());
+        expect (packed.isValid());
+        expectEquals (packed.getNumEntries(), numPacked);
+
+        // every recording the folder has is found, and nothing else
+        WavAudioFormat wav;
+        int numFound = 0;
+        for (int a = 0; a < KitLayout::kNumArticulations; ++a)
+        {
+            for (int m = 0; m < KitLayout::kNumCymbalMics; ++m)
+            {
+                for (int v = 0; v < KitLayout::kNumVelocities; ++v)
+                {
+                    for (int r = 0; r < KitLayout::kNumRoundRobins; ++r)
+                    {
+                        const KitFile::Entry* pEntry = packed.find (a, m, v, r);
+                        const File file (folder.getChildFile (KitLayout::getFileName (a, m, v, r)));
+                        if (m >= KitLayout::getNumMics (a) || ! file.existsAsFile())
+                        {
+                            expect (pEntry == NULL, "an entry without a WAV: " + KitLayout::getFileName (a, m, v, r));
+                            continue;
+                        }
+
+                        expect (pEntry != NULL, "not packed: " + file.getFileName());
+                        if (pEntry == NULL)
+                            continue;
+                        ++numFound;
+
+                        // the first recording of each articulation and mic is checked
+                        // sample for sample
+                        if (v == KitLayout::kNumVelocities - 1 && r == 0)
+                            expectSamplesMatch (*pEntry, packed.getSamples (*pEntry), wav, file);
+                    }
+                }
+            }
+        }
+        expectEquals (numFound, numPacked);
+
+        expect (packed.find (KitLayout::kNumArticulations, 0, 0, 0) == NULL);
+        expect (packed.find (0, 0, -1, 0) == NULL);
+    }
+
+private:
+    // the entry against the WAV it was packed from, mixed down to mono and normalised
+    void expectSamplesMatch (const KitFile::Entry& entry, const float* pSamples, WavAudioFormat& wav, const File& file)
+    {
+        ScopedPointer<AudioFormatReader> reader (wav.createReaderFor (new FileInputStream (file), true));
+        expect (reader != nullptr);
+        if (reader == nullptr)
+            return;
+
+        expectEquals ((int) entry.numChannels, 1);
+        expectEquals ((int) entry.numFrames, (int) reader->lengthInSamples);
+        expectEquals ((double) entry.sampleRate, reader->sampleRate);
+
+        const int numFrames = (int) reader->lengthInSamples;
+        const int numChannels = jmin (2, (int) reader->numChannels);
+        AudioSampleBuffer samples (numChannels, numFrames);
+        reader->read (&samples, 0, numFrames, 0, true, numChannels > 1);
+        if (numChannels > 1)
+        {
+            samples.applyGain (0, 0, numFrames, 0.5f);
+            samples.addFrom (0, 0, samples, 1, 0, numFrames, 0.5f);
+        }
+
+        const float peak = samples.getMagnitude (0, 0, numFrames);
+        expect (peak > 0.0f && std::abs (entry.peak - peak) <= 1.0e-6f * peak, "the peak of " + file.getFileName());
+
+        float worst = 0.0f;
+        for (int i = 0; i < numFrames; ++i)
+            worst = jmax (worst, std::abs (pSamples[i] - *samples.getSampleData (0, i) / peak));
+        expect (worst <= 1.0e-6f, file.getFileName() + " differs by " + String (worst));
+    }
+};
+
+static KitFileTests kitFileTests;
+
+#endif // TESTSYNTHAU_UNIT_TESTS
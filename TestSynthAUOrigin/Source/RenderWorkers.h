@@ -0,0 +1,202 @@
+//
+//  RenderWorkers.h
+//  TestSynthAU
+//
+//  A small pool of real-time worker threads, used to spread voice rendering across
+//  cores. The audio thread hands the pool a Job and a number of items; the items
+//  are split into one contiguous range per thread, each thread works through its
+//  own range and then steals from the back of the others' until none are left.
+//
+
+#ifndef __RenderWorkers_h__
+#define __RenderWorkers_h__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "RealtimeGuard.h"
+
+class RenderWorkerPool
+{
+public:
+    //==============================================================================
+    /** The work handed to the pool - renderItem() is called exactly once for each
+        item, on whichever thread claimed it. Worker 0 is always the calling (audio)
+        thread; workers 1 to getNumWorkers()-1 are the pool's own threads.         */
+    class Job
+    {
+    public:
+        virtual ~Job() {}
+
+        virtual void renderItem (int item, int worker) = 0;
+    };
+
+    //==============================================================================
+    // Creates (and starts) numThreads helper threads, in addition to the caller.
+    RenderWorkerPool (int numThreads)
+    :   pJob (nullptr)
+    {
+        for(int w=0; w<=numThreads; w++)
+            ranges.add(new Atomic<int64>());
+
+        for(int t=0; t<numThreads; t++){
+            Worker* pWorker = threads.add(new Worker(*this, t + 1));
+            pWorker->startThread(9);
+            // keep helpers off the first core, which the host's audio thread tends to use
+            if(SystemStats::getNumCpus() > t + 1)
+                pWorker->setAffinityMask(1u << (t + 1));
+        }
+    }
+
+    ~RenderWorkerPool()
+    {
+        for(int t=0; t<threads.size(); t++)
+            threads[t]->signalThreadShouldExit();
+        for(int t=0; t<threads.size(); t++)
+            threads[t]->stopThread(1000);
+    }
+
+    // number of threads that take part in a run (including the caller)
+    int getNumWorkers() const { return threads.size() + 1; }
+
+    //==============================================================================
+    // Renders numItems items of job across the pool, returning once they're all done.
+    // The pool is driven by a single owner (the synth, from the audio thread), which
+    // always passes the same job.
+    void run (Job& job, int numItems)
+    {
+        const int numWorkers = getNumWorkers();
+
+        // The job and count go out before the ranges: a helper still stealing at the
+        // end of the last run may take an item the moment its range is published, and
+        // its count must come off this run's total, not be overwritten by it.
+        pJob = &job;
+        remaining = numItems;
+
+        // deal out contiguous ranges, one per worker
+        for(int w=0; w<numWorkers; w++)
+            ranges.getUnchecked(w)->set(pack((numItems * w) / numWorkers, (numItems * (w + 1)) / numWorkers));
+
+        ++generation;
+
+        for(int t=0; t<threads.size(); t++){
+            if(threads.getUnchecked(t)->sleeping.get())
+                threads.getUnchecked(t)->notify();
+        }
+
+        work(0);
+
+        // wait for items the helpers are still rendering (a helper that was asleep
+        // and wakes late simply finds nothing left to take)
+        while(remaining.get() > 0) {}
+
+        pJob = nullptr;
+    }
+
+private:
+    //==============================================================================
+    class Worker : public Thread
+    {
+    public:
+        Worker (RenderWorkerPool& owner, int index)
+        :   Thread ("Render Worker " + String(index)), pool(owner), iIndex(index), lastGeneration(0)
+        {
+        }
+
+        void run()
+        {
+            while(!threadShouldExit()){
+                // spin for a while waiting for the next block, then sleep until woken
+                for(int spins = 0; pool.generation.get() == lastGeneration; spins++){
+                    if(threadShouldExit())
+                        return;
+                    if(spins > kSpinCount){
+                        sleeping = 1;
+                        if(pool.generation.get() == lastGeneration)
+                            wait(100);
+                        sleeping = 0;
+                        spins = 0;
+                    }
+                }
+
+                lastGeneration = pool.generation.get();
+                const RealtimeGuard::Scope realtime;
+                pool.work(iIndex);
+            }
+        }
+
+        Atomic<int> sleeping;
+
+    private:
+        enum { kSpinCount = 20000 };
+
+        RenderWorkerPool& pool;
+        const int iIndex;
+        int lastGeneration;
+    };
+
+    //==============================================================================
+    // a worker's range of items is packed into one atomic as (next << 32 | end)
+    static int64 pack (int next, int end) { return (((int64) next) << 32) | (uint32) end; }
+    static int getNext (int64 range) { return (int) (range >> 32); }
+    static int getEnd (int64 range) { return (int) (uint32) range; }
+
+    // takes the next item from the front of a worker's own range
+    int popFront (int worker)
+    {
+        Atomic<int64>& range = *ranges.getUnchecked(worker);
+        for(;;){
+            const int64 current = range.get();
+            const int next = getNext(current), end = getEnd(current);
+            if(next >= end)
+                return -1;
+            if(range.compareAndSetBool(pack(next + 1, end), current))
+                return next;
+        }
+    }
+
+    // steals the last item from the back of another worker's range
+    int stealBack (int victim)
+    {
+        Atomic<int64>& range = *ranges.getUnchecked(victim);
+        for(;;){
+            const int64 current = range.get();
+            const int next = getNext(current), end = getEnd(current);
+            if(next >= end)
+                return -1;
+            if(range.compareAndSetBool(pack(next, end - 1), current))
+                return end - 1;
+        }
+    }
+
+    void work (int worker)
+    {
+        Job* job = pJob;
+        if(job == nullptr)
+            return;
+
+        int item;
+        while((item = popFront(worker)) >= 0){
+            job->renderItem(item, worker);
+            --remaining;
+        }
+
+        const int numWorkers = getNumWorkers();
+        for(int v=1; v<numWorkers; v++){
+            const int victim = (worker + v) % numWorkers;
+            while((item = stealBack(victim)) >= 0){
+                job->renderItem(item, worker);
+                --remaining;
+            }
+        }
+    }
+
+    OwnedArray<Worker> threads;
+    OwnedArray<Atomic<int64> > ranges;
+
+    Job* volatile pJob;
+    Atomic<int> generation;
+    Atomic<int> remaining;
+
+    JUCE_DECLARE_NON_COPYABLE (RenderWorkerPool)
+};
+
+#endif
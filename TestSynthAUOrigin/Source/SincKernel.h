@@ -0,0 +1,128 @@
+//
+//  SincKernel.h
+//  TestSynthAU
+//
+//  The windowed-sinc interpolation kernel used to play samples back at other
+//  pitches. The kernel is precomputed as a polyphase table (kPhases fractional
+//  positions, interpolated between), with one table per semitone of upward
+//  transposition (up to two octaves - a drum tuned up, played at a lower host rate
+//  than it was recorded at), each lowpassed to the pitched-up sample's new Nyquist
+//  so that it doesn't alias.
+//
+
+#ifndef __SincKernel_h__
+#define __SincKernel_h__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#if JUCE_INTEL
+ #include <xmmintrin.h>
+ #define SINCKERNEL_SSE 1
+#endif
+
+class SincKernel
+{
+public:
+    enum { kTaps = 32, kPhases = 256, kMaxSemitones = 24 };
+
+    // the tables are shared by everything that resamples; build them (with a first
+    // call) before the audio thread needs them
+    static const SincKernel& getInstance()
+    {
+        static SincKernel kernel;
+        return kernel;
+    }
+
+    // the table to use for a playback rate (1 = original pitch, 2 = an octave up)
+    static int getTable(double rate)
+    {
+        if(rate <= 1.0)
+            return 0;
+        return jmin((int)kMaxSemitones, (int)ceil(12.0 * log(rate) / log(2.0) - 1.0e-6));
+    }
+
+    // The kTaps weights for a position fraction (0 to 1) of the way from sample x[i]
+    // to x[i+1]; weights[t] applies to x[i - kTaps/2 + 1 + t].
+    void getWeights(int table, float fraction, float* weights) const
+    {
+        const float fPos = fraction * kPhases;
+        const int phase = jlimit(0, kPhases - 1, (int)fPos);
+        const float fMix = fPos - phase;
+        const float* a = tables[table][phase];
+        const float* b = tables[table][phase + 1];
+
+       #if SINCKERNEL_SSE
+        const __m128 mix = _mm_set1_ps(fMix);
+        for(int t=0; t<kTaps; t+=4){
+            const __m128 va = _mm_loadu_ps(a + t);
+            _mm_storeu_ps(weights + t, _mm_add_ps(va, _mm_mul_ps(mix, _mm_sub_ps(_mm_loadu_ps(b + t), va))));
+        }
+       #else
+        for(int t=0; t<kTaps; t++)
+            weights[t] = a[t] + fMix * (b[t] - a[t]);
+       #endif
+    }
+
+    // applies a set of weights to kTaps samples
+    static float apply(const float* weights, const float* x)
+    {
+       #if SINCKERNEL_SSE
+        __m128 sum = _mm_mul_ps(_mm_loadu_ps(weights), _mm_loadu_ps(x));
+        for(int t=4; t<kTaps; t+=4)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(weights + t), _mm_loadu_ps(x + t)));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        return _mm_cvtss_f32(sum);
+       #else
+        float fSum = 0.0f;
+        for(int t=0; t<kTaps; t++)
+            fSum += weights[t] * x[t];
+        return fSum;
+       #endif
+    }
+
+private:
+    SincKernel()
+    {
+        const double beta = 7.0;
+        double taps[kTaps];
+
+        for(int k=0; k<=kMaxSemitones; k++){
+            // (relative to the sample's Nyquist) pitched up, the transition band has to
+            // end by the new Nyquist; otherwise it just needs to clear 20kHz
+            const double cutoff = k == 0 ? 0.9 : 1.0 / pow(2.0, k / 12.0) - 0.13;
+
+            for(int p=0; p<=kPhases; p++){
+                const double fraction = p / (double)kPhases;
+                double sum = 0.0;
+                for(int t=0; t<kTaps; t++){
+                    const double d = (t - (kTaps / 2 - 1)) - fraction;
+                    const double r = d / (kTaps / 2);
+                    const double window = r * r < 1.0 ? besselI0(beta * sqrt(1.0 - r * r)) / besselI0(beta) : 0.0;
+                    const double x = double_Pi * cutoff * d;
+                    const double sinc = fabs(x) < 1.0e-9 ? 1.0 : sin(x) / x;
+                    sum += (taps[t] = cutoff * sinc * window);
+                }
+                // unity gain at DC for every phase
+                for(int t=0; t<kTaps; t++)
+                    tables[k][p][t] = (float)(taps[t] / sum);
+            }
+        }
+    }
+
+    static double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for(int k=1; k<32; k++){
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    float tables[kMaxSemitones + 1][kPhases + 1][kTaps];
+
+    JUCE_DECLARE_NON_COPYABLE (SincKernel)
+};
+
+#endif
@@ -0,0 +1,345 @@
+//
+//  StemExport.h
+//  TestSynthAU
+//
+//  Offline stem export: a MIDI sequence is rendered once, and the stereo mix and each
+//  of the synth's mic buses are written to files of their own. The song is cut into
+//  segments which are rendered side by side, each by its own copy of the processor
+//  (made from the plugin's state, in deterministic mode). A segment's copy starts a
+//  pre-roll ahead of it and plays the events from there, so the hits still ringing
+//  into the segment, and the bus dynamics, are where they'd be had the render
+//  started at the beginning - and as round robins are drawn from each hit's position
+//  (see Synth::prepareNote()), they're the same ones too. Rendered segments are
+//  encoded in order on a second thread pool, one job per file, while later segments
+//  are still rendering.
+//
+
+#ifndef __StemExport_h__
+#define __StemExport_h__
+
+#include "PluginProcessor.h"
+
+//==============================================================================
+struct StemExportOptions
+{
+    enum Format { wav, flac };
+
+    StemExportOptions()
+    :   format(wav), bitsPerSample(24), tailSeconds(4.0), preRollSeconds(6.0), segmentSeconds(0.0),
+        numRenderThreads(jmax(1, SystemStats::getNumCpus() - 1)), numEncodeThreads(2), seed(1)
+    {
+    }
+
+    Format format;
+    int bitsPerSample;          // 16 or 24 (WAVs can also be 8, or 32 for float)
+    String fileNamePrefix;      // e.g. "Verse - " writes "Verse - Kick In.wav", ...
+    double tailSeconds;         // rendered after the last event
+    double preRollSeconds;      // should cover the longest hit, or it's cut at a segment's start
+    double segmentSeconds;      // 0 picks a length from the song's and the number of threads
+    int numRenderThreads;
+    int numEncodeThreads;
+    int64 seed;                 // for the round robins
+};
+
+//==============================================================================
+class StemExport
+{
+public:
+    StemExport (PluginAudioProcessor& processor, const MidiMessageSequence& sequence, const File& folder,
+                const StemExportOptions& exportOptions)
+    :   source(processor), events(sequence), outputFolder(folder), options(exportOptions),
+        numBuses(processor.getNumBuses()), fSampleRate(processor.getSampleRate() > 0.0 ? processor.getSampleRate() : 44100.0),
+        iTotalSamples(0), iSegmentSamples(0), iPreRollSamples(0), numSegments(0), written(0)
+    {
+    }
+
+    // Renders and writes every file, returning once they're finished - or, having
+    // deleted them, if one can't be written or the calling thread is asked to exit.
+    Result run()
+    {
+        ScopedPointer<AudioFormat> format (options.format == StemExportOptions::flac ? (AudioFormat*) new FlacAudioFormat()
+                                                                                       : (AudioFormat*) new WavAudioFormat());
+        if(!format->getPossibleBitDepths().contains(options.bitsPerSample))
+            return Result::fail(format->getFormatName() + " can't be written at " + String(options.bitsPerSample) + " bits");
+        if(!outputFolder.createDirectory())
+            return Result::fail("can't create " + outputFolder.getFullPathName());
+
+        // (the parameters and everything else the synth keeps - see Synth::saveSettings())
+        source.getStateInformation(state);
+        prepareEvents();
+        prepareSegments();
+
+        Result result (openFiles(*format));
+        if(result.wasOk())
+            result = renderAndWrite();
+
+        writers.clear();
+        if(result.failed()){
+            for(int f = 0; f < files.size(); f++)
+                files.getReference(f).deleteFile();
+        }
+        return result;
+    }
+
+    // (any thread) how much of the export has been written, from 0 to 1
+    double getProgress() const { return numSegments > 0 ? written.get() / (double) numSegments : 0.0; }
+
+private:
+    enum { kBlockSize = 1024, kMaxAutoSegmentSeconds = 30 };
+
+    // a stretch of the song: the mix in channels 0-1 of its audio, then the buses
+    struct Segment
+    {
+        Segment (int64 startSample, int length, int numChannels)
+        :   start(startSample), numSamples(length), audio(numChannels, length)
+        {
+            audio.clear();
+        }
+
+        const int64 start;
+        const int numSamples;
+        AudioSampleBuffer audio;
+        Atomic<int> rendered;
+        Atomic<int> encoding;   // the files still being written from it
+    };
+
+    //==============================================================================
+    class RenderJob : public ThreadPoolJob
+    {
+    public:
+        RenderJob (StemExport& owner, Segment& segmentToRender)
+        :   ThreadPoolJob("Stem Render"), exporter(owner), segment(segmentToRender)
+        {
+        }
+
+        JobStatus runJob()
+        {
+            exporter.render(segment, *this);
+            segment.rendered = 1;
+            exporter.finished.signal();
+            return jobHasFinished;
+        }
+
+    private:
+        StemExport& exporter;
+        Segment& segment;
+    };
+
+    class EncodeJob : public ThreadPoolJob
+    {
+    public:
+        EncodeJob (StemExport& owner, Segment& segmentToWrite, int fileIndex)
+        :   ThreadPoolJob("Stem Encode"), exporter(owner), segment(segmentToWrite), iFile(fileIndex)
+        {
+        }
+
+        JobStatus runJob()
+        {
+            // the mix is the first file, then a file per bus
+            float* const* channels = segment.audio.getArrayOfChannels() + (iFile == 0 ? 0 : iFile + 1);
+            const AudioSampleBuffer stem (channels, iFile == 0 ? 2 : 1, segment.numSamples);
+            if(!exporter.writers.getUnchecked(iFile)->writeFromAudioSampleBuffer(stem, 0, segment.numSamples))
+                exporter.failedFile = iFile + 1;
+
+            --segment.encoding;
+            exporter.finished.signal();
+            return jobHasFinished;
+        }
+
+    private:
+        StemExport& exporter;
+        Segment& segment;
+        const int iFile;
+    };
+
+    //==============================================================================
+    // the song's events, at their samples (in time order, and the sequence's order
+    // for events at the same sample)
+    void prepareEvents()
+    {
+        double fEndTime = 0.0;
+        for(int e = 0; e < events.getNumEvents(); e++){
+            const MidiMessage& m = events.getEventPointer(e)->message;
+            if(m.isMetaEvent())
+                continue;
+            song.addEvent(m, roundToInt(m.getTimeStamp() * fSampleRate));
+            fEndTime = jmax(fEndTime, m.getTimeStamp());
+        }
+
+        iTotalSamples = (int64) ((fEndTime + options.tailSeconds) * fSampleRate) + 1;
+    }
+
+    // Segments (and the pre-roll) are whole deterministic slices, so every segment's
+    // slices line up with those of a render from the start.
+    void prepareSegments()
+    {
+        const int threads = jmax(1, options.numRenderThreads);
+        const double fPreRoll = jmax(0.0, options.preRollSeconds);
+        double fSegment = options.segmentSeconds;
+        if(fSegment <= 0.0)
+            fSegment = jmax(4.0 * fPreRoll, jmin((double) kMaxAutoSegmentSeconds, iTotalSamples / (fSampleRate * 2 * threads)));
+
+        iSegmentSamples = roundUpToSlice((int64) (fSegment * fSampleRate));
+        iPreRollSamples = roundUpToSlice((int64) (fPreRoll * fSampleRate));
+        numSegments = (int) ((iTotalSamples + iSegmentSamples - 1) / iSegmentSamples);
+    }
+
+    static int64 roundUpToSlice (int64 numSamples)
+    {
+        const int64 slice = PluginAudioProcessor::kDeterministicSliceSize;
+        return jmax(slice, ((numSamples + slice - 1) / slice) * slice);
+    }
+
+    Result openFiles (AudioFormat& format)
+    {
+        const String extension (format.getFileExtensions()[0]);
+        // (FLAC's default compression level)
+        const int quality = dynamic_cast<FlacAudioFormat*>(&format) != nullptr ? 5 : 0;
+
+        for(int f = 0; f <= numBuses; f++){
+            const String name (f == 0 ? String("Mix") : source.getBusName(f - 1));
+            const File file (outputFolder.getChildFile(File::createLegalFileName(options.fileNamePrefix + name + extension)));
+            file.deleteFile();
+            files.add(file);
+
+            ScopedPointer<FileOutputStream> stream (file.createOutputStream());
+            if(stream == nullptr)
+                return Result::fail("can't write " + file.getFullPathName());
+
+            // (the writer owns the stream from here, even if it fails)
+            AudioFormatWriter* pWriter = format.createWriterFor(stream.release(), fSampleRate, f == 0 ? 2 : 1,
+                                                                 options.bitsPerSample, StringPairArray(), quality);
+            if(pWriter == nullptr)
+                return Result::fail("can't write " + file.getFullPathName());
+            writers.add(pWriter);
+        }
+        return Result::ok();
+    }
+
+    //==============================================================================
+    // Keeps the render pool a segment or so ahead of the encoders, which write the
+    // segments in order. (The pools are declared last, so they stop first.)
+    Result renderAndWrite()
+    {
+        const int threads = jmax(1, options.numRenderThreads);
+        const int window = threads + 1;
+        int nextToRender = 0, nextToWrite = 0;
+        bool bEncoding = false;
+
+        ThreadPool renderPool (threads);
+        ThreadPool encodePool (jmax(1, options.numEncodeThreads));
+
+        while(nextToWrite < numSegments)
+        {
+            Thread* pCaller = Thread::getCurrentThread();
+            if(pCaller != nullptr && pCaller->threadShouldExit())
+                return Result::fail("the export was cancelled");
+            if(failedFile.get() > 0)
+                return Result::fail("can't write " + files[failedFile.get() - 1].getFullPathName());
+
+            while(nextToRender < numSegments && nextToRender - nextToWrite < window){
+                const int64 start = nextToRender * iSegmentSamples;
+                const int length = (int) jmin(iSegmentSamples, iTotalSamples - start);
+                Segment* pSegment = segments.add(new Segment(start, length, 2 + numBuses));
+                renderPool.addJob(new RenderJob(*this, *pSegment), true);
+                nextToRender++;
+            }
+
+            Segment& segment = *segments.getUnchecked(nextToWrite);
+            if(!bEncoding && segment.rendered.get() != 0){
+                segment.encoding = writers.size();
+                for(int f = 0; f < writers.size(); f++)
+                    encodePool.addJob(new EncodeJob(*this, segment, f), true);
+                bEncoding = true;
+            }
+            else if(bEncoding && segment.encoding.get() == 0){
+                // done with - free its audio
+                segment.audio.setSize(1, 1);
+                bEncoding = false;
+                ++written;
+                nextToWrite++;
+                continue;
+            }
+
+            finished.wait(100);
+        }
+
+        return failedFile.get() > 0 ? Result::fail("can't write " + files[failedFile.get() - 1].getFullPathName()) : Result::ok();
+    }
+
+    // (render thread) plays the pre-roll and then the segment through a copy of the processor
+    void render (Segment& segment, ThreadPoolJob& job)
+    {
+        PluginAudioProcessor processor;
+        processor.setStateInformation(state.getData(), (int) state.getSize());
+        processor.setPlayConfigDetails(0, 2, fSampleRate, kBlockSize);
+        processor.setDeterministic(true, options.seed);
+        processor.prepareToPlay(fSampleRate, kBlockSize);
+        processor.waitUntilReady();
+
+        const int64 from = jmax((int64) 0, segment.start - iPreRollSamples);
+        const int64 end = segment.start + segment.numSamples;
+        processor.setStreamPosition(from);
+
+        // the buses are captured straight into the segment, once it starts
+        AudioSampleBuffer buses (segment.audio.getArrayOfChannels() + 2, jmax(1, numBuses), segment.numSamples);
+        AudioSampleBuffer preRoll (2, kBlockSize);
+        MidiBuffer midi;
+
+        MidiBuffer::Iterator iterator (song);
+        iterator.setNextSamplePosition((int) from);
+        MidiMessage event (0xf4, 0.0);
+        int eventPosition = 0;
+        bool bEvent = iterator.getNextEvent(event, eventPosition);
+
+        for(int64 position = from; position < end && !job.shouldExit();)
+        {
+            int n = (int) jmin((int64) kBlockSize, end - position);
+            if(position < segment.start)
+                n = (int) jmin((int64) n, segment.start - position);
+            else if(position == segment.start && numBuses > 0)
+                processor.setBusCapture(&buses);
+
+            midi.clear();
+            for(; bEvent && eventPosition < position + n; bEvent = iterator.getNextEvent(event, eventPosition))
+                midi.addEvent(event, (int) (eventPosition - position));
+
+            if(position < segment.start){
+                AudioSampleBuffer block (preRoll.getArrayOfChannels(), 2, n);
+                block.clear();
+                processor.processBlock(block, midi);
+            }else{
+                AudioSampleBuffer block (segment.audio.getArrayOfChannels(), 2, (int) (position - segment.start), n);
+                processor.processBlock(block, midi);
+            }
+            position += n;
+        }
+
+        processor.setBusCapture(NULL);
+        processor.releaseResources();
+    }
+
+    //==============================================================================
+    PluginAudioProcessor& source;
+    const MidiMessageSequence& events;
+    const File outputFolder;
+    const StemExportOptions options;
+    const int numBuses;
+    const double fSampleRate;
+
+    MemoryBlock state;          // the plugin's, for each copy
+    MidiBuffer song;
+    int64 iTotalSamples, iSegmentSamples, iPreRollSamples;
+    int numSegments;
+
+    Array<File> files;
+    OwnedArray<AudioFormatWriter> writers;
+    OwnedArray<Segment> segments;
+    WaitableEvent finished;     // signalled as each job finishes
+    Atomic<int> written;
+    Atomic<int> failedFile;     // (1 + the index of a file that couldn't be written)
+
+    JUCE_DECLARE_NON_COPYABLE (StemExport)
+};
+
+#endif
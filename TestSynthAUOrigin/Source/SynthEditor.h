@@ -38,7 +38,8 @@ struct Control
 };
 
 const Bounds AUTO_SIZE = Bounds(-1,-1,-1,-1); // used to trigger automatic layout
-enum { kParam0, kParam1, kParam2, kParam3, kParam4, kParam5, kParam6, kParam7, kParam8, kParam9, kParam10, kParam11, kParam12, kParam13, kParam14, kParam15, kParam16, kParam17, kParam18, kParam19, kParam20, kParam21, kParam22, kParam23 };
+enum { kParam0, kParam1, kParam2, kParam3, kParam4, kParam5, kParam6, kParam7, kParam8, kParam9, kParam10, kParam11, kParam12, kParam13, kParam14, kParam15, kParam16, kParam17, kParam18, kParam19, kParam20, kParam21, kParam22, kParam23,
+       kParam24, kParam25, kParam26, kParam27, kParam28, kParam29, kParam30 };
 
 //=========================================================================
 // UI_CONTROLS - Use this array to completely specify your UI
@@ -81,6 +82,14 @@ const Control UI_CONTROLS[] = {
     {   "",      kParam21,   ROTARY, 0.0, 1.0, 0.5,          Bounds(450, 30, 40, 40)   },
     {   "",      kParam22,   ROTARY, 0.0, 1.0, 0.5,          Bounds(530, 30, 40, 40)   },
     {   "",      kParam23,   ROTARY, 0.0, 1.0, 0.5,          Bounds(610, 30, 40, 40)   },
+    // each drum's tuning, in semitones (see MySynth::getTuningRate())
+    {   "Kick Tune",      kParam24,   ROTARY, -12.0, 12.0, 0.0,   Bounds(40,  260, 40, 40)   },
+    {   "Snare Tune",     kParam25,   ROTARY, -12.0, 12.0, 0.0,   Bounds(125, 260, 40, 40)   },
+    {   "High Tom Tune",  kParam26,   ROTARY, -12.0, 12.0, 0.0,   Bounds(210, 260, 40, 40)   },
+    {   "Mid Tom Tune",   kParam27,   ROTARY, -12.0, 12.0, 0.0,   Bounds(295, 260, 40, 40)   },
+    {   "Floor Tom Tune", kParam28,   ROTARY, -12.0, 12.0, 0.0,   Bounds(380, 260, 40, 40)   },
+    {   "Hats Tune",      kParam29,   ROTARY, -12.0, 12.0, 0.0,   Bounds(465, 260, 40, 40)   },
+    {   "Cymbals Tune",   kParam30,   ROTARY, -12.0, 12.0, 0.0,   Bounds(550, 260, 40, 40)   },
 //    {   "Pan",          kParam15,   ROTARY, 0.0, 1.0, 0.5,          Bounds(450, 10, 40, 40)   },
 //    {   "Pan",          kParam16,   ROTARY, 0.0, 1.0, 0.5,          Bounds(530, 10, 40, 40)   },
 //    {   "Pan",          kParam17,   ROTARY, 0.0, 1.0, 0.5,          Bounds(610, 10, 40, 40)   },
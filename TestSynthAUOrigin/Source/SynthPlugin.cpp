@@ -7,50 +7,21 @@
 
 #include "SynthPlugin.h"
 
-const char* fileName[19] = {
-    "Bass Drum In ",
-    "Bass Drum Out ",
-    "Snare Up ",
-    "Snare Down ",
-    "High Tom ",
-    "Mid Tom ",
-    "Floor Tom ",
-    "Hats Closed Tip ",
-    "Hats Closed Shaft ",
-    "Hats Rock Sizzle ",
-    //    "Hats Tight Sizzle ",
-    "Hats Open ",
-    //    "Hats Pedal ",
-    "Ride Tip ",
-    "Ride Bell ",
-    "Splash Crash ",
-    "Crash Crash ",
-    //    "Crash Bell ",
-    //    "Crash Tip "
-};
-const char* velocityIndex[6]{
-    "1_",
-    "2_",
-    "3_",
-    "4_",
-    "5_",
-    "6_",
-};
-const char* stringEnd[6] = {
-    "1.wav",
-    "2.wav",
-    "3.wav",
-    "4.wav",
-    "5.wav",
-    "6.wav"
-};
-const char* cymbalMics[5]{
-    "Close Mic ",
-    "OH L ",
-    "OH R ",
-    "Room L ",
-    "Room R "
-};
+// Load-time tail trimming: samples are cut 10ms after their last frame above -70dBFS
+const float kTailThreshold = 0.0003f;
+const float kTailFadeTime = 0.01f;
+
+// Load-time mic alignment: a distant mic is moved by at most 20ms to meet its close mic
+const float kMaxMicDelay = 0.02f;
+
+// Run-time silence detection: a hit is freed once every mic it feeds has stayed
+// below -70dBFS for 50ms
+const float kSilenceThreshold = 0.0003f;
+const float kSilenceTime = 0.05f;
+
+// Hi-hat choke: a closed or sizzle hit cuts off a ringing open hat over 15ms
+const int kHatChokeGroup = 1;
+const float kChokeTime = 15.0f;
 /*
  ////////////////////////////////////////////////////////////////////////////
  //Currently only running the hardest samples                              //
@@ -65,35 +36,190 @@ Synth* JUCE_CALLTYPE createSynth() {
     return new MySynth();
 }
 
-// Called when the synthesiser is first created
-void MySynth::initialise()
+//===================================================================================
+// KIT - the sample library, shared between all instances of the plugin
+
+GuardedCriticalSection DrumKit::cacheLock;
+ReferenceCountedArray<DrumKit> DrumKit::cache;
+
+DrumKit::Ptr DrumKit::acquire(const String& path)
 {
-    // Initialise synthesiser variables here
-    char charBuffer[128] = { 0 };
-    for(int a = 0; a < 7; a++){
-        for (int x = 5; x < 6; x++){
-            for (int i = 0; i < 6; i++){
-                sprintf(charBuffer, "%s%s%s", fileName[a], velocityIndex[x], stringEnd[i]);
-                buffer[a].velocities[x].samples[i].openResource(charBuffer);
-                buffer[a].velocities[x].samples[i].reset();
-                printf("Buffer - %d Velocity - %d Sample - %d %s\n", a, x, i, charBuffer);
-            }
-        }
+    // held while loading, so a second instance waits for the first load and attaches
+    const GuardedCriticalSection::ScopedLockType sl (cacheLock);
+    
+    for(int k = 0; k < cache.size(); k++){
+        DrumKit* pKit = cache.getUnchecked(k);
+        if(pKit->kitPath == path)
+            return pKit;
     }
-    for(int b = 0; b < 8; b++){
-        for(int a = 0; a < 5; a++){
+    
+    DrumKit* pKit = new DrumKit(path);
+    pKit->load();
+    cache.add(pKit);
+    return pKit;
+}
+
+void DrumKit::release(Ptr& kit)
+{
+    const GuardedCriticalSection::ScopedLockType sl (cacheLock);
+    
+    DrumKit* pKit = kit;
+    kit = nullptr;
+    
+    // the cache holds the last reference once no instance is using the kit
+    if(pKit != nullptr && pKit->getReferenceCount() == 1)
+        cache.removeObject(pKit);
+}
+
+void DrumKit::load()
+{
+    // the packed kit, if the folder has one (see KitFile.h), otherwise its WAVs
+    const File packedFile (File(kitPath).getChildFile(KitFile::getDefaultFileName()));
+    const KitFile packed (packedFile);
+    if(packed.isValid())
+        DBG("Kit - " << packed.getNumEntries() << " samples packed in " << KitFile::getDefaultFileName());
+    
+    // what earlier loads found out about each recording (see KitCache.h)
+    KitCache cache (kitPath);
+    
+    for(int a = 0; a < KitLayout::kNumArticulations; a++){
+        for(int m = 0; m < KitLayout::getNumMics(a); m++){
             for (int x = 5; x < 6; x++){
                 for (int i = 0; i < 6; i++){
-                    sprintf(charBuffer, "%s%s%s%s", fileName[b+7], cymbalMics[a], velocityIndex[x], stringEnd[i]);
-                    cymbals[b].mics[a].velocities[x].samples[i].openResource(charBuffer);
-                    cymbals[b].mics[a].velocities[x].samples[i].reset();
-                    printf("Cymbal - %d Mics - %d Velocity - %d Sample - %d %s\n", b, a, x, i, charBuffer);
+                    Buffer& sample = getSample(a, m, x, i);
+                    const String name (KitLayout::getFileName(a, m, x, i));
+                    const File source (packed.isValid() ? packedFile : File(kitPath).getChildFile(name));
+                    const KitCache::Entry* pCached = cache.find(name, source);
+                    float fPeak = 1.0f;
+                    
+                    if(packed.isValid()){
+                        const KitFile::Entry* pEntry = packed.find(a, m, x, i);
+                        if(pEntry == NULL)
+                            continue;
+                        sample.loadSamples(packed.getSamples(*pEntry), pEntry->numFrames, 1, pEntry->sampleRate);
+                        fPeak = pEntry->peak;
+                    }else if(pCached != NULL){
+                        sample.openResource(name.toStdString(), pCached->numFrames, 1.0f / pCached->fPeak);
+                    }else{
+                        fPeak = sample.openResource(name.toStdString());
+                        printf("Articulation - %d Mic - %d Velocity - %d Sample - %d %s\n", a, m, x, i, name.toRawUTF8());
+                    }
+                    
+                    const int iFadeLength = (int)(kTailFadeTime * sample.getFileRate());
+                    if(pCached != NULL){
+                        sample.trimTo(pCached->numFrames, iFadeLength);
+                    }else{
+                        sample.trimTail(kTailThreshold, iFadeLength);
+                        if(fPeak > 0.0f)
+                            cache.set(name, source, fPeak, sample.getSamples(), sample.getNumFrames());
+                    }
+                    sample.reset();
                 }
             }
         }
     }
     
+    alignMics(cache);
+}
+
+Buffer& DrumKit::getSample(int articulation, int mic, int velocity, int roundRobin)
+{
+    if(articulation < KitLayout::kNumDrums)
+        return buffer[articulation].velocities[velocity].samples[roundRobin];
+    return cymbals[articulation - KitLayout::kNumDrums].mics[mic].velocities[velocity].samples[roundRobin];
+}
+
+// Each distant mic hears a hit a little after its close mic does, so when they're
+// summed the drum loses low end to comb filtering. Every recording of a hit is
+// cross-correlated with the close mic's, and the later mics start that much further
+// in (a start offset on the Buffer - nothing is delayed at playback). The offsets
+// are cached with the recordings, and only worked out again when one changes.
+void DrumKit::alignMics(KitCache& cache)
+{
+    MicAligner aligner;
+    
+    for(int x = 0; x < 6; x++){
+        for(int i = 0; i < 6; i++){
+            // the kick's outside mic against its inside one (the snare's under mic is
+            // left alone, as it's usually in opposite polarity to the top)
+            const int kick[2] = { 0, 1 };
+            const int kickMics[2] = { 0, 0 };
+            alignHit(aligner, cache, kick, kickMics, 2, x, i);
+            
+            // the overheads and room mics against each cymbal's close mic
+            for(int b = 0; b < KitLayout::kNumCymbals; b++){
+                int cymbal[KitLayout::kNumCymbalMics], mics[KitLayout::kNumCymbalMics];
+                for(int a = 0; a < KitLayout::kNumCymbalMics; a++){
+                    cymbal[a] = KitLayout::kNumDrums + b;
+                    mics[a] = a;
+                }
+                alignHit(aligner, cache, cymbal, mics, KitLayout::kNumCymbalMics, x, i);
+            }
+        }
+    }
+}
+
+// aligns the recordings of one hit (given by articulation and mic, the first the
+// reference) with each other
+void DrumKit::alignHit(MicAligner& aligner, KitCache& cache, const int* articulations, const int* mics,
+                       int numMics, int velocity, int roundRobin)
+{
+    enum { kMaxMics = 8 };
+    Buffer* samples[kMaxMics];
+    String names[kMaxMics];
+    bool bCached = true;
+    
+    numMics = jmin(numMics, (int)kMaxMics);
+    for(int a = 0; a < numMics; a++){
+        samples[a] = &getSample(articulations[a], mics[a], velocity, roundRobin);
+        names[a] = KitLayout::getFileName(articulations[a], mics[a], velocity, roundRobin);
+        if(cache.getCurrent(names[a]) == NULL)
+            bCached = false;
+    }
+    
+    const Buffer* close = samples[0];
+    if(close->getSamples() == NULL)
+        return;
+    
+    if(bCached){
+        for(int a = 0; a < numMics; a++)
+            samples[a]->setStartOffset(cache.getCurrent(names[a])->startOffset);
+        return;
+    }
+    
+    aligner.setReference(close->getSamples(), close->getNumFrames());
+    const int maxLag = (int)(kMaxMicDelay * close->getFileRate());
+    
+    int delay[kMaxMics] = { 0 };
+    int earliest = 0;
+    for(int a = 1; a < numMics; a++){
+        if(samples[a]->getSamples() != NULL)
+            delay[a] = aligner.findDelay(samples[a]->getSamples(), samples[a]->getNumFrames(), maxLag);
+        earliest = jmin(earliest, delay[a]);
+    }
+    
+    // a mic that arrives earlier than the close one (mis-slated, or recorded through
+    // something with latency) moves everything else along instead
+    for(int a = 0; a < numMics; a++){
+        samples[a]->setStartOffset(delay[a] - earliest);
+        cache.setStartOffset(names[a], delay[a] - earliest);
+    }
+}
+
+//===================================================================================
+
+// Called when the synthesiser is first created
+void MySynth::initialise()
+{
+    // Initialise synthesiser variables here
+    kit = DrumKit::acquire(getResourcePath().c_str());
+    
+    resetDrums();
+    
+    roundRobins.setSeed(Time::currentTimeMillis());
+    
     for(int i = 0; i < 19; i++){
+        fReverbSend[i] = 0.0f;
         pSubmix[i] = new float[16384];
         for(int s=0; s < 16384; s++)
             pSubmix[i][s] = 0;
@@ -104,6 +230,207 @@ void MySynth::initialise()
     
 }
 
+// Sets the bus processing up at the host's rate, so the latency is reported at the
+// new rate before the first block, and reloads the room impulse if it was loaded at
+// another. (The kit needs nothing - hits are resampled from its recorded rate as
+// they play.)
+void MySynth::prepareToPlay(double sampleRate, int samplesPerBlock)
+{
+    eq.setSampleRate(sampleRate);
+    dynamics.setSampleRate(sampleRate);
+    drive.setSampleRate(sampleRate);
+    masterDrive.setSampleRate(sampleRate);
+    
+    const File impulse (reverb.getImpulseFile());
+    if(impulse != File::nonexistent && reverb.getImpulseSampleRate() != sampleRate)
+        reverb.loadImpulse(impulse, sampleRate);
+}
+
+// The bus processing's delay: the dynamics' lookahead, then the drive's oversampling
+// filters (every bus is delayed alike, so the mics stay lined up), then the master
+// drive's
+int MySynth::getLatency() const
+{
+    return dynamics.getLatency() + drive.getLatency() + masterDrive.getLatency();
+}
+
+// a child element of saved settings, or an empty one if they were saved without it
+static const XmlElement& getSettings(const XmlElement& xml, const String& name)
+{
+    static const XmlElement empty ("EMPTY");
+    const XmlElement* pChild = xml.getChildByName(name);
+    return pChild != nullptr ? *pChild : empty;
+}
+
+// one-shot drums, with the hats' choke
+void MySynth::resetDrums()
+{
+    for(int i = 0; i < 128; i++){
+        fReleaseTime[i] = 0.0f;
+        iChokeGroup[i] = 0;
+    }
+    
+    // the hats (closed, rock sizzle, open) are one cymbal
+    iChokeGroup[54] = iChokeGroup[56] = iChokeGroup[58] = kHatChokeGroup;
+    fChokeTime = kChokeTime;
+}
+
+void MySynth::saveSettings(XmlElement& xml) const
+{
+    eq.saveSettings(*xml.createNewChildElement("EQ"));
+    dynamics.saveSettings(*xml.createNewChildElement("DYNAMICS"));
+    drive.saveSettings(*xml.createNewChildElement("DRIVE"));
+    masterDrive.saveSettings(*xml.createNewChildElement("MASTERDRIVE"));
+    
+    XmlElement* pReverb = xml.createNewChildElement("REVERB");
+    pReverb->setAttribute("impulse", reverb.getImpulseFile().getFullPathName());
+    pReverb->setAttribute("return", fReverbReturn);
+    for(int i = 0; i < 19; i++){
+        if(fReverbSend[i] > 0.0f){
+            XmlElement* pSend = pReverb->createNewChildElement("SEND");
+            pSend->setAttribute("bus", i);
+            pSend->setAttribute("level", fReverbSend[i]);
+        }
+    }
+    
+    XmlElement* pDrums = xml.createNewChildElement("DRUMS");
+    pDrums->setAttribute("chokeTime", fChokeTime);
+    for(int i = 0; i < 128; i++){
+        if(fReleaseTime[i] > 0.0f || iChokeGroup[i] != 0){
+            XmlElement* pNote = pDrums->createNewChildElement("NOTE");
+            pNote->setAttribute("note", i);
+            pNote->setAttribute("release", fReleaseTime[i]);
+            pNote->setAttribute("chokeGroup", iChokeGroup[i]);
+        }
+    }
+}
+
+void MySynth::loadSettings(const XmlElement& xml)
+{
+    eq.loadSettings(getSettings(xml, "EQ"));
+    dynamics.loadSettings(getSettings(xml, "DYNAMICS"));
+    drive.loadSettings(getSettings(xml, "DRIVE"));
+    masterDrive.loadSettings(getSettings(xml, "MASTERDRIVE"));
+    
+    const XmlElement& reverbSettings = getSettings(xml, "REVERB");
+    const String impulsePath (reverbSettings.getStringAttribute("impulse"));
+    const File impulse (impulsePath.isNotEmpty() ? File(impulsePath) : File::nonexistent);
+    if(impulse != reverb.getImpulseFile())
+        loadRoomImpulse(impulse);
+    setReverbReturn((float) reverbSettings.getDoubleAttribute("return", 1.0));
+    for(int i = 0; i < 19; i++)
+        fReverbSend[i] = 0.0f;
+    forEachXmlChildElementWithTagName(reverbSettings, pSend, "SEND")
+        setReverbSend(pSend->getIntAttribute("bus", -1), (float) pSend->getDoubleAttribute("level"));
+    
+    // (a state from before the drums were saved keeps the defaults)
+    resetDrums();
+    const XmlElement* pDrums = xml.getChildByName("DRUMS");
+    if(pDrums != nullptr){
+        for(int i = 0; i < 128; i++)
+            iChokeGroup[i] = 0;
+        setChokeTime((float) pDrums->getDoubleAttribute("chokeTime", kChokeTime));
+        forEachXmlChildElementWithTagName(*pDrums, pNote, "NOTE"){
+            const int note = pNote->getIntAttribute("note", -1);
+            setReleaseTime(note, (float) pNote->getDoubleAttribute("release"));
+            setChokeGroup(note, pNote->getIntAttribute("chokeGroup"));
+        }
+    }
+    ++settingsVersion;
+}
+
+void MySynth::setDeterministic(bool enabled, int64 seed)
+{
+    Synth::setDeterministic(enabled, seed);
+    roundRobins.setSeed(enabled ? seed : Time::currentTimeMillis());
+    iSeed = seed;
+}
+
+// The hit's round robins depend only on the seed, the note and where it starts, not
+// on the hits before it - so a render started part way through the stream (see
+// StemExport.h) picks the same samples as one started at the beginning.
+void MySynth::prepareNote(int note, int64 position)
+{
+    roundRobins.setSeed(iSeed);
+    roundRobins.combineSeed(position * 128 + note);
+}
+
+// The drums' tuning parameters, by the notes MyVoice::onStartNote() plays them on
+int MySynth::getTuningParameter(int note)
+{
+    switch(note){
+        case 48: return kParam24;       // kick
+        case 50: return kParam25;       // snare
+        case 57: return kParam26;       // high tom
+        case 55: return kParam27;       // mid tom
+        case 53: return kParam28;       // floor tom
+        case 54: case 56: case 58:
+            return kParam29;            // hats
+        case 60: case 63: case 65: case 66:
+            return kParam30;            // cymbals
+        default: return -1;
+    }
+}
+
+// The buses are named after what MyVoice::onStartNote() plays into them
+String MySynth::getBusName(int bus) const
+{
+    static const char* const names[] = { "Kick In", "Kick Out", "Snare Up", "Snare Down", "Floor Tom", "Mid Tom", "High Tom",
+                                         "Cymbals Close", "OH L", "OH R", "Room L", "Room R" };
+    if(bus >= 0 && bus < numElementsInArray(names))
+        return names[bus];
+    return Synth::getBusName(bus);
+}
+
+MySynth::~MySynth()
+{
+    DrumKit::release(kit);
+    
+    for(int i = 0; i < 19; i++)
+        delete[] pSubmix[i];
+}
+
+// Renders the voices: the pool mixes every sounding hit straight into the submixes
+// (nothing goes to the main output, which postProcess() builds from the submixes)
+void MySynth::renderVoices(AudioSampleBuffer& outputBuffer, int startSample, int numSamples)
+{
+    voicePool.setSilenceDetection(kSilenceThreshold, (int)(kSilenceTime * getSampleRate()));
+    voicePool.setSampleRate(getSampleRate());
+    
+    if(renderInParallel(outputBuffer, startSample, numSamples, voicePool.getNumActive()))
+        voicePool.finishBlock();
+    else
+        voicePool.render(pSubmix, startSample, numSamples);
+    
+    // free the voices whose hits have ended
+    for(int i = voices.size(); --i >= 0;){
+        MyVoice* pVoice = static_cast<MyVoice*>(voices.getUnchecked(i));
+        if(pVoice->getCurrentlyPlayingNote() >= 0 && !pVoice->isHitPlaying())
+            pVoice->finishNote();
+    }
+}
+
+// Fades out every other sounding hit in the note's choke group, from the given
+// sample of the current block
+void MySynth::choke(int note, int offset, MyVoice* pChoker)
+{
+    const int group = iChokeGroup[note & 127];
+    if(group == 0)
+        return;
+    
+    for(int i = voices.size(); --i >= 0;){
+        MyVoice* pVoice = static_cast<MyVoice*>(voices.getUnchecked(i));
+        if(pVoice != pChoker && pVoice->getCurrentlyPlayingNote() >= 0 && iChokeGroup[pVoice->getPitch() & 127] == group)
+            pVoice->fadeOut(offset, fChokeTime);
+    }
+}
+
+// Renders one of the pool's hits on a render worker
+void MySynth::renderItem(int item, int worker)
+{
+    voicePool.renderHit(item, getWorkerBuses(worker), getRenderStartSample(), getRenderNumSamples());
+}
+
 // Used to apply any additional audio processing to the synthesisers' combined output
 // (when called, outputBuffer contains all the voices' audio)
 void MySynth::postProcess(float** outputBuffer, int numChannels, int numSamples)
@@ -141,20 +468,47 @@ void MySynth::postProcess(float** outputBuffer, int numChannels, int numSamples)
     
     float fLevel[8];
     float fPanner[8];
-    float dbFs[8] = { 0 };
     
     for(int i = 0; i < 7; i++){
         fPanner[i] = getParameter(kParam16+i);
         fLevel[i] = getParameter(kParam0+i);
     }
-    for(int i = 0; i < 7; i++){
-        dbFs[i] = fabsf(*pfSubmix[i]);
-        setParameter(kParam8+i, dbFs[i]);
+    // EQ and dynamics on the mic buses (pre-fader, so the meters show their effect)
+    eq.setSampleRate(getSampleRate());
+    eq.process(pSubmix, 0, numSamples);
+    dynamics.setSampleRate(getSampleRate());
+    dynamics.process(pSubmix, 0, numSamples);
+    drive.setSampleRate(getSampleRate());
+    drive.process(pSubmix, 0, numSamples);
+    captureBuses(pSubmix, 19, numSamples);
+    
+    // room reverb send (pre-fader, but after the EQ, dynamics and drive, so the room
+    // hears the processed buses, delayed as much as the dry ones), returned into the
+    // main outputs (from the block a new impulse is swapped in, whatever the block size)
+    reverb.update();
+    float* pfSend = reverbSend.getSampleData(0);
+    FloatVectorOperations::clear(pfSend, numSamples);
+    if(reverb.isLoaded()){
+        for(int i = 0; i < 19; i++){
+            if(fReverbSend[i] > 0.0f)
+                FloatVectorOperations::addWithMultiply(pfSend, pSubmix[i], fReverbSend[i], numSamples);
+        }
+    }
+    
+    reverb.process(pfSend, reverbReturn.getArrayOfChannels(), 2, numSamples);
+    
+    if(reverb.isLoaded()){
+        for(int c = 0; c < numChannels && c < 2; c++)
+            FloatVectorOperations::addWithMultiply(outputBuffer[c], reverbReturn.getSampleData(c), fReverbReturn, numSamples);
     }
-    for(int i = 7; i < 16; i++){
-        dbFs[7] += fabsf(*pfSubmix[i]);
-        setParameter(kParam8+i, dbFs[i]);
+    
+    // publish the bus levels for the meter bridge (lock-free, read by the editor)
+    for(int i = 0; i < 19; i++){
+        meterLevels.process(i, pfSubmix[i], numSamples);
     }
+    analysis.pushBus(pSubmix, 19, numSamples);
+    
+    const int iBlockSize = numSamples;
     
     while(numSamples--)
     {
@@ -180,6 +534,10 @@ void MySynth::postProcess(float** outputBuffer, int numChannels, int numSamples)
         }
         
     }
+    
+    masterDrive.setSampleRate(getSampleRate());
+    if(numChannels >= 2)
+        masterDrive.process(outputBuffer, 0, iBlockSize);
 }
 
 ////////////////////////////////////////////////////////////////////////////
@@ -194,42 +552,48 @@ Voice* JUCE_CALLTYPE createVoice() {
 // Triggered when a note is started (use to initialise / prepare note)
 void MyVoice::onStartNote (const int pitch, const float velocity)
 {
-    printf("Note start\n");
+    VoicePool& pool = getSynthesiser()->voicePool;
+    
+    // a stolen voice gives up its previous hit
+    if(isHitPlaying())
+        pool.stop(iHit);
+    iHit = pool.start();
+    dFileRate = 0.0;
     
     this->pitch = pitch;
     //bass drum
     if (pitch == 48){
-        signalGenerator[0] = *getSynthesiser()->getBuffer(0,velocity);
-        signalGenerator[1] = *getSynthesiser()->getBuffer(1,velocity);
+        addMic(getSynthesiser()->getBuffer(0,velocity), 0);
+        addMic(getSynthesiser()->getBuffer(1,velocity), 1);
     }
     //snare
     else if (pitch == 50){
-        signalGenerator[0] = *getSynthesiser()->getBuffer(2,velocity);
-        signalGenerator[1] = *getSynthesiser()->getBuffer(3,velocity);
+        addMic(getSynthesiser()->getBuffer(2,velocity), 2);
+        addMic(getSynthesiser()->getBuffer(3,velocity), 3);
     }
     //hats closed
     else if (pitch == 54){
         for(int i = 0; i < 5; i++){
-            signalGenerator[i] = *getSynthesiser()->getCymbalBuffer(0, velocity, i);
+            addMic(getSynthesiser()->getCymbalBuffer(0, velocity, i), 7 + i);
         }
         
     }
     //hats Rock sizzle
     else if (pitch == 56){
         for(int i = 0; i < 5; i++){
-            signalGenerator[i] = *getSynthesiser()->getCymbalBuffer(2, velocity, i);
+            addMic(getSynthesiser()->getCymbalBuffer(2, velocity, i), 7 + i);
         }
     }
     //openHats
     else if (pitch == 58){
         for(int i = 0; i < 5; i++){
-            signalGenerator[i] = *getSynthesiser()->getCymbalBuffer(3, velocity, i);
+            addMic(getSynthesiser()->getCymbalBuffer(3, velocity, i), 7 + i);
         }
     }
     //Crash crash
     else if (pitch == 60){
         for(int i = 0; i < 5; i++){
-            signalGenerator[i] = *getSynthesiser()->getCymbalBuffer(7, velocity, i);
+            addMic(getSynthesiser()->getCymbalBuffer(7, velocity, i), 7 + i);
         }
     }
     //crash bell
@@ -239,7 +603,7 @@ void MyVoice::onStartNote (const int pitch, const float velocity)
     //ride tip
     else if (pitch == 63){
         for(int i = 0; i < 5; i++){
-            signalGenerator[i] = *getSynthesiser()->getCymbalBuffer(4, velocity, i);
+            addMic(getSynthesiser()->getCymbalBuffer(4, velocity, i), 7 + i);
         }
     }
     //ride crash
@@ -247,136 +611,96 @@ void MyVoice::onStartNote (const int pitch, const float velocity)
     //ride bell
     else if (pitch == 65){
         for(int i = 0; i < 5; i++){
-            signalGenerator[i] = *getSynthesiser()->getCymbalBuffer(5, velocity, i);
+            addMic(getSynthesiser()->getCymbalBuffer(5, velocity, i), 7 + i);
         }
     }
     //splash crash
     else if (pitch == 66){
         for(int i = 0; i < 5; i++){
-            signalGenerator[i] = *getSynthesiser()->getCymbalBuffer(6, velocity, i);
+            addMic(getSynthesiser()->getCymbalBuffer(6, velocity, i), 7 + i);
         }
     }
     //high tom
     else if (pitch == 57){
-        signalGenerator[0] = *getSynthesiser()->getBuffer(4,velocity);
+        addMic(getSynthesiser()->getBuffer(4,velocity), 6);
     }
     //mid tom
     else if (pitch == 55){
-        signalGenerator[0] = *getSynthesiser()->getBuffer(5,velocity);
+        addMic(getSynthesiser()->getBuffer(5,velocity), 5);
     }
     //floor tom
     else if (pitch == 53){
-        signalGenerator[0] = *getSynthesiser()->getBuffer(6,velocity);
+        addMic(getSynthesiser()->getBuffer(6,velocity), 4);
     }
     
     else
     {
-//        for(int i = 0; i < 8; i++){
-//        signalGenerator[i].reset();
-//        }
+        // no drum on this note
+        pool.stop(iHit);
+        iHit = -1;
     }
     
+    // the hit is resampled from the rate its mics were recorded at, as well as tuned
+    if(dFileRate > 0.0)
+        pool.setRate(iHit, getSynthesiser()->getPlaybackRate(pitch, dFileRate));
+    
     fLevel = velocity;
-    iSilenceCount = 0;
+}
+
+// Called once the note-on's position in the block is known
+void MyVoice::onStartOffset (const int offset)
+{
+    getSynthesiser()->voicePool.setDelay(iHit, offset);
+    // the hit cuts off the others in its choke group as it starts
+    if(iHit >= 0)
+        getSynthesiser()->choke(pitch, offset, this);
 }
 
 // Triggered when a note is stopped (return false to keep the note alive)
 bool MyVoice::onStopNote (){
     
-//        noteOffEnv.release(0.75);
+    // the voice lives until its hit ends (see onStopOffset() for releases)
     return false;
 }
 
-// Called to render the note's next buffer of audio (generates the sound)
+// Called once the note-off's position in the block is known
+void MyVoice::onStopOffset (const int offset)
+{
+    const float ms = getSynthesiser()->getReleaseTime(pitch);
+    if(ms > 0.0f)
+        fadeOut(offset, ms);
+}
+
+void MyVoice::fadeOut (int offset, float ms)
+{
+    // the voice is freed (in MySynth::renderVoices()) once the pool ends the hit
+    if(isHitPlaying())
+        getSynthesiser()->voicePool.fadeOut(iHit, offset, ms);
+}
+
+// Not used by the drum synth, which renders its voices' hits in MySynth::renderVoices()
 // (return false to terminate the note)
 bool MyVoice::process (float** outputBuffer, int numChannels, int numSamples)
 {
-    float* pfOutBuffer0 = outputBuffer[0];
-    float* pfOutBuffer1 = outputBuffer[1];
-    float** pfSubmixes = getSynthesiser()->pSubmix;
-    float* pfSubmix[19] = {  pfSubmixes[0], pfSubmixes[1], pfSubmixes[2], pfSubmixes[3], pfSubmixes[4], pfSubmixes[5], pfSubmixes[6],  pfSubmixes[7],  pfSubmixes[8],  pfSubmixes[9],  pfSubmixes[10],  pfSubmixes[11],  pfSubmixes[12],  pfSubmixes[13], pfSubmixes[14],  pfSubmixes[15],  pfSubmixes[16],  pfSubmixes[17],  pfSubmixes[19]};
-    
-    while(numSamples--)
-    {
-        if (pitch == 48)
-        {
-            *pfSubmix[0] += signalGenerator[0].tick();
-            *pfSubmix[1] += signalGenerator[1].tick();
-        }
-        else if (pitch == 50){
-            *pfSubmix[2] += signalGenerator[0].tick();
-            *pfSubmix[3] += signalGenerator[1].tick();
-        }
-        //hats closed tip
-        else if (pitch == 54){
-            for(int i = 7; i < 12; i++){
-                *pfSubmix[i] += signalGenerator[i - 7].tick();
-            }
-//            *pfSubmix[7] += signalGenerator[0].tick();
-//            *pfSubmix[8] += signalGenerator[1].tick();
-//            *pfSubmix[9] += signalGenerator[2].tick();
-//            *pfSubmix[10] += signalGenerator[3].tick();
-//            *pfSubmix[11] += signalGenerator[4].tick();
-        }
-        //hats sizzle
-        else if (pitch == 56){
-            for(int i = 7; i < 12; i++){
-                *pfSubmix[i] += signalGenerator[i - 7].tick();
-            }
-        }
-        //hats open
-        else if (pitch == 58){
-            for(int i = 7; i < 12; i++){
-                *pfSubmix[i] += signalGenerator[i - 7].tick();
-            }
-        }
-        //ride tip
-        else if (pitch == 63){
-            for(int i = 7; i < 12; i++){
-                *pfSubmix[i] += signalGenerator[i - 7].tick();
-            }
-        }
-        //ride bell
-        else if (pitch == 65){
-            for(int i = 7; i < 12; i++){
-                *pfSubmix[i] += signalGenerator[i - 7].tick();
-            }
-        }
-        //splash crash
-        else if (pitch == 66){
-            for(int i = 7; i < 12; i++){
-                *pfSubmix[i] += signalGenerator[i - 7].tick();
-            }
-        }
-        //crash crash
-        else if (pitch == 60){
-            for(int i = 7; i < 12; i++){
-                *pfSubmix[i] += signalGenerator[i - 7].tick();
-            }
-        }
+    return isHitPlaying();
+}
 
-        else if (pitch == 53){
-            *pfSubmix[4] += signalGenerator[0].tick();
-        }
-        else if (pitch == 55){
-            *pfSubmix[5] += signalGenerator[0].tick();
-        }
-        else if (pitch == 57){
-            *pfSubmix[6] += signalGenerator[0].tick();
-        }
-//        for(int i = 0; i < 15; i++){
-//            *pfSubmix[i] *= noteOffEnv.tick();
-//        }
-        for(int i = 0; i < 15; i++){
-            pfSubmix[i]++;
-        }
-        
-        *pfOutBuffer0++ = 0;
-        *pfOutBuffer1++ = 0;
+bool MyVoice::isHitPlaying ()
+{
+    // the pool frees a hit once it ends, after which the index may be reused
+    if(iHit >= 0 && !getSynthesiser()->voicePool.isPlaying(iHit))
+        iHit = -1;
+    return iHit >= 0;
+}
+
+void MyVoice::addMic (const Buffer* buffer, int bus)
+{
+    // the pool plays the kit's sample data in place (the kit outlives every hit),
+    // from the sample's alignment offset
+    if(buffer != NULL && buffer->getSamples() != NULL){
+        const int offset = jmin(buffer->getStartOffset(), buffer->getNumFrames() - 1);
+        getSynthesiser()->voicePool.addMic(iHit, buffer->getSamples() + offset, buffer->getNumFrames() - offset, bus);
+        // (a hit's mics are all recorded at the same rate)
+        dFileRate = buffer->getFileRate();
     }
-    
-    bool bActuallyEnding = !signalGenerator[0].isFinished() || !signalGenerator[1].isFinished() || !signalGenerator[2].isFinished() || !signalGenerator[3].isFinished() || !signalGenerator[4].isFinished();
-    if(!bActuallyEnding)
-        printf("Note terminated.\n");
-    return bActuallyEnding;
 }
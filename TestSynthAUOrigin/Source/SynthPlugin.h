@@ -10,29 +10,48 @@
 
 #include "PluginProcessor.h"
 #include "SynthExtra.h"
+#include "VoicePool.h"
+#include "BusEQ.h"
+#include "BusDynamics.h"
+#include "BusSaturation.h"
+#include "ConvolutionReverb.h"
+#include "MicAlignment.h"
+#include "KitFile.h"
+#include "KitCache.h"
 #include <sstream>
 
 //===================================================================================
-/** An example STK-voice, based on a sine wave generator                           */
+/** A drum voice. The voice only chooses the samples for a hit; their playback
+    state lives in the synth's VoicePool, which renders every hit in one pass.     */
 class MyVoice : public Voice
 {
 public:
-    int iSilenceCount;
+    MyVoice() : pitch(0), fLevel(0.0f), iHit(-1), dFileRate(0.0) {}
     
     void onStartNote (const int pitch, const float velocity);
+    void onStartOffset (const int offset);
     bool onStopNote ();
+    void onStopOffset (const int offset);
     
     //    void onPitchWheel (const int value);
     //    void onControlChange (const int controller, const int value);
     
     bool process (float** outputBuffer, int numChannels, int numSamples);
     
+    // true while the voice's hit is still playing in the pool
+    bool isHitPlaying ();
+    int getPitch () const { return pitch; }
+    // fades the voice's hit out from a sample of the current block (see VoicePool)
+    void fadeOut (int offset, float ms);
+    
 private:
-    //array of signal generators
-    Buffer signalGenerator[8];
-    Envelope noteOffEnv;
+    // adds a mic of the hit, played into the given submix
+    void addMic (const Buffer* buffer, int bus);
+    
     int pitch;
     float fLevel;
+    int iHit;   // the voice's hit in the synth's VoicePool (-1 if none)
+    double dFileRate;   // the rate the hit's samples were recorded at
 };
 
 struct VelRange
@@ -49,9 +68,9 @@ struct VelRange
         2,
         1,
     };
-    Buffer* getNextSample(){
-        int chosen = randomNumbers[rand() % 10];
-        printf("Sampl chosen");
+    // the next round robin, drawn from the synth's sequence (see MySynth::setDeterministic())
+    Buffer* getNextSample(Random& sequence){
+        int chosen = randomNumbers[sequence.nextInt(10)];
         return &samples[chosen];
     };
     
@@ -93,32 +112,162 @@ struct CymbalMics
 {
     Drum mics[8];
 };
+
+//===================================================================================
+/** The sample data for a whole kit, as recorded (hits are resampled to the host's
+    rate as they play). Kits are loaded once per process and shared by every plugin
+    instance using the same kit folder.                                            */
+class DrumKit : public ReferenceCountedObject
+{
+public:
+    typedef ReferenceCountedObjectPtr<DrumKit> Ptr;
+    
+    // returns the shared kit for a folder, loading it if no instance has yet
+    static Ptr acquire (const String& path);
+    // drops an instance's reference, unloading the kit when the last one goes
+    static void release (Ptr& kit);
+    
+    const String& getPath() const { return kitPath; }
+    
+    Drum buffer[8];
+    CymbalMics cymbals[8];
+    
+private:
+    DrumKit (const String& path) : kitPath(path) {}
+    
+    void load ();
+    // a recording, by its number in the KitLayout
+    Buffer& getSample (int articulation, int mic, int velocity, int roundRobin);
+    // lines the distant mics of every recorded hit up with its close mic
+    void alignMics (KitCache& cache);
+    void alignHit (MicAligner& aligner, KitCache& cache, const int* articulations, const int* mics,
+                   int numMics, int velocity, int roundRobin);
+    
+    String kitPath;
+    
+    static GuardedCriticalSection cacheLock;
+    static ReferenceCountedArray<DrumKit> cache;
+    
+    JUCE_DECLARE_NON_COPYABLE (DrumKit)
+};
+
 class MySynth : public Synth
 {
 public:
-    MySynth() : Synth() {
+    MySynth() : Synth(), eq(19), dynamics(19), drive(19), masterDrive(2, BusSaturation::kTube), reverbSend(1, 16384), reverbReturn(2, 16384), fReverbReturn(1.0f), iSeed(0) {
         initialise();
     }
+    ~MySynth();
+    
+    // the room reverb: loads an impulse (in the background, at the host's rate - it's
+    // loaded again by prepareToPlay() if that changes), and sets the level each bus
+    // sends to it and the level of its return in the mix
+    void loadRoomImpulse(const File& file) { reverb.loadImpulse(file, getSampleRate() > 0.0 ? getSampleRate() : SAMPLE_RATE); }
+    File getRoomImpulse() const { return reverb.getImpulseFile(); }
+    void setReverbSend(int bus, float level) { if(bus >= 0 && bus < 19) fReverbSend[bus] = jmax(0.0f, level); }
+    float getReverbSend(int bus) const { return bus >= 0 && bus < 19 ? fReverbSend[bus] : 0.0f; }
+    void setReverbReturn(float level) { fReverbReturn = jmax(0.0f, level); }
+    float getReverbReturn() const { return fReverbReturn; }
+    bool waitUntilReady(int timeoutMs) { return reverb.waitForImpulse(timeoutMs); }
+    
+    // A drum's tuning is a parameter (the "Tune" knobs, up to 12 semitones either way),
+    // taken up from its next hit; notes without a drum aren't tuned.
+    static int getTuningParameter(int note);
+    double getTuningRate(int note) const {
+        const int parameter = getTuningParameter(note);
+        return parameter >= 0 ? pow(2.0, jlimit(-12.0f, 12.0f, getParameter(parameter)) / 12.0) : 1.0;
+    }
+    // the speed a drum's samples play at: its tuning, and their recorded rate against
+    // the host's (the kit is loaded as recorded, whatever the host's rate)
+    double getPlaybackRate(int note, double fileRate) const {
+        return getSampleRate() > 0.0 ? getTuningRate(note) * fileRate / getSampleRate() : getTuningRate(note);
+    }
+    
+    // A drum's note-off fades it out over the given time (in ms), or is ignored if it's
+    // 0 (the default - drums are one-shots).
+    void setReleaseTime(int note, float ms) { if(note >= 0 && note < 128) fReleaseTime[note] = jmax(0.0f, ms); }
+    float getReleaseTime(int note) const { return fReleaseTime[note & 127]; }
+    
+    // Drums in the same choke group (other than 0) cut each other off: each hit fades
+    // out the group's sounding hits over the choke time (in ms), from its own start.
+    void setChokeGroup(int note, int group) { if(note >= 0 && note < 128) iChokeGroup[note] = group; }
+    int getChokeGroup(int note) const { return iChokeGroup[note & 127]; }
+    void setChokeTime(float ms) { fChokeTime = jmax(0.0f, ms); }
+    float getChokeTime() const { return fChokeTime; }
+    void choke(int note, int offset, MyVoice* pChoker);
     
     void initialise ();
+    void prepareToPlay (double sampleRate, int samplesPerBlock);
+    int getLatency () const;
     void postProcess (float** outputBuffer, int numChannels, int numSamples);
     
+    // (re)starts the round robin sequence from the seed, when deterministic
+    void setDeterministic (bool enabled, int64 seed);
+    // (deterministic) draws the hit's round robins from the seed and its position
+    void prepareNote (int note, int64 position);
+    
+    // the mix processing's and the drums' settings, kept in the plugin's state (see
+    // Synth::saveSettings())
+    void saveSettings (XmlElement& xml) const;
+    void loadSettings (const XmlElement& xml);
+    // changes with every loadSettings(), for editors showing the settings
+    int getSettingsVersion() const { return settingsVersion.get(); }
+    
+    int getNumBuses() const { return 19; }
+    float** getBuses() { return pSubmix; }
+    String getBusName (int bus) const;
+    int getNumSoundingHits() const { return voicePool.getNumActive(); }
+    
+    void renderVoices (AudioSampleBuffer& outputBuffer, int startSample, int numSamples);
+    void renderItem (int item, int worker);
+    
     const Buffer* getBuffer(int timbre, float velocity){
+        if(kit == nullptr)
+            return NULL;
         velocity *= 127;
-        return buffer[timbre].getVelRange(velocity)->getNextSample();
+        return kit->buffer[timbre].getVelRange(velocity)->getNextSample(roundRobins);
     }
     const Buffer* getCymbalBuffer(int timbre, float velocity, int mics){
+        if(kit == nullptr)
+            return NULL;
         velocity *= 127;
         
-        return cymbals[timbre].mics[mics].getVelRange(velocity)->getNextSample();
+        return kit->cymbals[timbre].mics[mics].getVelRange(velocity)->getNextSample(roundRobins);
         
     }
     float* pSubmix[19];
     
+    // the playback state of every sounding hit
+    VoicePool voicePool;
+    
+    // the channel EQ on each mic bus (applied in postProcess(), ahead of the mix)
+    BusEQ eq;
+    // the compressor and transient shaper on each mic bus (after the EQ)
+    BusDynamics dynamics;
+    // oversampled drive on the mic buses (for the kick and snare, after the dynamics)
+    // and on the main outputs (after the mix) - all bypassed until set up
+    BusSaturation drive;
+    BusSaturation masterDrive;
+    
+private:
+    void resetDrums();
+    
+    ConvolutionReverb reverb;
+    AudioSampleBuffer reverbSend, reverbReturn;
+    float fReverbSend[19];
+    float fReverbReturn;
+    float fReleaseTime[128];
+    int iChokeGroup[128];
+    float fChokeTime;
+    // picks each hit's round robins (seeded from the clock, unless deterministic)
+    Random roundRobins;
+    int64 iSeed;
+    Atomic<int> settingsVersion;
+    
+    
 private:
     // Insert synthesizer variables here
-    Drum buffer[8];
-    CymbalMics cymbals[8];
+    DrumKit::Ptr kit;
     float fMix;
     
 };
@@ -0,0 +1,401 @@
+//
+//  VoicePool.h
+//  TestSynthAU
+//
+//  The playback state of every sounding drum hit, stored as flat arrays (one entry
+//  per hit, or per hit and mic) rather than inside the voices, so the per-block
+//  render loop only touches a few contiguous cache lines. Voices just own a hit.
+//  Hits can be tuned, in which case they're resampled through the SincKernel, and
+//  faded out (released or choked) from any sample in a block.
+//
+
+#ifndef __VoicePool_h__
+#define __VoicePool_h__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "SincKernel.h"
+#include "PluginWrapper.h"
+
+class VoicePool
+{
+public:
+    enum { kMaxHits = 32, kMaxMics = 5 };
+
+    VoicePool()
+    :   numActive(0), fSilenceThreshold(0.0f), iSilenceHold(0), dSampleRate(44100.0)
+    {
+        for(int h=0; h<kMaxHits; h++){
+            bPlaying[h] = false;
+            iNumMics[h] = 0;
+        }
+
+        // build the interpolation tables now, rather than on the first tuned hit
+        SincKernel::getInstance();
+    }
+
+    // A hit is freed early once every mic it plays has stayed below fThreshold for
+    // holdSamples (0 disables this, leaving hits to play to the end of their samples).
+    void setSilenceDetection(float fThreshold, int holdSamples)
+    {
+        fSilenceThreshold = fThreshold;
+        iSilenceHold = holdSamples;
+    }
+
+    // (for fade times, from the next hit)
+    void setSampleRate(double sampleRate) { if(sampleRate > 0.0) dSampleRate = sampleRate; }
+
+    //==============================================================================
+    // Claims a free hit, returning its index (or -1 if all are playing). Mics are
+    // then added with addMic(); the hit starts playing at the next render.
+    int start()
+    {
+        for(int h=0; h<kMaxHits; h++){
+            if(!bPlaying[h]){
+                bPlaying[h] = true;
+                iNumMics[h] = 0;
+                iPosition[h] = 0;
+                iRemaining[h] = 0;
+                iDelay[h] = 0;
+                iSilenceCount[h] = 0;
+                iElapsed[h] = 0;
+                fWindowPeak[h] = 0.0f;
+                fGain[h] = 1.0f;
+                dRate[h] = 1.0;
+                dPhase[h] = 0.0;
+                iTable[h] = 0;
+                iFadeDelay[h] = -1;
+                bFading[h] = false;
+                fade[h].set(Envelope::Points(0.0f, 1.0f), BlockEnvelope::kExponential, dSampleRate);
+                iActive[numActive++] = h;
+                return h;
+            }
+        }
+        return -1;
+    }
+
+    // Adds a mic to a hit: numFrames of mono sample data, mixed into the given bus.
+    // The data is played in place, so must outlive the hit.
+    void addMic(int hit, const float* samples, int numFrames, int bus)
+    {
+        if(!isPlaying(hit) || iNumMics[hit] >= kMaxMics || samples == NULL || numFrames <= 0)
+            return;
+
+        const int m = iNumMics[hit]++;
+        pfSource[hit][m] = samples;
+        iLength[hit][m] = numFrames;
+        iBus[hit][m] = bus;
+        iRemaining[hit] = jmax(iRemaining[hit], numFrames);
+    }
+
+    // delays the start of a hit by a number of samples into the next render
+    void setDelay(int hit, int samples) { if(isPlaying(hit)) iDelay[hit] = jmax(0, samples); }
+    void setGain(int hit, float gain) { if(isPlaying(hit)) fGain[hit] = gain; }
+
+    // Plays a hit back at a different speed (and so pitch), from a quarter to four
+    // times speed: source frames per output frame, so it takes in the sample's
+    // recorded rate against the output's as well as any tuning. Set it before the
+    // hit's first render.
+    void setRate(int hit, double rate)
+    {
+        if(!isPlaying(hit))
+            return;
+
+        dRate[hit] = jlimit(0.25, 4.0, rate);
+        iTable[hit] = SincKernel::getTable(dRate[hit]);
+    }
+
+    // Fades a hit out over the given time (in ms), starting the given number of
+    // samples into the next render, and frees it once the fade reaches zero. A fade
+    // doesn't replace one that's already scheduled or playing unless it's shorter.
+    void fadeOut(int hit, int offset, float ms)
+    {
+        if(!isPlaying(hit))
+            return;
+
+        const float time = jmax(0.0f, ms) * 0.001f;
+        if(bFading[hit] && time >= fFadeTime[hit])
+            return;
+
+        iFadeDelay[hit] = jmax(0, offset);
+        fFadeTime[hit] = time;
+        bFading[hit] = true;
+    }
+
+    bool isFading(int hit) const { return isPlaying(hit) && bFading[hit]; }
+
+    // frees a hit immediately
+    void stop(int hit)
+    {
+        if(!isPlaying(hit))
+            return;
+
+        bPlaying[hit] = false;
+        for(int a=0; a<numActive; a++){
+            if(iActive[a] == hit){
+                removeActive(a);
+                break;
+            }
+        }
+    }
+
+    bool isPlaying(int hit) const { return hit >= 0 && hit < kMaxHits && bPlaying[hit]; }
+
+    //==============================================================================
+    // number of hits to render this block (renderHit() takes 0 to getNumActive()-1)
+    int getNumActive() const { return numActive; }
+
+    // Mixes the index'th active hit into the buses, from startSample. Hits only
+    // touch their own state, so different hits may be rendered on different threads
+    // (into different buses), as long as finishBlock() follows on one thread.
+    void renderHit(int index, float** buses, int startSample, int numSamples)
+    {
+        const int h = iActive[index];
+
+        // a hit started part way through the block
+        const int delay = jmin(iDelay[h], numSamples);
+        iDelay[h] -= delay;
+        startSample += delay;
+        numSamples -= delay;
+        if(iFadeDelay[h] > 0)
+            iFadeDelay[h] = jmax(0, iFadeDelay[h] - delay);
+        if(numSamples <= 0)
+            return;
+
+        // in pieces that end on the hit's own kBlock grid, where its silence is judged -
+        // so it's ended at the same sample whichever way the blocks split its playback
+        while(numSamples > 0 && iRemaining[h] > 0){
+            const int n = jmin(numSamples, (int)kBlock - iElapsed[h] % kBlock);
+            fWindowPeak[h] = jmax(fWindowPeak[h], renderPiece(h, buses, startSample, n));
+            startSample += n;
+            numSamples -= n;
+            iElapsed[h] += n;
+
+            if(iElapsed[h] % kBlock == 0){
+                if(fWindowPeak[h] < fSilenceThreshold)
+                    iSilenceCount[h] += kBlock;
+                else
+                    iSilenceCount[h] = 0;
+                fWindowPeak[h] = 0.0f;
+
+                if(iSilenceHold > 0 && iSilenceCount[h] > iSilenceHold)
+                    iRemaining[h] = 0;
+            }
+        }
+    }
+
+    // frees the hits that have finished (or fallen silent) - call after rendering
+    void finishBlock()
+    {
+        for(int a=numActive; --a >= 0;){
+            const int h = iActive[a];
+            if(iRemaining[h] <= 0){
+                bPlaying[h] = false;
+                removeActive(a);
+            }
+        }
+    }
+
+    // renders all active hits, then frees those that have finished
+    void render(float** buses, int startSample, int numSamples)
+    {
+        for(int a=0; a<numActive; a++)
+            renderHit(a, buses, startSample, numSamples);
+        finishBlock();
+    }
+
+private:
+    enum { kBlock = 64 };
+
+    // Keeps the rest in the order they started, so the hits are always mixed into a bus
+    // in the same order (and round the same way) however the blocks fall.
+    void removeActive(int a)
+    {
+        numActive--;
+        for(; a<numActive; a++)
+            iActive[a] = iActive[a + 1];
+    }
+
+    // Renders part of a hit (within one of its kBlock windows), returning its peak.
+    float renderPiece(int h, float** buses, int startSample, int numSamples)
+    {
+        if(dRate[h] != 1.0 || dPhase[h] != 0.0)
+            return renderTuned(h, buses, startSample, numSamples);
+        if(bFading[h])
+            return renderFaded(h, buses, startSample, numSamples);
+
+        const int pos = iPosition[h];
+        const float gain = fGain[h];
+        float fPeak = 0.0f;
+
+        for(int m=0; m<iNumMics[h]; m++){
+            const int n = jmin(numSamples, iLength[h][m] - pos);
+            if(n <= 0)
+                continue;
+
+            const float* src = pfSource[h][m] + pos;
+            FloatVectorOperations::addWithMultiply(buses[iBus[h][m]] + startSample, src, gain, n);
+
+            float fMin, fMax;
+            FloatVectorOperations::findMinAndMax(src, n, fMin, fMax);
+            fPeak = jmax(fPeak, fMax, -fMin);
+        }
+
+        iPosition[h] = pos + numSamples;
+        iRemaining[h] -= numSamples;
+        return fPeak * gain;
+    }
+
+    // The next numSamples (up to kBlock) gains of a fading hit: its gain, held until
+    // the fade's offset and then ramped down.
+    void getFadeGains(int h, float* gains, int numSamples)
+    {
+        int hold = 0;
+        if(iFadeDelay[h] >= 0){
+            hold = jmin(iFadeDelay[h], numSamples);
+            fade[h].process(gains, hold);
+            iFadeDelay[h] -= hold;
+            if(hold < numSamples){
+                fade[h].release(fFadeTime[h]);
+                iFadeDelay[h] = -1;
+            }
+        }
+        fade[h].process(gains + hold, numSamples - hold);
+        FloatVectorOperations::multiply(gains, fGain[h], numSamples);
+    }
+
+    // Renders a hit that's being faded out, a block of gains at a time, ending it as
+    // soon as the fade reaches zero.
+    float renderFaded(int h, float** buses, int startSample, int numSamples)
+    {
+        const int pos = iPosition[h];
+        float fPeak = 0.0f;
+        float gains[kBlock], faded[kBlock];
+
+        int done = 0;
+        while(done < numSamples && !fade[h].isOff()){
+            const int n = jmin((int)kBlock, numSamples - done);
+            getFadeGains(h, gains, n);
+
+            for(int m=0; m<iNumMics[h]; m++){
+                const int k = jmin(n, iLength[h][m] - (pos + done));
+                if(k <= 0)
+                    continue;
+
+                FloatVectorOperations::copy(faded, pfSource[h][m] + pos + done, k);
+                FloatVectorOperations::multiply(faded, gains, k);
+                FloatVectorOperations::add(buses[iBus[h][m]] + startSample + done, faded, k);
+
+                float fMin, fMax;
+                FloatVectorOperations::findMinAndMax(faded, k, fMin, fMax);
+                fPeak = jmax(fPeak, fMax, -fMin);
+            }
+            done += n;
+        }
+
+        iPosition[h] = pos + done;
+        iRemaining[h] = fade[h].isOff() ? 0 : iRemaining[h] - done;
+        return fPeak;
+    }
+
+    // Renders a hit that's been tuned. Each output sample's source position and
+    // interpolation weights are worked out once, then applied to all the hit's mics.
+    float renderTuned(int h, float** buses, int startSample, int numSamples)
+    {
+        enum { kTaps = SincKernel::kTaps, kCentre = SincKernel::kTaps / 2 - 1 };
+
+        const SincKernel& kernel = SincKernel::getInstance();
+        const double rate = dRate[h];
+        int pos = iPosition[h];
+        double phase = dPhase[h];
+        float fPeak = 0.0f;
+
+        float weights[kBlock * kTaps];
+        int first[kBlock];
+        float gains[kBlock];
+
+        for(int done=0; done<numSamples && !fade[h].isOff(); done+=kBlock){
+            const int n = jmin((int)kBlock, numSamples - done);
+            if(bFading[h])
+                getFadeGains(h, gains, n);
+            else
+                FloatVectorOperations::fill(gains, fGain[h], n);
+
+            for(int s=0; s<n; s++){
+                kernel.getWeights(iTable[h], (float)phase, weights + s * kTaps);
+                first[s] = pos - kCentre;
+                phase += rate;
+                const int whole = (int)phase;
+                pos += whole;
+                phase -= whole;
+            }
+
+            for(int m=0; m<iNumMics[h]; m++){
+                const float* src = pfSource[h][m];
+                const int length = iLength[h][m];
+                float* dst = buses[iBus[h][m]] + startSample + done;
+
+                for(int s=0; s<n && first[s] < length; s++){
+                    const float* w = weights + s * kTaps;
+                    float y;
+                    if(first[s] >= 0 && first[s] + kTaps <= length){
+                        y = SincKernel::apply(w, src + first[s]);
+                    }else{
+                        // the kernel hangs off the start or end of the sample
+                        y = 0.0f;
+                        for(int t = jmax(0, -first[s]); t < kTaps && first[s] + t < length; t++)
+                            y += w[t] * src[first[s] + t];
+                    }
+                    y *= gains[s];
+                    dst[s] += y;
+                    fPeak = jmax(fPeak, fabsf(y));
+                }
+            }
+        }
+
+        // (the kernel reaches kCentre frames past the position, so the hit lasts until
+        // it's left the longest mic - were it cut off sooner, the last few samples
+        // would depend on whether a block boundary split their window)
+        int longest = 0;
+        for(int m=0; m<iNumMics[h]; m++)
+            longest = jmax(longest, iLength[h][m]);
+        iRemaining[h] = fade[h].isOff() ? 0 : longest + kCentre - pos;
+        iPosition[h] = pos;
+        dPhase[h] = phase;
+        return fPeak;
+    }
+
+    // per hit
+    int iPosition[kMaxHits];        // frames played (shared by all the hit's mics)
+    int iRemaining[kMaxHits];       // frames until the longest mic ends
+    int iDelay[kMaxHits];
+    int iSilenceCount[kMaxHits];    // samples the hit's been silent for, by whole windows
+    int iElapsed[kMaxHits];         // samples rendered (after its delay)
+    float fWindowPeak[kMaxHits];    // the peak so far in the current window
+    float fGain[kMaxHits];
+    double dRate[kMaxHits];         // source frames per output frame
+    double dPhase[kMaxHits];        // how far past iPosition playback is (0 to 1)
+    int iTable[kMaxHits];           // which of the kernel's tables (by rate)
+    int iFadeDelay[kMaxHits];       // samples until a scheduled fade starts (-1 if none)
+    float fFadeTime[kMaxHits];      // in seconds
+    bool bFading[kMaxHits];
+    BlockEnvelope fade[kMaxHits];
+    int iNumMics[kMaxHits];
+    bool bPlaying[kMaxHits];
+
+    // per hit and mic
+    const float* pfSource[kMaxHits][kMaxMics];
+    int iLength[kMaxHits][kMaxMics];
+    int iBus[kMaxHits][kMaxMics];
+
+    // the playing hits, packed at the front (in the order they started)
+    int iActive[kMaxHits];
+    int numActive;
+
+    float fSilenceThreshold;
+    int iSilenceHold;
+    double dSampleRate;
+
+    JUCE_DECLARE_NON_COPYABLE (VoicePool)
+};
+
+#endif
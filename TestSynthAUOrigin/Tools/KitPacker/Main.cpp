@@ -0,0 +1,41 @@
+//
+//  Main.cpp
+//  KitPacker
+//
+//  Packs a kit's folder of WAVs into the single file the plugin loads in their place
+//  (see Source/KitFile.h). Built as a console app against the plugin's
+//  JuceLibraryCode (only juce_core and juce_audio_formats are used):
+//
+//      KitPacker <wav folder> [<output file>]
+//
+//  The output defaults to Kit.drumkit in the WAV folder, which is where the plugin
+//  looks for it.
+//
+
+#include "../../Source/KitFile.h"
+
+int main (int argc, char* argv[])
+{
+    if(argc < 2){
+        printf("usage: KitPacker <wav folder> [<output file>]\n");
+        return 1;
+    }
+    
+    const File folder (File::getCurrentWorkingDirectory().getChildFile(argv[1]));
+    const File output (argc > 2 ? File::getCurrentWorkingDirectory().getChildFile(argv[2])
+                                : folder.getChildFile(KitFile::getDefaultFileName()));
+    
+    if(!folder.isDirectory()){
+        printf("KitPacker - %s is not a folder\n", folder.getFullPathName().toRawUTF8());
+        return 1;
+    }
+    
+    const int numPacked = KitFileWriter::write(folder, output);
+    if(numPacked == 0){
+        printf("KitPacker - nothing packed into %s\n", output.getFullPathName().toRawUTF8());
+        return 1;
+    }
+    
+    printf("KitPacker - packed %d samples into %s\n", numPacked, output.getFullPathName().toRawUTF8());
+    return 0;
+}
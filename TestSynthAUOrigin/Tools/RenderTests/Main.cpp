@@ -0,0 +1,45 @@
+//
+//  Main.cpp
+//  RenderTests
+//
+//  Runs the plugin's unit tests - the golden render tests in Source/RenderTests.cpp
+//  and the engine's in Source/EngineTests.cpp - from the command line, returning the
+//  number of failures.
+//  Built as a console app from the plugin's sources and JuceLibraryCode, with
+//  TESTSYNTHAU_UNIT_TESTS=1 (Builds/Linux/Makefile builds it that way):
+//
+//      RenderTests [--update] [<golden folder>]
+//
+//  The golden folder defaults to Tests/Golden in the working directory. --update
+//  rewrites the golden WAVs from this build's renders (check them by ear first).
+//
+
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/RealtimeGuardHooks.h"
+
+void setGoldenRenderOptions (const File& folder, bool rewrite);
+
+int main (int argc, char* argv[])
+{
+    bool bUpdate = false;
+    File folder (File::getCurrentWorkingDirectory().getChildFile ("Tests/Golden"));
+    
+    for(int a = 1; a < argc; a++){
+        if(String(argv[a]) == "--update")
+            bUpdate = true;
+        else
+            folder = File::getCurrentWorkingDirectory().getChildFile(argv[a]);
+    }
+    
+    setGoldenRenderOptions(folder, bUpdate);
+    
+    UnitTestRunner runner;
+    runner.runAllTests();
+    
+    int numFailures = 0;
+    for(int r = 0; r < runner.getNumResults(); r++)
+        numFailures += runner.getResult(r)->failures;
+    
+    printf("RenderTests - %d failure(s)%s\n", numFailures, bUpdate ? " (golden renders rewritten)" : "");
+    return numFailures;
+}
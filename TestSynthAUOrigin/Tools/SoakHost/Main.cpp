@@ -0,0 +1,342 @@
+//
+//  Main.cpp
+//  SoakHost
+//
+//  Plays the processor into a null audio device for as long as it's asked to, and
+//  reports what went wrong. A high-priority thread stands in for the device: it asks
+//  for each block when a real one would (from the wall clock), with random drum hits
+//  in its MIDI, and counts an xrun whenever processBlock() isn't done by the block's
+//  deadline. The hits come in bursts, with a rest after each long enough for the
+//  kit to ring out - after which every voice and hit should have ended (a leak if
+//  not). Memory is measured against the process's size after the first burst.
+//  Built with Builds/Linux/Makefile:
+//
+//      SoakHost [--hours <h>] [--minutes <m>] [--seconds <s>] [--rate <hz>]
+//               [--block <n>[,<n>...]] [--density <hits per second>] [--play <s>]
+//               [--rest <s>] [--report <s>] [--max-xruns <n>] [--max-growth <MB>]
+//               [--resources <folder>] [--fast]
+//
+//  With a list of block sizes, each block picks one (as some hosts' do). --fast
+//  skips the wall-clock pacing - each block just has to render in its own duration.
+//  Returns the number of checks failed (xruns, leaks, memory growth and - in debug
+//  builds - real-time violations).
+//
+
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/RealtimeGuardHooks.h"
+
+//==============================================================================
+struct SoakOptions
+{
+    SoakOptions() : fSeconds(3600.0), fSampleRate(44100.0), fDensity(8.0), fPlaySeconds(120.0), fRestSeconds(30.0),
+                    fReportSeconds(60.0), iMaxXruns(0), fMaxGrowthMB(16.0), bFast(false) {}
+
+    double fSeconds;
+    double fSampleRate;
+    Array<int> blockSizes;
+    double fDensity;
+    double fPlaySeconds, fRestSeconds;
+    double fReportSeconds;
+    int iMaxXruns;
+    double fMaxGrowthMB;
+    String resources;
+    bool bFast;
+
+    int getMaxBlockSize() const {
+        int iMax = 0;
+        for(int b = 0; b < blockSizes.size(); b++)
+            iMax = jmax(iMax, blockSizes[b]);
+        return iMax;
+    }
+};
+
+//==============================================================================
+/** The null device: renders the stream on its own thread, keeping time with the
+    wall clock, and keeps the counts the main thread reports.                     */
+class NullDevice : public Thread
+{
+public:
+    NullDevice (PluginAudioProcessor& p, const SoakOptions& o)
+    : Thread("Soak Device"), processor(p), options(o), output(2, o.getMaxBlockSize()), random(1),
+      iNumPending(0)
+    {
+        midi.ensureSize(4096);
+    }
+
+    // (read by the main thread while the device runs)
+    Atomic<int64> numSamples;
+    Atomic<int64> numCallbacks;
+    Atomic<int> numXruns;
+    Atomic<int> numLateStarts;      // (the xruns where the block was asked for late - the
+                                    // thread was woken late - rather than rendered slowly)
+    Atomic<int> iWorstLoad;         // the slowest block since the last report, in % of its duration
+    Atomic<int> numLeakChecks, numLeaks;
+    Atomic<int> iLeakedVoices, iLeakedHits;     // at the last check
+    Atomic<int> numBursts;
+
+    void run()
+    {
+        const double fTicksPerSecond = (double) Time::getHighResolutionTicksPerSecond();
+        const int64 iTotal = (int64) (options.fSeconds * options.fSampleRate);
+        const int64 iCycle = (int64) ((options.fPlaySeconds + options.fRestSeconds) * options.fSampleRate);
+        const int64 iPlay = (int64) (options.fPlaySeconds * options.fSampleRate);
+
+        int64 iStart = Time::getHighResolutionTicks();  // the stream's time zero (moved on by an xrun)
+        int64 iPosition = 0;
+        double fNextHit = 0.0;
+
+        while(iPosition < iTotal && !threadShouldExit()){
+            const int n = (int) jmin((int64) options.blockSizes[random.nextInt(options.blockSizes.size())], iTotal - iPosition);
+
+            // the device asks for the block as the previous one starts playing
+            const int64 iDue = iStart + (int64) (iPosition / options.fSampleRate * fTicksPerSecond);
+            const int64 iBudget = (int64) (n / options.fSampleRate * fTicksPerSecond);
+            if(!options.bFast)
+                waitUntil(iDue, fTicksPerSecond);
+
+            // this block's hits and their note-offs, in bursts with a rest between
+            midi.clear();
+            const int64 iInCycle = iPosition % iCycle;
+            if(iInCycle < iPlay)
+                addHits(midi, iPosition, n, fNextHit);
+            else
+                fNextHit = (double) (iPosition + iCycle - iInCycle);
+            addNoteOffs(midi, iPosition, n);
+
+            AudioSampleBuffer block (output.getArrayOfChannels(), 2, n);
+            block.clear();
+
+            const int64 iBefore = Time::getHighResolutionTicks();
+            processor.processBlock(block, midi);
+            const int64 iAfter = Time::getHighResolutionTicks();
+
+            const int iLoad = (int) (100 * (iAfter - iBefore) / jmax((int64) 1, iBudget));
+            for(int iWorst = iWorstLoad.get(); iLoad > iWorst; iWorst = iWorstLoad.get())
+                if(iWorstLoad.compareAndSetBool(iLoad, iWorst))
+                    break;
+
+            // late - the device would have played a gap; start its clock again from here
+            if(iAfter - iBefore > iBudget || (!options.bFast && iAfter > iDue + iBudget)){
+                ++numXruns;
+                if(iAfter - iBefore <= iBudget)
+                    ++numLateStarts;
+                iStart = iAfter - (int64) ((iPosition + n) / options.fSampleRate * fTicksPerSecond);
+            }
+
+            // at the end of a rest, everything should have rung out
+            const int64 iNext = iPosition + n;
+            if(iInCycle >= iPlay && iNext % iCycle < iInCycle){
+                const int iVoices = processor.getNumActiveVoices();
+                const int iHits = processor.getNumSoundingHits();
+                iLeakedVoices = iVoices;
+                iLeakedHits = iHits;
+                ++numLeakChecks;
+                if(iVoices > 0 || iHits > 0)
+                    ++numLeaks;
+                ++numBursts;
+            }
+
+            iPosition = iNext;
+            numSamples = iPosition;
+            ++numCallbacks;
+        }
+    }
+
+private:
+    enum { kMaxPending = 256 };
+
+    void waitUntil (int64 iTicks, double fTicksPerSecond)
+    {
+        for(;;){
+            const double fMs = (iTicks - Time::getHighResolutionTicks()) * 1000.0 / fTicksPerSecond;
+            if(fMs <= 0.0)
+                return;
+            if(fMs > 2.0)
+                Thread::sleep((int) fMs - 1);
+            else
+                Thread::yield();
+        }
+    }
+
+    void addHits (MidiBuffer& buffer, int64 iPosition, int n, double& fNextHit)
+    {
+        static const int notes[] = { 48, 50, 54, 56, 58, 60, 63, 65, 66, 57, 55, 53 };
+
+        while(fNextHit < (double) (iPosition + n)){
+            const int iOffset = jmax(0, (int) (fNextHit - iPosition));
+            const int note = notes[random.nextInt(numElementsInArray(notes))];
+            buffer.addEvent(MidiMessage::noteOn(1, note, (uint8) (1 + random.nextInt(127))), iOffset);
+
+            // each hit's note-off follows it (as a pad's would), 20 to 500ms later
+            if(iNumPending < kMaxPending){
+                pendingNotes[iNumPending] = note;
+                pendingOffs[iNumPending] = iPosition + iOffset + (int64) ((0.02 + 0.48 * random.nextDouble()) * options.fSampleRate);
+                iNumPending++;
+            }
+
+            // (exponential gaps - the hits arrive at random, fDensity a second)
+            fNextHit += -log(1.0 - random.nextDouble()) / options.fDensity * options.fSampleRate;
+        }
+    }
+
+    void addNoteOffs (MidiBuffer& buffer, int64 iPosition, int n)
+    {
+        for(int p = iNumPending; --p >= 0;){
+            if(pendingOffs[p] < iPosition + n){
+                buffer.addEvent(MidiMessage::noteOff(1, pendingNotes[p]), (int) jmax((int64) 0, pendingOffs[p] - iPosition));
+                iNumPending--;
+                pendingNotes[p] = pendingNotes[iNumPending];
+                pendingOffs[p] = pendingOffs[iNumPending];
+            }
+        }
+    }
+
+    PluginAudioProcessor& processor;
+    const SoakOptions& options;
+    AudioSampleBuffer output;
+    MidiBuffer midi;
+    Random random;
+
+    int pendingNotes[kMaxPending];
+    int64 pendingOffs[kMaxPending];
+    int iNumPending;
+
+    JUCE_DECLARE_NON_COPYABLE (NullDevice)
+};
+
+//==============================================================================
+// the process's resident size, in MB (0 where it isn't measured)
+static double getResidentMB()
+{
+#if JUCE_LINUX
+    StringArray fields;
+    fields.addTokens(File("/proc/self/statm").loadFileAsString(), " ", String::empty);
+    if(fields.size() > 1)
+        return fields[1].getLargeIntValue() * (double) sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+#endif
+    return 0.0;
+}
+
+static bool parseOptions (int argc, char* argv[], SoakOptions& options)
+{
+    for(int a = 1; a < argc; a++){
+        const String arg (argv[a]);
+        const String value (a + 1 < argc ? String(argv[a + 1]) : String::empty);
+
+        if(arg == "--fast"){
+            options.bFast = true;
+            continue;
+        }
+        if(value.isEmpty())
+            return false;
+        a++;
+
+        if(arg == "--hours") options.fSeconds = value.getDoubleValue() * 3600.0;
+        else if(arg == "--minutes") options.fSeconds = value.getDoubleValue() * 60.0;
+        else if(arg == "--seconds") options.fSeconds = value.getDoubleValue();
+        else if(arg == "--rate") options.fSampleRate = value.getDoubleValue();
+        else if(arg == "--density") options.fDensity = value.getDoubleValue();
+        else if(arg == "--play") options.fPlaySeconds = value.getDoubleValue();
+        else if(arg == "--rest") options.fRestSeconds = value.getDoubleValue();
+        else if(arg == "--report") options.fReportSeconds = value.getDoubleValue();
+        else if(arg == "--max-xruns") options.iMaxXruns = value.getIntValue();
+        else if(arg == "--max-growth") options.fMaxGrowthMB = value.getDoubleValue();
+        else if(arg == "--resources") options.resources = File::getCurrentWorkingDirectory().getChildFile(value).getFullPathName();
+        else if(arg == "--block"){
+            StringArray sizes;
+            sizes.addTokens(value, ",", String::empty);
+            for(int s = 0; s < sizes.size(); s++)
+                if(sizes[s].getIntValue() > 0)
+                    options.blockSizes.add(sizes[s].getIntValue());
+        }
+        else
+            return false;
+    }
+
+    if(options.blockSizes.size() == 0)
+        options.blockSizes.add(256);
+
+    return options.fSampleRate > 0.0 && options.fDensity > 0.0 && options.fPlaySeconds > 0.0
+        && options.fRestSeconds >= 0.0 && options.fReportSeconds > 0.0;
+}
+
+int main (int argc, char* argv[])
+{
+    SoakOptions options;
+    if(!parseOptions(argc, argv, options)){
+        printf("usage: SoakHost [--hours <h>] [--minutes <m>] [--seconds <s>] [--rate <hz>]\n"
+               "                [--block <n>[,<n>...]] [--density <hits per second>] [--play <s>]\n"
+               "                [--rest <s>] [--report <s>] [--max-xruns <n>] [--max-growth <MB>]\n"
+               "                [--resources <folder>] [--fast]\n");
+        return 1;
+    }
+
+    if(options.resources.isNotEmpty())
+        setResourcePath(options.resources.toStdString());
+    if(!File(getResourcePath().c_str()).isDirectory()){
+        printf("SoakHost - no resources in %s (use --resources or TESTSYNTHAU_RESOURCES)\n", getResourcePath().c_str());
+        return 1;
+    }
+
+    const int iMaxBlockSize = options.getMaxBlockSize();
+    ScopedPointer<PluginAudioProcessor> processor (new PluginAudioProcessor());
+    processor->setPlayConfigDetails(0, 2, options.fSampleRate, iMaxBlockSize);
+    processor->prepareToPlay(options.fSampleRate, iMaxBlockSize);
+    RealtimeGuard::resetViolations();
+
+    const String blocks (options.blockSizes.size() == 1 ? String(iMaxBlockSize) : "up to " + String(iMaxBlockSize) + " (ragged)");
+    printf("SoakHost - %.1fs at %.0fHz, blocks of %s, %.1f hits/s (%.0fs bursts, %.0fs rests)%s\n",
+           options.fSeconds, options.fSampleRate, blocks.toRawUTF8(),
+           options.fDensity, options.fPlaySeconds, options.fRestSeconds, options.bFast ? ", unpaced" : "");
+
+    NullDevice device (*processor, options);
+    device.startThread(10);
+
+    double fBaselineMB = 0.0, fGrowthMB = 0.0;
+    const uint32 iStarted = Time::getMillisecondCounter();
+    uint32 iNextReport = iStarted + (uint32) (options.fReportSeconds * 1000.0);
+
+    for(bool bRunning = true; bRunning;){
+        bRunning = !device.waitForThreadToExit(100);
+
+        // (the size after the first burst - the kit, caches and pools are all in by then)
+        if(fBaselineMB == 0.0 && device.numBursts.get() > 0)
+            fBaselineMB = getResidentMB();
+        if(fBaselineMB > 0.0)
+            fGrowthMB = jmax(fGrowthMB, getResidentMB() - fBaselineMB);
+
+        if(Time::getMillisecondCounter() >= iNextReport || !bRunning){
+            iNextReport += (uint32) (options.fReportSeconds * 1000.0);
+
+            const int iWorst = device.iWorstLoad.exchange(0);
+            printf("%9.1fs  %10lld blocks  xruns %d (%d late)  worst block %d%%  %.1fMB (+%.1f)  leaks %d/%d (%d voices, %d hits)  violations %d\n",
+                   device.numSamples.get() / options.fSampleRate, (long long) device.numCallbacks.get(), device.numXruns.get(), device.numLateStarts.get(), iWorst,
+                   getResidentMB(), fGrowthMB, device.numLeaks.get(), device.numLeakChecks.get(),
+                   device.iLeakedVoices.get(), device.iLeakedHits.get(), RealtimeGuard::getNumViolations());
+            fflush(stdout);
+        }
+    }
+
+    processor->releaseResources();
+
+    int numFailures = 0;
+    if(device.numXruns.get() > options.iMaxXruns){
+        printf("SoakHost - %d xrun(s), %d of them woken late\n", device.numXruns.get(), device.numLateStarts.get());
+        numFailures++;
+    }
+    if(device.numLeaks.get() > 0){
+        printf("SoakHost - voices or hits still sounding after %d of %d rests\n", device.numLeaks.get(), device.numLeakChecks.get());
+        numFailures++;
+    }
+    if(fGrowthMB > options.fMaxGrowthMB){
+        printf("SoakHost - memory grew by %.1fMB\n", fGrowthMB);
+        numFailures++;
+    }
+    if(RealtimeGuard::getNumViolations() > 0){
+        printf("SoakHost - %d real-time violation(s)\n", RealtimeGuard::getNumViolations());
+        numFailures++;
+    }
+
+    printf("SoakHost - %d failure(s)\n", numFailures);
+    return numFailures;
+}